@@ -0,0 +1,94 @@
+#include "corpus.hpp"
+#include "tags.hpp"
+#include "parallel.hpp"
+
+#include <fstream>
+#include <random>
+#include <cmath>
+
+namespace {
+
+class zipf_distribution {
+public:
+
+	zipf_distribution(size_t count, double exponent) {
+		cumulative.reserve(count);
+		double total{ 0.0 };
+		for (size_t k{ 1 }; k <= count; k++) {
+			total += 1.0 / std::pow(static_cast<double>(k), exponent);
+			cumulative.push_back(total);
+		}
+		for (auto& weight : cumulative) {
+			weight /= total;
+		}
+	}
+
+	template<typename Random>
+	size_t operator()(Random& random) {
+		const double value{ uniform(random) };
+		const auto found = std::lower_bound(cumulative.begin(), cumulative.end(), value);
+		return std::min(static_cast<size_t>(found - cumulative.begin()), cumulative.size() - 1);
+	}
+
+private:
+
+	std::vector<double> cumulative;
+	std::uniform_real_distribution<double> uniform{ 0.0, 1.0 };
+
+};
+
+}
+
+corpus_layout make_corpus_layout(const corpus_options& options) {
+	std::mt19937 random{ options.seed };
+	corpus_layout layout;
+	for (size_t i{ 0 }; i < std::max<size_t>(options.tag_count, 1); i++) {
+		layout.tag_names.push_back("tag" + std::to_string(i));
+	}
+	// every directory at a level gets the same number of subdirectories, down to the depth.
+	layout.directories.emplace_back();
+	size_t level_begin{ 0 };
+	for (int level{ 0 }; level < options.depth; level++) {
+		const size_t level_end{ layout.directories.size() };
+		for (size_t parent{ level_begin }; parent < level_end; parent++) {
+			for (int child{ 0 }; child < options.directories_per_level; child++) {
+				layout.directories.push_back(layout.directories[parent] / ("dir" + std::to_string(child)));
+			}
+		}
+		level_begin = level_end;
+	}
+	const std::vector<std::string> words{ "holiday", "screenshot", "IMG", "scan", "notes", "wallpaper", "report", "cat" };
+	const std::vector<std::string> extensions{ ".jpg", ".png", ".txt", ".pdf", ".webp" };
+	zipf_distribution tag_distribution{ layout.tag_names.size(), options.zipf_exponent };
+	std::uniform_int_distribution<int> tags_per_file{ 0, std::max(options.max_tags_per_file, 0) };
+	std::uniform_int_distribution<size_t> directory_distribution{ 0, layout.directories.size() - 1 };
+	std::uniform_int_distribution<size_t> word_distribution{ 0, words.size() - 1 };
+	std::uniform_int_distribution<size_t> extension_distribution{ 0, extensions.size() - 1 };
+	layout.files.reserve(options.file_count);
+	for (size_t i{ 0 }; i < options.file_count; i++) {
+		std::vector<std::string> file_tags;
+		const int count{ tags_per_file(random) };
+		for (int j{ 0 }; j < count; j++) {
+			const auto& tag = layout.tag_names[tag_distribution(random)];
+			if (std::find(file_tags.begin(), file_tags.end(), tag) == file_tags.end()) {
+				file_tags.push_back(tag);
+			}
+		}
+		const auto& directory = layout.directories[directory_distribution(random)];
+		const auto name = words[word_distribution(random)] + "_" + std::to_string(i) + extensions[extension_distribution(random)];
+		layout.files.push_back(directory / std::filesystem::u8path(tags::make_tag_string(file_tags) + name));
+	}
+	return layout;
+}
+
+size_t write_corpus(const std::filesystem::path& root, const corpus_layout& layout) {
+	for (const auto& directory : layout.directories) {
+		std::filesystem::create_directories(root / directory);
+	}
+	std::atomic<size_t> failures{ 0 };
+	parallel_for(layout.files.size(), [&](size_t index) {
+		std::ofstream file{ root / layout.files[index] };
+		failures += file ? 0 : 1;
+	});
+	return failures;
+}
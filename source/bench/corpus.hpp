@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <cstdint>
+
+struct corpus_options {
+	size_t file_count{ 100000 };
+	int depth{ 3 };
+	int directories_per_level{ 8 };
+	int max_tags_per_file{ 4 };
+	size_t tag_count{ 500 };
+	// tag k is picked with a probability proportional to 1 / k^s. 0 is uniform.
+	double zipf_exponent{ 1.0 };
+	uint32_t seed{ 1234 };
+};
+
+// The paths are relative to the corpus root, and file names look like "[tag1 tag2]name.ext".
+struct corpus_layout {
+	std::vector<std::string> tag_names;
+	std::vector<std::filesystem::path> directories;
+	std::vector<std::filesystem::path> files;
+};
+
+// Generates the same layout for the same options.
+corpus_layout make_corpus_layout(const corpus_options& options);
+
+// Creates the directories and empty files below the root. Returns the number of files that could not be created.
+size_t write_corpus(const std::filesystem::path& root, const corpus_layout& layout);
@@ -0,0 +1,62 @@
+#include "corpus.hpp"
+
+#include <iostream>
+#include <optional>
+
+namespace {
+
+void print_usage() {
+	std::cerr << "usage: milky-corpus [--files <count>] [--depth <levels>] [--fanout <directories>] [--tags-per-file <max>]\n"
+		"                    [--tags <count>] [--zipf <exponent>] [--seed <number>] [<root>]\n"
+		"\n"
+		"creates a tree of empty tagged files below the root, or a new temporary directory if no root is given.\n"
+		"the same options always create the same tree.\n";
+}
+
+std::optional<std::pair<corpus_options, std::filesystem::path>> parse_options(int argc, char** argv) {
+	corpus_options options;
+	std::filesystem::path root;
+	for (int i{ 1 }; i < argc; i++) {
+		const std::string_view option{ argv[i] };
+		const bool has_value{ i + 1 < argc };
+		if (option == "--files" && has_value) {
+			options.file_count = std::stoull(argv[++i]);
+		} else if (option == "--depth" && has_value) {
+			options.depth = std::stoi(argv[++i]);
+		} else if (option == "--fanout" && has_value) {
+			options.directories_per_level = std::stoi(argv[++i]);
+		} else if (option == "--tags-per-file" && has_value) {
+			options.max_tags_per_file = std::stoi(argv[++i]);
+		} else if (option == "--tags" && has_value) {
+			options.tag_count = std::stoull(argv[++i]);
+		} else if (option == "--zipf" && has_value) {
+			options.zipf_exponent = std::stod(argv[++i]);
+		} else if (option == "--seed" && has_value) {
+			options.seed = static_cast<uint32_t>(std::stoul(argv[++i]));
+		} else if (option[0] != '-' && root.empty()) {
+			root = std::filesystem::u8path(argv[i]);
+		} else {
+			return std::nullopt;
+		}
+	}
+	if (root.empty()) {
+		root = std::filesystem::temp_directory_path() / ("milky-corpus-" + std::to_string(options.seed) + "-" + std::to_string(options.file_count));
+	}
+	return std::make_pair(options, root);
+}
+
+}
+
+int main(int argc, char** argv) {
+	const auto options = parse_options(argc, argv);
+	if (!options) {
+		print_usage();
+		return 2;
+	}
+	const auto& [corpus, root] = options.value();
+	const auto layout = make_corpus_layout(corpus);
+	const size_t failures{ write_corpus(root, layout) };
+	std::cerr << "created " << layout.files.size() - failures << " files in " << layout.directories.size() << " directories\n";
+	std::cout << root.u8string() << "\n";
+	return failures > 0 ? 1 : 0;
+}
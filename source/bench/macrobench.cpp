@@ -0,0 +1,207 @@
+#include "corpus.hpp"
+#include "tags.hpp"
+#include "search.hpp"
+#include "parallel.hpp"
+#include "filesystem.hpp"
+
+#include <iostream>
+#include <chrono>
+#include <optional>
+#include <random>
+
+#if defined(_WIN32)
+#include <Windows.h>
+#include <Psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// Runs the scan, search and retag code on a generated tree. Each measurement is printed as one line of JSON
+// with the same names every run, so results from different commits can be compared directly.
+
+namespace {
+
+struct macro_options {
+	corpus_options corpus;
+	int search_repetitions{ 20 };
+	std::optional<fs::simulated_options> simulated_storage;
+	bool keep{ false };
+};
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double>{ std::chrono::steady_clock::now() - start }.count();
+}
+
+size_t peak_memory_kilobytes() {
+#if defined(_WIN32)
+	PROCESS_MEMORY_COUNTERS counters{};
+	GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+	return static_cast<size_t>(counters.PeakWorkingSetSize / 1024);
+#else
+	rusage usage{};
+	getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+	return static_cast<size_t>(usage.ru_maxrss / 1024); // bytes on macos.
+#else
+	return static_cast<size_t>(usage.ru_maxrss);
+#endif
+#endif
+}
+
+void print_metric(const std::string& name, double value, const std::string& unit) {
+	std::cout << "{\"name\":\"" << name << "\",\"value\":" << value << ",\"unit\":\"" << unit << "\"}\n";
+	std::cout.flush();
+}
+
+double percentile(std::vector<double> values, double fraction) {
+	if (values.empty()) {
+		return 0.0;
+	}
+	std::sort(values.begin(), values.end());
+	const auto index = static_cast<size_t>(fraction * static_cast<double>(values.size() - 1) + 0.5);
+	return values[std::min(index, values.size() - 1)];
+}
+
+void bench_search(const std::string& name, search_query query, const search_path_cache& cache, int repetitions) {
+	query.caches.push_back(&cache);
+	std::vector<double> milliseconds;
+	size_t matches{ 0 };
+	for (int i{ 0 }; i < repetitions; i++) {
+		const auto start = std::chrono::steady_clock::now();
+		matches = run_search(query)->paths.size();
+		milliseconds.push_back(seconds_since(start) * 1000.0);
+	}
+	print_metric("search_" + name + "_p50", percentile(milliseconds, 0.5), "ms");
+	print_metric("search_" + name + "_p99", percentile(milliseconds, 0.99), "ms");
+	print_metric("search_" + name + "_matches", static_cast<double>(matches), "files");
+}
+
+// Replaces a tag in every file that has it, the same way the command line tool does.
+void bench_retag(search_path_cache& cache, const std::string& old_tag, const std::string& new_tag) {
+	search_query query;
+	query.include_tags.push_back(old_tag);
+	query.caches.push_back(&cache);
+	const auto start = std::chrono::steady_clock::now();
+	const auto paths = run_search(query)->paths;
+	std::atomic<size_t> failures{ 0 };
+	parallel_for(paths.size(), [&](size_t index) {
+		auto file_tags = tags::parse_tags(paths[index].filename().u8string());
+		std::replace(file_tags.begin(), file_tags.end(), old_tag, new_tag);
+		std::error_code error;
+		const auto new_path = tags::rename_with_tags(paths[index], file_tags, error);
+		if (error) {
+			failures++;
+		} else {
+			cache.rename_path(paths[index], new_path);
+		}
+	});
+	cache.wait(); // the renames are applied on the change thread of the cache.
+	const double seconds{ seconds_since(start) };
+	print_metric("retag_files", static_cast<double>(paths.size()), "files");
+	print_metric("retag_failures", static_cast<double>(failures), "files");
+	print_metric("retag_seconds", seconds, "s");
+	print_metric("retag_throughput", static_cast<double>(paths.size()) / std::max(seconds, 1.0e-9), "files/s");
+}
+
+void print_usage() {
+	std::cerr << "usage: milky-macrobench [--files <count>] [--depth <levels>] [--fanout <directories>] [--tags-per-file <max>]\n"
+		"                         [--tags <count>] [--zipf <exponent>] [--seed <number>] [--repetitions <count>] [--keep]\n"
+		"                         [--latency <microseconds>] [--failure-rate <0 to 1>]\n"
+		"\n"
+		"--latency and --failure-rate simulate slow storage for every filesystem operation after the tree is created.\n";
+}
+
+std::optional<macro_options> parse_options(int argc, char** argv) {
+	macro_options options;
+	for (int i{ 1 }; i < argc; i++) {
+		const std::string_view option{ argv[i] };
+		const bool has_value{ i + 1 < argc };
+		if (option == "--files" && has_value) {
+			options.corpus.file_count = std::stoull(argv[++i]);
+		} else if (option == "--depth" && has_value) {
+			options.corpus.depth = std::stoi(argv[++i]);
+		} else if (option == "--fanout" && has_value) {
+			options.corpus.directories_per_level = std::stoi(argv[++i]);
+		} else if (option == "--tags-per-file" && has_value) {
+			options.corpus.max_tags_per_file = std::stoi(argv[++i]);
+		} else if (option == "--tags" && has_value) {
+			options.corpus.tag_count = std::stoull(argv[++i]);
+		} else if (option == "--zipf" && has_value) {
+			options.corpus.zipf_exponent = std::stod(argv[++i]);
+		} else if (option == "--seed" && has_value) {
+			options.corpus.seed = static_cast<uint32_t>(std::stoul(argv[++i]));
+		} else if (option == "--repetitions" && has_value) {
+			options.search_repetitions = std::max(std::stoi(argv[++i]), 1);
+		} else if ((option == "--latency" || option == "--failure-rate") && has_value) {
+			if (!options.simulated_storage) {
+				options.simulated_storage.emplace();
+			}
+			auto& simulated = options.simulated_storage.value();
+			for (auto operation : { &simulated.enumerate, &simulated.stat, &simulated.rename, &simulated.read, &simulated.hash, &simulated.attribute }) {
+				if (option == "--latency") {
+					operation->latency_microseconds = std::stoi(argv[i + 1]);
+				} else {
+					operation->failure_rate = std::stod(argv[i + 1]);
+				}
+			}
+			i++;
+		} else if (option == "--keep") {
+			options.keep = true;
+		} else {
+			return std::nullopt;
+		}
+	}
+	return options;
+}
+
+}
+
+int main(int argc, char** argv) {
+	const auto options = parse_options(argc, argv);
+	if (!options) {
+		print_usage();
+		return 2;
+	}
+	const auto root = std::filesystem::temp_directory_path() / ("milky-macrobench-" + std::to_string(std::random_device{}()));
+	tags::load(root / "milky.tags");
+
+	auto start = std::chrono::steady_clock::now();
+	const auto layout = make_corpus_layout(options->corpus);
+	write_corpus(root / "files", layout);
+	print_metric("corpus_files", static_cast<double>(layout.files.size()), "files");
+	print_metric("corpus_directories", static_cast<double>(layout.directories.size()), "directories");
+	print_metric("corpus_write_seconds", seconds_since(start), "s");
+	tags::create_tags("bench", layout.tag_names);
+	if (options->simulated_storage) {
+		fs::set_backend(std::make_shared<fs::simulated_backend>(fs::current_backend(), options->simulated_storage.value()));
+		print_metric("simulated_latency", options->simulated_storage->stat.latency_microseconds, "us");
+		print_metric("simulated_failure_rate", options->simulated_storage->stat.failure_rate, "ratio");
+	}
+
+	start = std::chrono::steady_clock::now();
+	search_path_cache cache{ root / "files" };
+	cache.wait();
+	const double scan_seconds{ seconds_since(start) };
+	print_metric("scan_seconds", scan_seconds, "s");
+	print_metric("scan_throughput", static_cast<double>(layout.files.size()) / std::max(scan_seconds, 1.0e-9), "files/s");
+
+	// with a skewed distribution the first tag is the most common, and the last tags are rare.
+	const auto& common_tag = layout.tag_names.front();
+	const auto& rare_tag = layout.tag_names.back();
+	const int repetitions{ options->search_repetitions };
+	bench_search("common_tag", { { common_tag } }, cache, repetitions);
+	bench_search("rare_tag", { { rare_tag } }, cache, repetitions);
+	bench_search("include_exclude", { { common_tag }, { layout.tag_names[layout.tag_names.size() / 2] } }, cache, repetitions);
+	bench_search("name", { {}, {}, "shot_12" }, cache, repetitions);
+
+	bench_retag(cache, common_tag, "retagged");
+	print_metric("peak_memory", static_cast<double>(peak_memory_kilobytes()), "KiB");
+
+	if (options->keep) {
+		std::cerr << "kept the corpus in " << root.u8string() << "\n";
+	} else {
+		std::error_code error;
+		std::filesystem::remove_all(root, error);
+	}
+	return 0;
+}
@@ -0,0 +1,334 @@
+#include "corpus.hpp"
+#include "tags.hpp"
+#include "search.hpp"
+#include "index.hpp"
+#include "sort.hpp"
+#include "parallel.hpp"
+#include "image.hpp"
+#include "filesystem.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <random>
+
+// Measures the hot paths of the core library on generated data. Each benchmark prints one line of JSON,
+// so the results can be collected and compared between builds.
+
+namespace {
+
+struct bench_options {
+	size_t path_count{ 200000 };
+	size_t tag_count{ 2000 };
+	size_t rename_count{ 5000 };
+	double min_seconds{ 0.5 };
+	std::string filter;
+	std::filesystem::path image_path;
+	bool csv{ false };
+};
+
+struct bench_result {
+	std::string name;
+	size_t operations{ 0 }; // per run.
+	size_t runs{ 0 };
+	double best_seconds{ 0.0 };
+	double mean_seconds{ 0.0 };
+
+	double nanoseconds_per_operation() const {
+		return best_seconds * 1.0e9 / static_cast<double>(std::max<size_t>(operations, 1));
+	}
+
+	double operations_per_second() const {
+		return static_cast<double>(operations) / std::max(best_seconds, 1.0e-9);
+	}
+};
+
+// Keeps the optimizer from removing work where the result is not used otherwise.
+volatile size_t sink{ 0 };
+
+void print_header(const bench_options& options) {
+	if (options.csv) {
+		std::cout << "name,operations,runs,best_seconds,mean_seconds,ns_per_op,ops_per_second\n";
+	}
+}
+
+void print_result(const bench_result& result, const bench_options& options) {
+	if (options.csv) {
+		std::cout << result.name << "," << result.operations << "," << result.runs << "," << result.best_seconds << ","
+			<< result.mean_seconds << "," << result.nanoseconds_per_operation() << "," << result.operations_per_second() << "\n";
+	} else {
+		std::cout << "{\"name\":\"" << result.name << "\",\"operations\":" << result.operations << ",\"runs\":" << result.runs
+			<< ",\"best_seconds\":" << result.best_seconds << ",\"mean_seconds\":" << result.mean_seconds
+			<< ",\"ns_per_op\":" << result.nanoseconds_per_operation() << ",\"ops_per_second\":" << result.operations_per_second() << "}\n";
+	}
+	std::cout.flush();
+}
+
+// Runs the function once to warm up, then until it has run for at least the minimum time.
+template<typename F>
+void measure(const std::string& name, size_t operations, const bench_options& options, F&& run) {
+	if (!options.filter.empty() && name.find(options.filter) == std::string::npos) {
+		return;
+	}
+	run();
+	bench_result result;
+	result.name = name;
+	result.operations = operations;
+	result.best_seconds = std::numeric_limits<double>::max();
+	double total_seconds{ 0.0 };
+	while (total_seconds < options.min_seconds || result.runs < 3) {
+		const auto start = std::chrono::steady_clock::now();
+		run();
+		const std::chrono::duration<double> elapsed{ std::chrono::steady_clock::now() - start };
+		result.best_seconds = std::min(result.best_seconds, elapsed.count());
+		total_seconds += elapsed.count();
+		result.runs++;
+	}
+	result.mean_seconds = total_seconds / static_cast<double>(result.runs);
+	print_result(result, options);
+}
+
+struct corpus {
+	std::vector<std::string> tag_names;
+	std::vector<std::string> filenames;
+	std::vector<std::filesystem::path> paths;
+};
+
+corpus make_corpus(const bench_options& options) {
+	corpus_options layout_options;
+	layout_options.file_count = options.path_count;
+	layout_options.tag_count = options.tag_count;
+	layout_options.depth = 2;
+	auto layout = make_corpus_layout(layout_options);
+	corpus result;
+	result.tag_names = std::move(layout.tag_names);
+	for (const auto& file : layout.files) {
+		result.filenames.push_back(file.filename().u8string());
+		result.paths.push_back("/bench" / file);
+	}
+	return result;
+}
+
+void bench_tag_parsing(const corpus& data, const bench_options& options) {
+	measure("parse_tags", data.filenames.size(), options, [&] {
+		size_t total{ 0 };
+		for (const auto& filename : data.filenames) {
+			total += tags::parse_tags(filename).size();
+		}
+		sink = total;
+	});
+	measure("filename_without_tags", data.filenames.size(), options, [&] {
+		size_t total{ 0 };
+		for (const auto& filename : data.filenames) {
+			total += tags::filename_without_tags(filename).size();
+		}
+		sink = total;
+	});
+	measure("make_tag_string", data.filenames.size(), options, [&] {
+		size_t total{ 0 };
+		for (const auto& filename : data.filenames) {
+			total += tags::make_tag_string(tags::parse_tags(filename)).size();
+		}
+		sink = total;
+	});
+}
+
+void bench_registry(const corpus& data, const bench_options& options) {
+	constexpr size_t lookups{ 10000 };
+	std::mt19937 random{ 5678 };
+	std::uniform_int_distribution<size_t> tag_distribution{ 0, data.tag_names.size() - 1 };
+	std::vector<std::string> names;
+	for (size_t i{ 0 }; i < lookups; i++) {
+		names.push_back(data.tag_names[tag_distribution(random)]);
+	}
+	measure("registry_find_tag", lookups, options, [&] {
+		size_t found{ 0 };
+		for (const auto& name : names) {
+			found += tags::find_tag(name) ? 1 : 0;
+		}
+		sink = found;
+	});
+	std::vector<std::string> prefixes;
+	for (const auto& name : names) {
+		prefixes.push_back(name.substr(0, 4));
+	}
+	measure("registry_complete", lookups, options, [&] {
+		size_t total{ 0 };
+		for (const auto& prefix : prefixes) {
+			total += tags::complete(prefix, 10).size();
+		}
+		sink = total;
+	});
+}
+
+void bench_filter(const corpus& data, const bench_options& options) {
+	search_path_cache cache{ "/bench", data.paths };
+	cache.wait();
+	search_query tag_query;
+	tag_query.include_tags.push_back(data.tag_names[0]);
+	tag_query.exclude_tags.push_back(data.tag_names[1]);
+	tag_query.caches.push_back(&cache);
+	measure("filter_tags", data.paths.size(), options, [&] {
+		sink = run_search(tag_query)->paths.size();
+	});
+	search_query name_query;
+	name_query.name_contains = "shot_1";
+	name_query.caches.push_back(&cache);
+	measure("filter_name", data.paths.size(), options, [&] {
+		sink = run_search(name_query)->paths.size();
+	});
+}
+
+void bench_index(const corpus& data, const bench_options& options) {
+	std::vector<std::string> names;
+	for (const auto& filename : data.filenames) {
+		names.push_back(tags::filename_without_tags(filename));
+	}
+	measure("name_index_build", names.size(), options, [&] {
+		name_index index;
+		for (size_t id{ 0 }; id < names.size(); id++) {
+			index.add(static_cast<uint32_t>(id), names[id]);
+		}
+		sink = index.memory_usage();
+	});
+	name_index index;
+	for (size_t id{ 0 }; id < names.size(); id++) {
+		index.add(static_cast<uint32_t>(id), names[id]);
+	}
+	const std::vector<std::string> queries{ "holiday_1", "screenshot", "_42", "scan_9", "notes_12", "report" };
+	measure("name_index_candidates", queries.size(), options, [&] {
+		size_t total{ 0 };
+		for (const auto& query : queries) {
+			total += index.candidates(query)->size();
+		}
+		sink = total;
+	});
+	measure("sort_by_name", names.size(), options, [&] {
+		std::vector<entry_sort_key> keys;
+		keys.reserve(names.size());
+		for (const auto& name : names) {
+			auto& key = keys.emplace_back();
+			key.name = make_collation_key(name);
+		}
+		sink = sorted_order(keys, {}).size();
+	});
+}
+
+void bench_rename(const corpus& data, const bench_options& options) {
+	const auto directory = std::filesystem::temp_directory_path() / ("milky-bench-" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()));
+	std::filesystem::create_directories(directory);
+	const size_t count{ std::min(options.rename_count, data.filenames.size()) };
+	std::vector<std::filesystem::path> paths;
+	for (size_t i{ 0 }; i < count; i++) {
+		paths.push_back(directory / std::filesystem::u8path(data.filenames[i]));
+		std::ofstream{ paths.back() };
+	}
+	// every run toggles the first tag, so the files are renamed each time.
+	const auto& tag = data.tag_names[0];
+	measure("rename_batch", count, options, [&] {
+		std::atomic<size_t> failures{ 0 };
+		parallel_for(paths.size(), [&](size_t index) {
+			auto file_tags = tags::parse_tags(paths[index].filename().u8string());
+			if (const auto found = std::find(file_tags.begin(), file_tags.end(), tag); found != file_tags.end()) {
+				file_tags.erase(found);
+			} else {
+				file_tags.push_back(tag);
+			}
+			std::error_code error;
+			paths[index] = tags::rename_with_tags(paths[index], file_tags, error);
+			failures += error ? 1 : 0;
+		});
+		sink = failures;
+	});
+	std::error_code error;
+	std::filesystem::remove_all(directory, error);
+}
+
+void bench_image(const bench_options& options) {
+	constexpr int thumbnail_size{ 256 };
+	decoded_image source;
+	source.width = 2048;
+	source.height = 1536;
+	source.pixels.resize(static_cast<size_t>(source.width) * source.height);
+	for (size_t i{ 0 }; i < source.pixels.size(); i++) {
+		source.pixels[i] = static_cast<uint32_t>(i * 2654435761u) | 0xff000000u;
+	}
+	measure("downscale_2048_to_256", 1, options, [&] {
+		sink = downscale(source, thumbnail_size, thumbnail_size * 3 / 4).pixels.size();
+	});
+	if (options.image_path.empty()) {
+		return;
+	}
+	std::error_code error;
+	const auto data = fs::read(options.image_path, std::numeric_limits<size_t>::max() / 2, error);
+	if (error || !decode_thumbnail(data, thumbnail_size)) {
+		std::cerr << "can't decode " << options.image_path.u8string() << "\n";
+		return;
+	}
+	// decoding at a reduced size first should be much faster than decoding everything and then resizing.
+	measure("thumbnail_decode_scaled", 1, options, [&] {
+		sink = decode_thumbnail(data, thumbnail_size, true)->pixels.size();
+	});
+	measure("thumbnail_decode_full", 1, options, [&] {
+		sink = decode_thumbnail(data, thumbnail_size, false)->pixels.size();
+	});
+}
+
+void print_usage() {
+	std::cerr << "usage: milky-bench [--paths <count>] [--tags <count>] [--renames <count>] [--min-seconds <seconds>] [--filter <name>] [--image <file>] [--csv]\n";
+}
+
+std::optional<bench_options> parse_options(int argc, char** argv) {
+	bench_options options;
+	for (int i{ 1 }; i < argc; i++) {
+		const std::string_view option{ argv[i] };
+		const bool has_value{ i + 1 < argc };
+		if (option == "--paths" && has_value) {
+			options.path_count = std::max(std::stoull(argv[++i]), 1ULL);
+		} else if (option == "--tags" && has_value) {
+			options.tag_count = std::max(std::stoull(argv[++i]), 2ULL);
+		} else if (option == "--renames" && has_value) {
+			options.rename_count = std::stoull(argv[++i]);
+		} else if (option == "--min-seconds" && has_value) {
+			options.min_seconds = std::stod(argv[++i]);
+		} else if (option == "--filter" && has_value) {
+			options.filter = argv[++i];
+		} else if (option == "--image" && has_value) {
+			options.image_path = std::filesystem::u8path(argv[++i]);
+		} else if (option == "--csv") {
+			options.csv = true;
+		} else {
+			return std::nullopt;
+		}
+	}
+	return options;
+}
+
+}
+
+int main(int argc, char** argv) {
+	const auto options = parse_options(argc, argv);
+	if (!options) {
+		print_usage();
+		return 2;
+	}
+	// the registry is saved on changes, so keep it away from the real one.
+	const auto registry_path = std::filesystem::temp_directory_path() / "milky-bench.tags";
+	std::error_code error;
+	std::filesystem::remove(registry_path, error);
+	tags::load(registry_path);
+	const auto data = make_corpus(options.value());
+	tags::create_tags("bench", data.tag_names);
+	for (const auto& tag : data.tag_names) {
+		tags::add_usage(tag, static_cast<int64_t>(std::hash<std::string>{}(tag) % 1000));
+	}
+	print_header(options.value());
+	bench_tag_parsing(data, options.value());
+	bench_registry(data, options.value());
+	bench_filter(data, options.value());
+	bench_index(data, options.value());
+	bench_rename(data, options.value());
+	bench_image(options.value());
+	std::filesystem::remove(registry_path, error);
+	return 0;
+}
@@ -2,17 +2,23 @@
 #include "camera.hpp"
 #include "ui.hpp"
 #include "window.hpp"
+#include "profiler.hpp"
+#include "filesystem.hpp"
+#include "parallel.hpp"
 
-#include <set>
+#include <numeric>
+#include <unordered_set>
 
-file_browser::file_browser(no::window& window, no::mouse& mouse, no::keyboard& keyboard) : window{ window }, mouse { mouse }, keyboard{ keyboard } {
+file_browser::file_browser(no::window& window, no::mouse& mouse, no::keyboard& keyboard, frame_scheduler& scheduler)
+	: loader{ scheduler }, window{ window }, mouse{ mouse }, keyboard{ keyboard }, scheduler{ scheduler } {
 	root_directories = no::platform::get_root_directories(); // todo: update this every now and then
 	load_directory(config.default_open_path);
 }
 
 void file_browser::update() {
 	new_cursor = no::platform::system_cursor::arrow;
-	if (entries.size() > 0) {
+	update_sort();
+	if (entry_paths.size() > 0) {
 		update_entries();
 		loader.update();
 	} else {
@@ -31,7 +37,11 @@ void file_browser::update_start() {
 
 	no::ui::text("Input the directory you wish to open by default.");
 	no::ui::input("##config-default-path", config.default_open_path);
-	bool valid{ std::filesystem::is_directory(config.default_open_path) };
+	if (checked_default_path != config.default_open_path) {
+		checked_default_path = config.default_open_path;
+		default_path_is_directory = fs::is_directory(std::filesystem::u8path(checked_default_path));
+	}
+	const bool valid{ default_path_is_directory };
 	if (!valid) {
 		no::ui::begin_disabled();
 	}
@@ -61,6 +71,7 @@ void file_browser::update_start() {
 }
 
 void file_browser::update_entries() {
+	PROFILE_ZONE("update_entries");
 	const auto window_size = window.size().to<float>() - top_left_position;
 	if (window_size.x < 0.0f || window_size.y < 0.0f) {
 		return;
@@ -71,8 +82,8 @@ void file_browser::update_entries() {
 	ImGui::BeginGroup();
 	ImGui::PushStyleVar(ImGuiStyleVar_FramePadding, { 0, 0 });
 	ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, { 0, 0 });
-	const int column_count{ static_cast<int>(window_size.x / entry_full_size.x) };
-	const int entry_count{ static_cast<int>(entries.size()) };
+	const int column_count{ std::max(static_cast<int>(window_size.x / entry_full_size.x), 1) };
+	const int entry_count{ static_cast<int>(entry_paths.size()) };
 	const int last_column_count{ entry_count % column_count };
 	int total_rows{ entry_count / column_count };
 	if (last_column_count > 0) {
@@ -84,8 +95,8 @@ void file_browser::update_entries() {
 			for (int column{ 0 }; column < column_count; column++) {
 				int entry_index{ row * column_count + column };
 				if (entry_index < entry_count) {
-					auto& entry = entries[entry_index];
-					directory_entry_control(entry);
+					auto& entry = entry_at(entry_index);
+					directory_entry_control(entry_index, entry);
 					entry.visible = true;
 				}
 			}
@@ -95,9 +106,9 @@ void file_browser::update_entries() {
 	ImGui::EndGroup();
 	no::ui::pop_window();
 
-	for (auto& entry : entries) {
-		if (entry.double_clicked) {
-			if (const auto path = entry.path; std::filesystem::is_directory(path)) {
+	for (auto& [index, entry] : materialized_entries) {
+		if (entry->double_clicked) {
+			if (const auto path = entry->path; fs::is_directory(path)) {
 				if (config.double_click_opens_directories) {
 					load_directory(path);
 				}
@@ -107,75 +118,147 @@ void file_browser::update_entries() {
 				}
 			}
 			break;
-		} else if (entry.left_clicked) {
+		} else if (entry->left_clicked) {
 			if (keyboard.is_key_down(no::key::left_shift)) {
-				if (!single_selected_entry) {
-					single_selected_entry = &entries[0];
+				if (anchor_index == -1) {
+					anchor_index = 0;
 				} else {
 					clear_selection();
 				}
-				for (auto middle : entries_between(single_selected_entry, &entry)) {
-					middle->selected = true;
-				}
+				select_range(anchor_index, index);
 			} else {
 				if (!keyboard.is_key_down(no::key::left_control)) {
 					clear_selection();
 				}
-				if (selected_entries().empty()) {
-					single_selected_entry = &entry;
+				if (selected_indices().empty()) {
+					anchor_index = index;
 				}
-				entry.selected = !entry.selected;
+				select(index, !selection[index]);
 			}
 			break;
-		} else if (entry.right_clicked) {
-			if (!entry.selected) {
+		} else if (entry->right_clicked) {
+			if (!selection[index]) {
 				clear_selection();
 			}
-			entry.selected = true;
-			context_entry = &entry;
-			single_selected_entry = &entry;
+			select(index, true);
+			context_index = index;
+			context_is_directory = fs::is_directory(entry_paths[index]);
+			find_context_tags();
+			anchor_index = index;
 			ImGui::OpenPopup("##entry-context");
 			break;
 		}
 	}
 
 	update_entry_context_menu();
+	update_add_tag_popup();
 
-	for (auto& entry : entries) {
-		entry.update();
-		if (entry.visible && !entry.has_requested_thumbnail) {
-			loader.load(entry.path, 256, entry.thumbnail_texture);
-			entry.has_requested_thumbnail = true;
+	// entries keep their current thumbnail until the level for the new zoom is ready, and only visible entries are reloaded.
+	const int thumbnail_size{ thumbnail_loader::level_for_size(std::max(entry_size.x, entry_size.y)) };
+	for (auto materialized = materialized_entries.begin(); materialized != materialized_entries.end();) {
+		auto& [index, entry] = *materialized;
+		if (entry->update()) {
+			if (on_entry_renamed) {
+				on_entry_renamed(entry_paths[index], entry->path);
+			}
+			entry_paths[index] = entry->path;
+		}
+		if (entry->visible) {
+			if (entry->thumbnail_size != thumbnail_size) {
+				loader.load(entry->path, thumbnail_size, entry->thumbnail_texture);
+				entry->thumbnail_size = thumbnail_size;
+			}
+			entry->visible = false;
+			materialized++;
+		} else {
+			release_entry(*entry);
+			materialized = materialized_entries.erase(materialized);
 		}
-		entry.visible = false;
 	}
 }
 
 bool file_browser::is_active() const {
-	return !context_entry && !no::ui::is_hovered();
+	return context_index == -1 && !ImGui::IsPopupOpen("##entry-add-tag") && !no::ui::is_hovered();
 }
 
 void file_browser::clear_entries() {
-	entries.clear();
+	for (auto& [index, entry] : materialized_entries) {
+		release_entry(*entry);
+	}
+	materialized_entries.clear();
+	if (!entry_paths.empty()) {
+		// freeing many paths takes a while, so they are freed over a few frames.
+		auto released_paths = std::make_shared<std::vector<std::filesystem::path>>(std::move(entry_paths));
+		scheduler.post(task_priority::low, "release_paths", [released_paths] {
+			constexpr size_t paths_per_step{ 16384 };
+			released_paths->resize(released_paths->size() - std::min(paths_per_step, released_paths->size()));
+			return !released_paths->empty();
+		});
+	}
+	entry_paths.clear();
+	pending_sort_paths = nullptr;
+	selection.clear();
+	is_selection_changed = true;
+	sort_keys = nullptr;
+	sort_key_indices.clear();
+	context_index = -1;
+	anchor_index = -1;
+	entry_order_version++;
 }
 
 void file_browser::load_directory(const std::filesystem::path& path) {
-	if (std::filesystem::is_directory(path)) {
+	if (fs::is_directory(path)) {
 		directory_history.push_back(path);
-		entries = directory_entry::load_from_directory(path);
+		load_paths(directory_entry::paths_in_directory(path));
 	} else {
 		WARNING("Invalid directory: " << path);
 		clear_entries();
 	}
 }
 
-void file_browser::load_paths(const std::vector<std::filesystem::path>& paths) {
+void file_browser::load_paths(std::vector<std::filesystem::path> paths) {
 	clear_entries();
-	for (const auto& path : paths) {
-		entries.emplace_back(path);
+	entry_paths = std::move(paths);
+	selection.resize(entry_paths.size());
+	if (sort_settings.order != sort_order::none) {
+		start_sort();
 	}
 }
 
+void file_browser::rename_paths(const std::vector<std::pair<std::filesystem::path, std::filesystem::path>>& renames) {
+	auto new_paths = std::make_shared<std::unordered_map<std::string, std::filesystem::path>>();
+	for (const auto& [from, to] : renames) {
+		new_paths->emplace(from.u8string(), to);
+	}
+	scheduler.post(task_priority::high, "rename_entries", [this, new_paths, next_index = 0, order_version = entry_order_version]() mutable {
+		constexpr int entries_per_step{ 4096 };
+		if (order_version != entry_order_version) {
+			// the renamed paths are looked up by path, so it's safe to start over in the new order.
+			order_version = entry_order_version;
+			next_index = 0;
+		}
+		const int end{ std::min(next_index + entries_per_step, static_cast<int>(entry_paths.size())) };
+		for (; next_index < end; next_index++) {
+			const auto new_path = new_paths->find(entry_paths[next_index].u8string());
+			if (new_path == new_paths->end()) {
+				continue;
+			}
+			entry_paths[next_index] = new_path->second;
+			// the entry has the old tags, so it's created again when it's visible.
+			if (const auto materialized = materialized_entries.find(next_index); materialized != materialized_entries.end()) {
+				release_entry(*materialized->second);
+				materialized_entries.erase(materialized);
+			}
+		}
+		if (next_index < static_cast<int>(entry_paths.size())) {
+			return true;
+		}
+		sort_keys = nullptr; // the tags may have changed.
+		sort_key_indices.clear();
+		return false;
+	});
+}
+
 void file_browser::pop_history() {
 	if (directory_history.size() > 1) {
 		directory_history.pop_back();
@@ -185,47 +268,182 @@ void file_browser::pop_history() {
 }
 
 void file_browser::clear_selection() {
-	for (auto& entry : entries) {
-		entry.selected = false;
-	}
+	selection.assign(selection.size(), false);
+	is_selection_changed = true;
 }
 
 void file_browser::select_all() {
-	for (auto& entry : entries) {
-		entry.selected = true;
-	}
+	selection.assign(selection.size(), true);
+	is_selection_changed = true;
+}
+
+void file_browser::select(int index, bool selected) {
+	selection[index] = selected;
+	is_selection_changed = true;
 }
 
-std::vector<directory_entry*> file_browser::selected_entries() {
-	std::vector<directory_entry*> result;
-	for (auto& entry : entries) {
-		if (entry.selected) {
-			result.push_back(&entry);
+const std::vector<int>& file_browser::selected_indices() {
+	if (is_selection_changed) {
+		is_selection_changed = false;
+		selected_index_cache.clear();
+		for (int index{ 0 }; index < static_cast<int>(selection.size()); index++) {
+			if (selection[index]) {
+				selected_index_cache.push_back(index);
+			}
 		}
 	}
-	return result;
+	return selected_index_cache;
 }
 
-std::vector<directory_entry*> file_browser::entries_between(directory_entry* from, directory_entry* to) {
-	if (from == to) {
-		return { from };
+std::vector<std::filesystem::path> file_browser::selected_paths() {
+	std::vector<std::filesystem::path> result;
+	result.reserve(selected_indices().size());
+	for (const auto index : selected_indices()) {
+		result.push_back(entry_paths[index]);
 	}
+	return result;
+}
+
+void file_browser::select_range(int from, int to) {
 	if (from > to) {
 		std::swap(from, to);
 	}
-	std::vector<directory_entry*> result;
-	for (auto& entry : entries) {
-		if (&entry == from || !result.empty()) {
-			result.push_back(&entry);
+	for (int index{ from }; index <= to; index++) {
+		selection[index] = true;
+	}
+	is_selection_changed = true;
+}
+
+directory_entry& file_browser::entry_at(int index) {
+	auto& entry = materialized_entries[index];
+	if (!entry) {
+		entry = &entry_pool.acquire(entry_paths[index]);
+	}
+	return *entry;
+}
+
+void file_browser::release_entry(directory_entry& entry) {
+	loader.cancel(entry.thumbnail_texture);
+	entry_pool.release(entry);
+}
+
+void file_browser::sort_entries(const sort_options& options) {
+	sort_settings = options;
+	start_sort();
+}
+
+const sort_options& file_browser::sorting() const {
+	return sort_settings;
+}
+
+bool file_browser::is_sorting() const {
+	return pending_sort.valid() || pending_sort_paths;
+}
+
+void file_browser::start_sort() {
+	if (pending_sort.valid()) {
+		*pending_sort_cancelled = true;
+		cancelled_sorts.push_back(std::move(pending_sort));
+	}
+	pending_sort_order_version = entry_order_version;
+	// the file system is only touched when the keys are created. otherwise, only the order is recalculated.
+	if (sort_keys) {
+		pending_sort_paths = nullptr;
+		run_sort({});
+		return;
+	}
+	// copying many paths takes a while, so they are copied for the sort thread over a few frames.
+	auto paths = std::make_shared<std::vector<std::filesystem::path>>();
+	paths->reserve(entry_paths.size());
+	pending_sort_paths = paths;
+	scheduler.post(task_priority::high, "copy_sort_paths", [this, paths] {
+		constexpr size_t paths_per_step{ 16384 };
+		if (pending_sort_paths != paths || pending_sort_order_version != entry_order_version) {
+			return false; // sorted again, or other paths were loaded.
 		}
-		if (&entry == to) {
-			break;
+		const size_t begin{ paths->size() };
+		const size_t end{ std::min(begin + paths_per_step, entry_paths.size()) };
+		paths->insert(paths->end(), entry_paths.begin() + begin, entry_paths.begin() + end);
+		if (end < entry_paths.size()) {
+			return true;
+		}
+		pending_sort_paths = nullptr;
+		run_sort(std::move(*paths));
+		return false;
+	});
+}
+
+void file_browser::run_sort(std::vector<std::filesystem::path> paths) {
+	auto cancelled = std::make_shared<std::atomic<bool>>(false);
+	pending_sort_cancelled = cancelled;
+	auto key_indices = sort_keys ? sort_key_indices : std::vector<uint32_t>{};
+	pending_sort = std::async(std::launch::async, [paths{ std::move(paths) }, key_indices{ std::move(key_indices) }, keys{ sort_keys }, options{ sort_settings }, cancelled]() mutable {
+		sort_result result;
+		if (keys) {
+			result.keys = keys;
+		} else {
+			result.keys = std::make_shared<const std::vector<entry_sort_key>>(make_sort_keys(paths, *cancelled));
+			key_indices.resize(paths.size());
+			std::iota(key_indices.begin(), key_indices.end(), 0);
+		}
+		if (*cancelled || key_indices.size() != result.keys->size()) {
+			return result;
+		}
+		result.key_order = sorted_order(*result.keys, options);
+		// the entries are in the order of the last sort, so the new order is given as their current positions.
+		std::vector<uint32_t> position_of_key(key_indices.size());
+		for (uint32_t position{ 0 }; position < key_indices.size(); position++) {
+			position_of_key[key_indices[position]] = position;
+		}
+		result.positions.reserve(result.key_order.size());
+		for (const auto key : result.key_order) {
+			result.positions.push_back(position_of_key[key]);
+		}
+		return result;
+	});
+}
+
+void file_browser::update_sort() {
+	for (int i{ 0 }; i < static_cast<int>(cancelled_sorts.size()); i++) {
+		if (no::is_future_ready(cancelled_sorts[i])) {
+			cancelled_sorts.erase(cancelled_sorts.begin() + i);
+			i--;
 		}
 	}
-	return result;
+	if (!no::is_future_ready(pending_sort)) {
+		return;
+	}
+	auto result = pending_sort.get();
+	if (*pending_sort_cancelled || pending_sort_order_version != entry_order_version || result.positions.size() != entry_paths.size()) {
+		return;
+	}
+	sort_keys = std::move(result.keys);
+	apply_order(std::move(result.positions), std::move(result.key_order));
+}
+
+void file_browser::apply_order(std::vector<uint32_t> positions, std::vector<uint32_t> key_order) {
+	for (auto& [index, entry] : materialized_entries) {
+		release_entry(*entry);
+	}
+	materialized_entries.clear();
+	std::vector<std::filesystem::path> sorted_paths;
+	std::vector<bool> sorted_selection;
+	sorted_paths.reserve(positions.size());
+	sorted_selection.reserve(positions.size());
+	for (const auto position : positions) {
+		sorted_paths.push_back(std::move(entry_paths[position]));
+		sorted_selection.push_back(selection[position]);
+	}
+	entry_paths = std::move(sorted_paths);
+	selection = std::move(sorted_selection);
+	is_selection_changed = true;
+	sort_key_indices = std::move(key_order);
+	context_index = -1;
+	anchor_index = -1;
+	entry_order_version++;
 }
 
-void file_browser::directory_entry_control(directory_entry& entry) {
+void file_browser::directory_entry_control(int index, directory_entry& entry) {
 	ImGui::BeginGroup();
 	const no::vector2f top_left_cursor{ ImGui::GetCursorScreenPos() };
 	auto tag_cursor = top_left_cursor + 4.0f;
@@ -238,7 +456,7 @@ void file_browser::directory_entry_control(directory_entry& entry) {
 	auto current_color = default_color;
 
 	ImGui::SetCursorScreenPos(top_left_cursor);
-	ImGui::InvisibleButton(CSTRING("entry" << &entry), entry_size);
+	ImGui::InvisibleButton(CSTRING("entry" << index), entry_size);
 	entry.double_clicked = false;
 	entry.left_clicked = false;
 	entry.right_clicked = false;
@@ -255,7 +473,7 @@ void file_browser::directory_entry_control(directory_entry& entry) {
 			entry.right_clicked = true;
 		}
 	}
-	if (entry.selected) {
+	if (selection[index]) {
 		current_color = config.entry_hover_color;
 	}
 
@@ -307,15 +525,53 @@ void file_browser::directory_entry_control(directory_entry& entry) {
 	}
 }
 
+void file_browser::find_context_tags() {
+	context_tags.clear();
+	pending_context_tags = {};
+	if (sort_keys && sort_key_indices.size() == entry_paths.size()) {
+		// the keys have the tags of every entry, and many entries have the same tags.
+		std::unordered_set<std::string_view> tag_strings;
+		for (const auto index : selected_indices()) {
+			tag_strings.insert((*sort_keys)[sort_key_indices[index]].tags);
+		}
+		for (const auto tag_string : tag_strings) {
+			for (auto& tag : tags::parse_tags("[" + std::string{ tag_string } + "]")) {
+				context_tags.insert(std::move(tag));
+			}
+		}
+		return;
+	}
+	pending_context_tags = std::async(std::launch::async, [paths = selected_paths()] {
+		std::vector<std::vector<std::string>> path_tags(paths.size());
+		parallel_for(paths.size(), [&](size_t index) {
+			path_tags[index] = tags::read_tags(paths[index]);
+		});
+		std::set<std::string> found_tags;
+		for (auto& tags : path_tags) {
+			found_tags.insert(std::make_move_iterator(tags.begin()), std::make_move_iterator(tags.end()));
+		}
+		return found_tags;
+	});
+}
+
+void file_browser::retag_selection(const tag_operation& operation) {
+	if (on_retag_requested) {
+		on_retag_requested(operation, selected_paths());
+	}
+}
+
 void file_browser::update_entry_context_menu() {
-	if (!context_entry) {
+	if (context_index == -1) {
 		return;
 	}
-	auto selection = selected_entries();
-	const auto path = context_entry->path;
+	if (pending_context_tags.valid() && no::is_future_ready(pending_context_tags)) {
+		context_tags = pending_context_tags.get();
+	}
+	const auto selection_count = selected_indices().size();
+	const auto path = entry_paths[context_index];
 	std::vector<no::ui::popup_item> items;
-	if (selection.size() == 1) {
-		if (std::filesystem::is_directory(path)) {
+	if (selection_count == 1) {
+		if (context_is_directory) {
 			items.emplace_back("Open directory", "", false, true, [&] {
 				load_directory(path);
 			});
@@ -329,41 +585,38 @@ void file_browser::update_entry_context_menu() {
 		});
 		items.emplace_back("Rename", "", false, false);
 	}
-	std::vector<no::ui::popup_item> tag_group_items;
-	for (const auto& group : tags::get_all_groups()) {
-		std::vector<no::ui::popup_item> tag_items;
-		for (const auto& tag : tags::get_all_tags_in_group(group)) {
-			auto tag_data = tags::find_tag(tag);
-			const auto tag_name = config.show_pretty_name ? tag_data->pretty_name : tag_data->name;
-			tag_items.emplace_back(tag_name, "", false, true, [this, tag] {
-				for (auto selected_entry : selected_entries()) {
-					selected_entry->add_tag(tag);
-				}
-			});
-		}
-		tag_group_items.emplace_back(group, "", false, true, [] {}, tag_items);
-	}
-	items.emplace_back("Add tags", "", false, true, [] {}, tag_group_items);
-	std::set<std::string> unique_tags;
-	for (auto selected_entry : selected_entries()) {
-		for (const auto& tag : selected_entry->get_tags()) {
-			unique_tags.insert(tag);
-		}
-	}
+	items.emplace_back("Add tags...", "", false, true, [this] {
+		must_open_tag_picker = true;
+	});
 	std::vector<no::ui::popup_item> tags_to_remove;
-	for (const auto& tag : unique_tags) {
+	for (const auto& tag : context_tags) {
 		auto tag_data = tags::find_tag(tag);
-		const auto tag_name = config.show_pretty_name ? tag_data->pretty_name : tag_data->name;
+		const auto tag_name = tag_data && config.show_pretty_name ? tag_data->pretty_name : tag;
 		tags_to_remove.emplace_back(tag_name, "", false, true, [this, tag] {
-			for (auto selected_entry : selected_entries()) {
-				selected_entry->remove_tag(tag);
-			}
+			retag_selection({ tag_operation_kind::remove, tag });
 		});
 	}
-	items.emplace_back("Remove tags", "", false, true, [] {}, tags_to_remove);
+	// the tags are still being read if there are no sort keys.
+	items.emplace_back("Remove tags", "", false, !pending_context_tags.valid(), [] {}, tags_to_remove);
 	
 	no::ui::popup("##entry-context", items);
 	if (!ImGui::IsPopupOpen("##entry-context")) {
-		context_entry = nullptr;
+		context_index = -1;
+	}
+}
+
+void file_browser::update_add_tag_popup() {
+	if (must_open_tag_picker) {
+		must_open_tag_picker = false;
+		add_tag_picker.reset();
+		ImGui::OpenPopup("##entry-add-tag");
+	}
+	if (!ImGui::BeginPopup("##entry-add-tag")) {
+		return;
+	}
+	if (const auto tag = add_tag_picker.update()) {
+		retag_selection({ tag_operation_kind::add, tag.value() });
+		ImGui::CloseCurrentPopup();
 	}
+	ImGui::EndPopup();
 }
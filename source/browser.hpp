@@ -1,9 +1,15 @@
 #pragma once
 
 #include "entry.hpp"
+#include "tags_ui.hpp"
+#include "sort.hpp"
 #include "draw.hpp"
 #include "input.hpp"
 
+#include <unordered_map>
+#include <set>
+#include <functional>
+
 class file_browser {
 public:
 
@@ -14,6 +20,14 @@ public:
 	no::vector2f entry_margin{ 12.0f, 12.0f };
 	no::vector2f entry_full_size{ entry_size + entry_margin };
 
+	// Called when the tags of an entry are written, so other views of the file system can be kept up to date.
+	// The paths are the same if the tags are stored in an attribute.
+	std::function<void(const std::filesystem::path& from, const std::filesystem::path& to)> on_entry_renamed;
+
+	// Called to add or remove a tag in the selected files. The files are written in the background, so the entries are
+	// updated when the renames are passed to rename_paths().
+	std::function<void(const tag_operation& operation, std::vector<std::filesystem::path> paths)> on_retag_requested;
+
 	struct {
 		std::string default_open_path;
 		bool double_click_opens_directories{ true };
@@ -22,7 +36,7 @@ public:
 		no::vector4f entry_hover_color{ 1.0f, 1.0f, 1.0f, 0.19f };
 	} config;
 
-	file_browser(no::window& window, no::mouse& mouse, no::keyboard& keyboard);
+	file_browser(no::window& window, no::mouse& mouse, no::keyboard& keyboard, frame_scheduler& scheduler);
 	file_browser(const file_browser&) = delete;
 	file_browser(file_browser&&) = delete;
 
@@ -33,35 +47,89 @@ public:
 	bool is_active() const;
 	void clear_entries();
 	void load_directory(const std::filesystem::path& path);
-	void load_paths(const std::vector<std::filesystem::path>& paths);
+	void load_paths(std::vector<std::filesystem::path> paths);
+
+	// Updates the entries after files were renamed somewhere else. Many entries are updated over a few frames.
+	void rename_paths(const std::vector<std::pair<std::filesystem::path, std::filesystem::path>>& renames);
+
 	void pop_history();
 	void clear_selection();
 	void select_all();
 
 	std::filesystem::path active_directory() const {
-		return directory_history.empty() ? config.default_open_path : directory_history.back();
+		return directory_history.empty() ? std::filesystem::u8path(config.default_open_path) : directory_history.back();
 	}
 
-	std::vector<directory_entry*> selected_entries();
-	std::vector<directory_entry*> entries_between(directory_entry* from, directory_entry* to);
+	// The selected indices are cached until the selection changes.
+	const std::vector<int>& selected_indices();
+	std::vector<std::filesystem::path> selected_paths();
+	void select_range(int from, int to);
+
+	void sort_entries(const sort_options& options);
+	const sort_options& sorting() const;
+	bool is_sorting() const;
 
 private:
 
 	void update_start();
 	void update_entries();
 
-	void directory_entry_control(directory_entry& entry);
+	void select(int index, bool selected);
+	directory_entry& entry_at(int index);
+	void release_entry(directory_entry& entry);
+
+	void start_sort();
+	void run_sort(std::vector<std::filesystem::path> paths);
+	void update_sort();
+	void apply_order(std::vector<uint32_t> positions, std::vector<uint32_t> key_order);
+
+	void directory_entry_control(int index, directory_entry& entry);
+	void find_context_tags();
+	void retag_selection(const tag_operation& operation);
 	void update_entry_context_menu();
+	void update_add_tag_popup();
 
 	no::transform2 transform;
-	std::vector<directory_entry> entries;
 	no::rectangle rectangle;
 	no::window& window;
 	no::mouse& mouse;
 	no::keyboard& keyboard;
-
-	directory_entry* context_entry{ nullptr };
-	directory_entry* single_selected_entry{ nullptr };
+	frame_scheduler& scheduler;
+
+	// Only the paths are kept for every entry. The full entry is created when it becomes visible, and released when it's hidden.
+	std::vector<std::filesystem::path> entry_paths;
+	std::vector<bool> selection;
+	std::vector<int> selected_index_cache;
+	bool is_selection_changed{ true };
+	std::unordered_map<int, directory_entry*> materialized_entries;
+	directory_entry_pool entry_pool;
+	uint64_t entry_order_version{ 0 }; // changed when the entries are loaded or sorted, so the indices are different.
+
+	int context_index{ -1 };
+	bool context_is_directory{ false }; // checked when the context menu is opened.
+	std::set<std::string> context_tags; // the tags of the selected entries when the context menu is opened.
+	std::future<std::set<std::string>> pending_context_tags; // read in the background if there are no sort keys.
+	int anchor_index{ -1 };
+
+	tag_picker add_tag_picker;
+	bool must_open_tag_picker{ false };
+
+	struct sort_result {
+		sort_key_list keys;
+		std::vector<uint32_t> key_order; // the key of every entry in the new order.
+		std::vector<uint32_t> positions; // the current position of every entry in the new order.
+	};
+
+	// The keys are created by the first sort after the paths are loaded, and reused until new paths are loaded.
+	// They stay in the order they were created in, so sorting again doesn't copy them.
+	sort_options sort_settings;
+	sort_key_list sort_keys;
+	std::vector<uint32_t> sort_key_indices; // the key of every entry.
+	std::shared_ptr<std::vector<std::filesystem::path>> pending_sort_paths; // copied over a few frames before the sort starts.
+	std::future<sort_result> pending_sort;
+	uint64_t pending_sort_order_version{ 0 }; // the sort is discarded if the entries were changed after it started.
+	std::shared_ptr<std::atomic<bool>> pending_sort_cancelled;
+	std::vector<std::future<sort_result>> cancelled_sorts;
 
 	no::platform::system_cursor old_cursor{ no::platform::system_cursor::arrow };
 	no::platform::system_cursor new_cursor{ no::platform::system_cursor::arrow };
@@ -70,4 +138,8 @@ private:
 
 	std::vector<std::filesystem::path> root_directories;
 
+	// the default path is only checked when it's changed.
+	std::string checked_default_path;
+	bool default_path_is_directory{ false };
+
 };
@@ -0,0 +1,435 @@
+#include "tags.hpp"
+#include "search.hpp"
+#include "duplicates.hpp"
+#include "shared_index.hpp"
+#include "retag.hpp"
+#include "parallel.hpp"
+#include "io.hpp"
+#include "assets.hpp"
+#include "timer.hpp"
+
+#include <iostream>
+
+namespace {
+
+constexpr size_t paths_per_batch{ 4096 };
+
+struct cli_options {
+	std::filesystem::path registry_path; // the registry of the program if empty.
+	char delimiter{ '\n' };
+	std::string command;
+	std::vector<std::string> arguments;
+};
+
+struct rename_job {
+	std::filesystem::path path;
+	std::filesystem::path new_path;
+	std::error_code error;
+};
+
+void print_usage() {
+	std::cerr << "usage: milky-tags-cli [--registry <file>] [-0] <command> [arguments]\n"
+		"\n"
+		"commands:\n"
+		"  query [-i <tag>]... [-x <tag>]... [-n <text>] <root>...  print the files below the roots that match\n"
+		"  tag <tag>[,<tag>...] [<path>...]                         add tags to the files\n"
+		"  untag <tag>[,<tag>...] [<path>...]                       remove tags from the files\n"
+		"  retag <old tag> <new tag> <root>...                      replace a tag in all files below the roots\n"
+		"  stats <root>...                                          count files and tags below the roots\n"
+		"  import <group> <root>...                                 add the unknown tags found below the roots to the group\n"
+		"  duplicates [--merge] <root>...                           print the copies of the same file below the roots\n"
+		"  storage [file-name|attribute|hybrid]                     print or change where tags are stored\n"
+		"  mirror <root>...                                         rename the files below the roots so their names have the tags from their attributes\n"
+		"\n"
+		"  -i, -x       include or exclude files with the tag\n"
+		"  -n           only include files where the name contains the text\n"
+		"  -0           paths are separated by NUL instead of newline, for both input and output\n"
+		"  --registry   the tag registry to use. default is the registry of milky-tags. --tags is the same\n"
+		"\n"
+		"tag and untag read the paths from standard input if none are given.\n"
+		"duplicates prints every group of copies followed by an empty line. --merge gives the copies the tags of all of them.\n"
+		"the hashes are cached in milky.hashes next to the tag registry.\n"
+		"the attribute modes keep tags in the user.milky.tags extended attribute, so tagging doesn't rename files.\n";
+}
+
+std::optional<cli_options> parse_options(int argc, char** argv) {
+	cli_options options;
+	int i{ 1 };
+	for (; i < argc && argv[i][0] == '-'; i++) {
+		const std::string_view option{ argv[i] };
+		if (option == "-0") {
+			options.delimiter = '\0';
+		} else if ((option == "--registry" || option == "--tags") && i + 1 < argc) {
+			options.registry_path = std::filesystem::u8path(argv[++i]);
+		} else {
+			return std::nullopt;
+		}
+	}
+	if (i == argc) {
+		return std::nullopt;
+	}
+	if (options.registry_path.empty()) {
+		// the same registry as the program, so the command line doesn't create one in every working directory.
+		options.registry_path = no::asset_path("milky.tags");
+	}
+	options.command = argv[i++];
+	for (; i < argc; i++) {
+		options.arguments.emplace_back(argv[i]);
+	}
+	return options;
+}
+
+void write_path(const std::filesystem::path& path, char delimiter) {
+	std::cout << path.u8string() << delimiter;
+}
+
+bool tags_are_known(const std::vector<std::string>& tag_names) {
+	bool all_known{ true };
+	for (const auto& tag : tag_names) {
+		if (!tags::find_tag(tag)) {
+			std::cerr << "unknown tag: " << tag << "\n";
+			all_known = false;
+		}
+	}
+	return all_known;
+}
+
+// Nested roots are scanned once, and the roots on the same disk are scanned in parallel only if it's not rotational.
+void scan_roots(search_path_cache_list& caches, const std::vector<std::string>& roots) {
+	for (const auto& root : roots) {
+		caches.add_search_directory(std::filesystem::u8path(root));
+	}
+	caches.wait();
+}
+
+// Writes the tags in parallel, and writes the new paths in the original order. Returns the number of failures.
+int run_renames(std::vector<rename_job>& jobs, const std::function<std::vector<std::string>(std::vector<std::string>)>& change_tags, char delimiter) {
+	parallel_for(jobs.size(), [&](size_t index) {
+		auto& job = jobs[index];
+		const auto tags = change_tags(tags::read_tags(job.path));
+		job.new_path = tags::write_tags(job.path, tags, job.error);
+	});
+	int failures{ 0 };
+	for (const auto& job : jobs) {
+		if (job.error) {
+			std::cerr << "failed to write tags of " << job.path.u8string() << ": " << job.error.message() << "\n";
+			failures++;
+		} else {
+			write_path(job.new_path, delimiter);
+		}
+	}
+	std::cout.flush();
+	return failures;
+}
+
+// Paths are read in batches, so renaming can start before all input has been read.
+int rename_paths(const std::vector<std::string>& path_arguments, const std::function<std::vector<std::string>(std::vector<std::string>)>& change_tags, char delimiter) {
+	int failures{ 0 };
+	std::vector<rename_job> jobs;
+	auto flush_jobs = [&] {
+		failures += run_renames(jobs, change_tags, delimiter);
+		jobs.clear();
+	};
+	if (!path_arguments.empty()) {
+		for (const auto& path : path_arguments) {
+			jobs.push_back({ std::filesystem::u8path(path) });
+		}
+		flush_jobs();
+		return failures;
+	}
+	std::string line;
+	while (std::getline(std::cin, line, delimiter)) {
+		if (line.empty()) {
+			continue;
+		}
+		jobs.push_back({ std::filesystem::u8path(line) });
+		if (jobs.size() == paths_per_batch) {
+			flush_jobs();
+		}
+	}
+	flush_jobs();
+	return failures;
+}
+
+int run_query(const cli_options& options) {
+	search_query query;
+	std::vector<std::string> roots;
+	for (size_t i{ 0 }; i < options.arguments.size(); i++) {
+		const auto& argument = options.arguments[i];
+		const bool has_value{ i + 1 < options.arguments.size() };
+		if (argument == "-i" && has_value) {
+			query.include_tags.push_back(options.arguments[++i]);
+		} else if (argument == "-x" && has_value) {
+			query.exclude_tags.push_back(options.arguments[++i]);
+		} else if (argument == "-n" && has_value) {
+			query.name_contains = options.arguments[++i];
+		} else {
+			roots.push_back(argument);
+		}
+	}
+	if (roots.empty()) {
+		print_usage();
+		return 2;
+	}
+	query.expand_implications();
+	// the paths are written as soon as each part is searched, so only the counts are kept for the summary.
+	search_result summary;
+	size_t found_count{ 0 };
+	const auto write_result = [&](const search_result& result) {
+		for (const auto& path : result.paths) {
+			write_path(path, options.delimiter);
+		}
+		found_count += result.paths.size();
+		summary.paths_searched += result.paths_searched;
+		summary.milliseconds += result.milliseconds;
+		summary.thread_count = std::max(summary.thread_count, result.thread_count);
+	};
+	// the roots that a running program publishes are searched in its index, and only the rest are scanned.
+	std::vector<std::string> unpublished_roots;
+	for (const auto& root : roots) {
+		const auto index_reader = shared_index::reader::open(std::filesystem::u8path(root));
+		const auto published = index_reader ? index_reader->search(query) : std::nullopt;
+		if (published) {
+			write_result(published.value());
+		} else {
+			unpublished_roots.push_back(root);
+		}
+	}
+	search_path_cache_list caches;
+	scan_roots(caches, unpublished_roots);
+	for (const auto& cache : caches.caches) {
+		query.caches = { cache.get() };
+		if (const auto scanned = run_search(query)) {
+			write_result(scanned.value());
+		}
+	}
+	std::cerr << found_count << " of " << summary.paths_searched << " paths in " << summary.milliseconds << " ms ("
+		<< static_cast<long long>(summary.paths_per_second()) << " paths/s, " << summary.thread_count << " threads)\n";
+	return 0;
+}
+
+int run_tag(const cli_options& options, bool add) {
+	if (options.arguments.empty()) {
+		print_usage();
+		return 2;
+	}
+	const auto tags_to_change = no::split_string(options.arguments[0], ',');
+	if (add && !tags_are_known(tags_to_change)) {
+		return 2;
+	}
+	const std::vector<std::string> paths{ options.arguments.begin() + 1, options.arguments.end() };
+	const int failures{ rename_paths(paths, [&](std::vector<std::string> tags) {
+		for (const auto& tag : tags_to_change) {
+			const auto found = std::find(tags.begin(), tags.end(), tag);
+			if (add && found == tags.end()) {
+				tags.push_back(tag);
+			} else if (!add && found != tags.end()) {
+				tags.erase(found);
+			}
+		}
+		return tags;
+	}, options.delimiter) };
+	return failures > 0 ? 1 : 0;
+}
+
+int run_retag(const cli_options& options) {
+	if (options.arguments.size() < 3) {
+		print_usage();
+		return 2;
+	}
+	const auto& old_tag = options.arguments[0];
+	const auto& new_tag = options.arguments[1];
+	search_path_cache_list caches;
+	scan_roots(caches, { options.arguments.begin() + 2, options.arguments.end() });
+	// the registry is only changed if every file was renamed.
+	bulk_retag retag{ { tag_operation_kind::rename, old_tag, new_tag }, caches };
+	retag.wait();
+	const auto result = retag.finish();
+	for (const auto& [from, to] : result->renamed_paths) {
+		write_path(to, options.delimiter);
+	}
+	std::cout.flush();
+	for (const auto& failure : result->failures) {
+		std::cerr << "failed to retag " << failure.path.u8string() << ": " << failure.message << "\n";
+	}
+	std::cerr << "retagged " << result->renamed_paths.size() << " of " << retag.file_count() << " files\n";
+	return result->failures.empty() ? 0 : 1;
+}
+
+int run_stats(const cli_options& options) {
+	if (options.arguments.empty()) {
+		print_usage();
+		return 2;
+	}
+	no::timer scan_timer;
+	scan_timer.start();
+	search_path_cache_list caches;
+	scan_roots(caches, options.arguments);
+	const auto scan_milliseconds = scan_timer.milliseconds();
+	size_t path_count{ 0 };
+	size_t tagged_count{ 0 };
+	std::vector<const search_path_cache*> searched_caches;
+	for (const auto& cache : caches.caches) {
+		const auto lock = cache->lock();
+		for (const auto& path : cache->paths()) {
+			path_count++;
+			tagged_count += path.empty() || tags::read_tags(path).empty() ? 0 : 1;
+		}
+		searched_caches.push_back(cache.get());
+	}
+	std::cout << "paths: " << path_count << "\n";
+	std::cout << "tagged: " << tagged_count << "\n";
+	std::cout << "scan: " << scan_milliseconds << " ms\n";
+	std::cout << "groups: " << tags::get_all_groups().size() << "\n";
+	std::cout << "registered tags: " << tags::get_all_tags().size() << "\n";
+	std::cout << "tags:\n";
+	auto discovered = discover_tags(searched_caches);
+	mark_registered_tags(discovered);
+	for (const auto& tag : discovered) {
+		std::cout << "  " << tag.name << " " << tag.file_count << (tag.is_registered ? "" : " (unknown)") << "\n";
+	}
+	return 0;
+}
+
+int run_import(const cli_options& options) {
+	if (options.arguments.size() < 2) {
+		print_usage();
+		return 2;
+	}
+	const auto& group = options.arguments[0];
+	search_path_cache_list caches;
+	scan_roots(caches, { options.arguments.begin() + 1, options.arguments.end() });
+	std::vector<const search_path_cache*> searched_caches;
+	for (const auto& cache : caches.caches) {
+		searched_caches.push_back(cache.get());
+	}
+	std::vector<std::string> unknown_tags;
+	auto discovered = discover_tags(searched_caches);
+	mark_registered_tags(discovered);
+	for (const auto& tag : discovered) {
+		if (!tag.is_registered) {
+			std::cout << tag.name << " " << tag.file_count << "\n";
+			unknown_tags.push_back(tag.name);
+		}
+	}
+	if (!unknown_tags.empty()) {
+		if (!tags::group_exists(group)) {
+			tags::create_group(group);
+		}
+		tags::create_tags(group, unknown_tags);
+	}
+	std::cerr << "imported " << unknown_tags.size() << " tags into " << group << "\n";
+	return 0;
+}
+
+int run_duplicates(const cli_options& options) {
+	const bool merge{ !options.arguments.empty() && options.arguments[0] == "--merge" };
+	const std::vector<std::string> roots{ options.arguments.begin() + (merge ? 1 : 0), options.arguments.end() };
+	if (roots.empty()) {
+		print_usage();
+		return 2;
+	}
+	search_path_cache_list caches;
+	scan_roots(caches, roots);
+	file_hash_cache hashes;
+	hashes.load(options.registry_path.parent_path() / "milky.hashes");
+	duplicate_finder finder{ caches, hashes };
+	finder.wait();
+	auto result = finder.finish();
+	int failures{ 0 };
+	for (auto& group : result->groups) {
+		if (merge && !group.has_same_tags) {
+			const auto merged = merge_duplicate_tags(group, caches, hashes);
+			for (const auto& [from, to] : merged.renamed_paths) {
+				std::replace(group.paths.begin(), group.paths.end(), from, to);
+			}
+			for (const auto& failure : merged.failures) {
+				std::cerr << "failed to rename " << failure.path.u8string() << ": " << failure.message << "\n";
+				failures++;
+			}
+		}
+		for (const auto& path : group.paths) {
+			write_path(path, options.delimiter);
+		}
+		std::cout << options.delimiter;
+	}
+	std::cout.flush();
+	hashes.save();
+	std::cerr << result->groups.size() << " groups of copies. hashed " << result->files_hashed << " files, "
+		<< result->cached_hashes << " hashes were cached, " << result->failures << " files could not be read\n";
+	return failures > 0 ? 1 : 0;
+}
+
+int run_storage(const cli_options& options) {
+	const std::vector<std::string> names{ "file-name", "attribute", "hybrid" };
+	if (options.arguments.empty()) {
+		std::cout << names[static_cast<size_t>(tags::get_storage_mode())] << "\n";
+		return 0;
+	}
+	const auto name = std::find(names.begin(), names.end(), options.arguments[0]);
+	if (name == names.end()) {
+		print_usage();
+		return 2;
+	}
+	const auto mode = static_cast<tags::storage_mode>(name - names.begin());
+	if (mode != tags::storage_mode::file_name && !tags::is_attribute_storage_supported()) {
+		std::cerr << "extended attributes are not supported on this platform\n";
+		return 1;
+	}
+	tags::set_storage_mode(mode);
+	return 0;
+}
+
+int run_mirror(const cli_options& options) {
+	if (options.arguments.empty()) {
+		print_usage();
+		return 2;
+	}
+	search_path_cache_list caches;
+	scan_roots(caches, options.arguments);
+	bulk_retag mirror{ { tag_operation_kind::mirror }, caches };
+	mirror.wait();
+	const auto result = mirror.finish();
+	for (const auto& [from, to] : result->renamed_paths) {
+		write_path(to, options.delimiter);
+	}
+	std::cout.flush();
+	for (const auto& failure : result->failures) {
+		std::cerr << "failed to rename " << failure.path.u8string() << ": " << failure.message << "\n";
+	}
+	std::cerr << "renamed " << result->renamed_paths.size() << " of " << mirror.file_count() << " files\n";
+	return result->failures.empty() ? 0 : 1;
+}
+
+}
+
+int main(int argc, char** argv) {
+	std::ios::sync_with_stdio(false);
+	const auto options = parse_options(argc, argv);
+	if (!options) {
+		print_usage();
+		return 2;
+	}
+	tags::load(options->registry_path);
+	if (options->command == "query") {
+		return run_query(options.value());
+	} else if (options->command == "tag") {
+		return run_tag(options.value(), true);
+	} else if (options->command == "untag") {
+		return run_tag(options.value(), false);
+	} else if (options->command == "retag") {
+		return run_retag(options.value());
+	} else if (options->command == "stats") {
+		return run_stats(options.value());
+	} else if (options->command == "import") {
+		return run_import(options.value());
+	} else if (options->command == "duplicates") {
+		return run_duplicates(options.value());
+	} else if (options->command == "storage") {
+		return run_storage(options.value());
+	} else if (options->command == "mirror") {
+		return run_mirror(options.value());
+	}
+	print_usage();
+	return 2;
+}
@@ -0,0 +1,333 @@
+#include "duplicates.hpp"
+#include "tags.hpp"
+#include "parallel.hpp"
+#include "profiler.hpp"
+#include "io.hpp"
+#include "assets.hpp"
+#include "timer.hpp"
+#include "debug.hpp"
+
+void file_hash_cache::load() {
+	load(no::asset_path("milky.hashes"));
+}
+
+void file_hash_cache::load(const std::filesystem::path& path) {
+	PROFILE_ZONE("load_hashes");
+	std::lock_guard lock{ mutex };
+	file_path = path;
+	hashes.clear();
+	no::io_stream stream;
+	no::file::read(file_path, stream);
+	if (stream.empty()) {
+		return;
+	}
+	const auto count = stream.read<int32_t>();
+	hashes.reserve(static_cast<size_t>(count));
+	for (int32_t i{ 0 }; i < count; i++) {
+		auto path_string = stream.read<std::string>();
+		cached_hash hash;
+		hash.size = stream.read<uint64_t>();
+		hash.modified_time = stream.read<int64_t>();
+		hash.hash = stream.read<uint64_t>();
+		hashes.emplace(std::move(path_string), hash);
+	}
+}
+
+void file_hash_cache::save() const {
+	PROFILE_ZONE("save_hashes");
+	std::lock_guard lock{ mutex };
+	if (file_path.empty()) {
+		return; // never loaded, so the file would be overwritten with only the new hashes.
+	}
+	no::io_stream stream;
+	stream.write(static_cast<int32_t>(hashes.size()));
+	for (const auto& [path_string, hash] : hashes) {
+		stream.write(path_string);
+		stream.write(hash.size);
+		stream.write(hash.modified_time);
+		stream.write(hash.hash);
+	}
+	no::file::write(file_path, stream);
+}
+
+std::optional<uint64_t> file_hash_cache::find(const std::filesystem::path& path, const fs::file_status& status) const {
+	std::lock_guard lock{ mutex };
+	const auto hash = hashes.find(path.u8string());
+	if (hash == hashes.end() || hash->second.size != status.size || hash->second.modified_time != status.modified_time) {
+		return std::nullopt;
+	}
+	return hash->second.hash;
+}
+
+void file_hash_cache::store(const std::filesystem::path& path, const fs::file_status& status, uint64_t hash) {
+	std::lock_guard lock{ mutex };
+	hashes[path.u8string()] = { status.size, status.modified_time, hash };
+}
+
+void file_hash_cache::rename_paths(const std::vector<std::pair<std::filesystem::path, std::filesystem::path>>& renames) {
+	std::lock_guard lock{ mutex };
+	for (const auto& [from, to] : renames) {
+		if (auto hash = hashes.extract(from.u8string())) {
+			hash.key() = to.u8string();
+			hashes.insert(std::move(hash));
+		}
+	}
+}
+
+size_t file_hash_cache::size() const {
+	std::lock_guard lock{ mutex };
+	return hashes.size();
+}
+
+std::vector<std::string> duplicate_group::merged_tags() const {
+	std::vector<std::string> tags;
+	for (const auto& path : paths) {
+		for (auto& tag : tags::read_tags(path)) {
+			if (std::find(tags.begin(), tags.end(), tag) == tags.end()) {
+				tags.push_back(std::move(tag));
+			}
+		}
+	}
+	return tags;
+}
+
+duplicate_finder::duplicate_finder(const search_path_cache_list& caches, file_hash_cache& hashes)
+	: hashes{ hashes }, max_reads{ std::min(caches.max_reads(), worker_thread_count()) } {
+	// only the paths are copied here, so the caches can be changed while the files are hashed.
+	for (const auto& cache : caches.caches) {
+		auto lock = cache->lock();
+		for (const auto& path : cache->paths()) {
+			if (!path.empty()) {
+				candidates.push_back(path);
+			}
+		}
+	}
+	future_result = std::async(std::launch::async, &duplicate_finder::find_duplicates, this);
+}
+
+uint64_t duplicate_finder::bytes_to_hash() const {
+	return total_bytes;
+}
+
+uint64_t duplicate_finder::bytes_hashed() const {
+	return done_bytes;
+}
+
+bool duplicate_finder::is_done() const {
+	return future_result.valid() && no::is_future_ready(future_result);
+}
+
+void duplicate_finder::wait() const {
+	if (future_result.valid()) {
+		future_result.wait();
+	}
+}
+
+std::optional<duplicate_finder::result> duplicate_finder::finish() {
+	if (!is_done()) {
+		return std::nullopt;
+	}
+	auto finished = future_result.get();
+	INFO("Found " << finished.groups.size() << " groups of duplicates in " << finished.milliseconds << " ms. Hashed "
+		<< finished.files_hashed << " files, and " << finished.cached_hashes << " hashes were cached.");
+	return finished;
+}
+
+// Keeps only the files with the same size as another file, sorted by size.
+static void keep_same_sizes(std::vector<std::filesystem::path>& paths, std::vector<fs::file_status>& statuses) {
+	std::vector<size_t> order(paths.size());
+	for (size_t i{ 0 }; i < order.size(); i++) {
+		order[i] = i;
+	}
+	parallel_sort(order, [&statuses](size_t a, size_t b) {
+		return statuses[a].size < statuses[b].size;
+	});
+	std::vector<std::filesystem::path> kept_paths;
+	std::vector<fs::file_status> kept_statuses;
+	for (size_t first{ 0 }; first < order.size();) {
+		const auto size = statuses[order[first]].size;
+		size_t last{ first + 1 };
+		while (last < order.size() && statuses[order[last]].size == size) {
+			last++;
+		}
+		if (last - first > 1) {
+			for (size_t i{ first }; i < last; i++) {
+				kept_paths.push_back(std::move(paths[order[i]]));
+				kept_statuses.push_back(statuses[order[i]]);
+			}
+		}
+		first = last;
+	}
+	paths = std::move(kept_paths);
+	statuses = std::move(kept_statuses);
+}
+
+duplicate_finder::result duplicate_finder::find_duplicates() {
+	PROFILE_ZONE("find_duplicates");
+	no::timer timer;
+	timer.start();
+	result finished;
+
+	// nested search directories have some of the same files.
+	std::sort(candidates.begin(), candidates.end());
+	candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+	// the scan doesn't stat the files, so the sizes are current when the hashes are checked against them.
+	const auto candidate_statuses = fs::stat_many(candidates, static_cast<size_t>(max_reads));
+	std::vector<std::filesystem::path> paths;
+	std::vector<fs::file_status> statuses;
+	for (size_t i{ 0 }; i < candidates.size(); i++) {
+		if (candidate_statuses[i].type == fs::file_type::file && candidate_statuses[i].size > 0) {
+			paths.push_back(std::move(candidates[i]));
+			statuses.push_back(candidate_statuses[i]);
+		}
+	}
+	candidates.clear();
+	keep_same_sizes(paths, statuses);
+
+	uint64_t total{ 0 };
+	for (const auto& status : statuses) {
+		total += status.size;
+	}
+	total_bytes = total;
+
+	std::vector<std::optional<uint64_t>> file_hashes(paths.size());
+	std::atomic<size_t> hashed_count{ 0 };
+	std::atomic<size_t> cached_count{ 0 };
+	parallel_for(paths.size(), max_reads, [&](size_t index) {
+		if (auto hash = hashes.find(paths[index], statuses[index])) {
+			file_hashes[index] = hash;
+			cached_count++;
+		} else {
+			std::error_code error;
+			const auto new_hash = fs::hash(paths[index], error);
+			if (!error) {
+				file_hashes[index] = new_hash;
+				hashes.store(paths[index], statuses[index], new_hash);
+				hashed_count++;
+			}
+		}
+		done_bytes += statuses[index].size;
+	});
+	finished.files_hashed = hashed_count;
+	finished.cached_hashes = cached_count;
+
+	std::vector<size_t> order;
+	for (size_t i{ 0 }; i < paths.size(); i++) {
+		if (file_hashes[i]) {
+			order.push_back(i);
+		} else {
+			finished.failures++;
+		}
+	}
+	std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+		return statuses[a].size < statuses[b].size || (statuses[a].size == statuses[b].size && file_hashes[a].value() < file_hashes[b].value());
+	});
+	for (size_t first{ 0 }; first < order.size();) {
+		size_t last{ first + 1 };
+		while (last < order.size() && statuses[order[last]].size == statuses[order[first]].size && file_hashes[order[last]] == file_hashes[order[first]]) {
+			last++;
+		}
+		if (last - first > 1) {
+			auto& group = finished.groups.emplace_back();
+			group.size = statuses[order[first]].size;
+			group.hash = file_hashes[order[first]].value();
+			for (size_t i{ first }; i < last; i++) {
+				group.paths.push_back(std::move(paths[order[i]]));
+			}
+			std::sort(group.paths.begin(), group.paths.end());
+		}
+		first = last;
+	}
+	std::sort(finished.groups.begin(), finished.groups.end(), [](const auto& a, const auto& b) {
+		return a.wasted_bytes() > b.wasted_bytes();
+	});
+	// the tags may be in attributes, so they are read here instead of every time the group is shown.
+	parallel_for(finished.groups.size(), max_reads, [&](size_t index) {
+		auto& group = finished.groups[index];
+		const auto tags = group.merged_tags();
+		group.has_same_tags = std::all_of(group.paths.begin(), group.paths.end(), [&tags](const auto& path) {
+			return tags::read_tags(path).size() == tags.size();
+		});
+	});
+	finished.milliseconds = timer.milliseconds();
+	return finished;
+}
+
+bulk_retag::result write_merged_tags(const duplicate_group& group) {
+	PROFILE_ZONE("write_merged_tags");
+	bulk_retag::result merged;
+	duplicate_group same_group;
+	for (const auto& path : group.paths) {
+		std::error_code error;
+		if (same_group.paths.empty() || fs::same_contents(same_group.paths.front(), path, error)) {
+			same_group.paths.push_back(path);
+		} else {
+			merged.failures.push_back({ path, error ? error.message() : "Not the same as " + same_group.paths.front().u8string() });
+		}
+	}
+	const auto tags = same_group.merged_tags();
+	for (const auto& path : same_group.paths) {
+		if (tags::read_tags(path).size() == tags.size()) {
+			continue;
+		}
+		std::error_code error;
+		const auto new_path = tags::write_tags(path, tags, error);
+		if (error) {
+			merged.failures.push_back({ path, error.message() });
+		} else {
+			merged.renamed_paths.emplace_back(path, new_path);
+		}
+	}
+	return merged;
+}
+
+bulk_retag::result merge_duplicate_tags(const duplicate_group& group, search_path_cache_list& caches, file_hash_cache& hashes) {
+	auto merged = write_merged_tags(group);
+	caches.rename_paths(merged.renamed_paths);
+	hashes.rename_paths(merged.renamed_paths);
+	return merged;
+}
+
+duplicate_merge::duplicate_merge(std::vector<duplicate_group> groups, search_path_cache_list& caches, file_hash_cache& hashes)
+	: groups{ std::move(groups) }, caches{ caches }, hashes{ hashes }, max_reads{ std::min(caches.max_reads(), worker_thread_count()) } {
+	future_result = std::async(std::launch::async, &duplicate_merge::merge_groups, this);
+}
+
+size_t duplicate_merge::groups_done() const {
+	return done;
+}
+
+size_t duplicate_merge::group_count() const {
+	return groups.size();
+}
+
+bool duplicate_merge::is_done() const {
+	return future_result.valid() && no::is_future_ready(future_result);
+}
+
+std::optional<bulk_retag::result> duplicate_merge::finish() {
+	if (!is_done()) {
+		return std::nullopt;
+	}
+	auto finished = future_result.get();
+	caches.rename_paths(finished.renamed_paths);
+	hashes.rename_paths(finished.renamed_paths);
+	INFO("Merged the tags of " << groups.size() << " groups of copies. Wrote " << finished.renamed_paths.size() << " files, and " << finished.failures.size() << " failed.");
+	return finished;
+}
+
+bulk_retag::result duplicate_merge::merge_groups() {
+	PROFILE_ZONE("merge_groups");
+	std::vector<bulk_retag::result> group_results(groups.size());
+	parallel_for(groups.size(), max_reads, [&](size_t index) {
+		group_results[index] = write_merged_tags(groups[index]);
+		done++;
+	});
+	bulk_retag::result merged;
+	for (auto& group_result : group_results) {
+		std::move(group_result.renamed_paths.begin(), group_result.renamed_paths.end(), std::back_inserter(merged.renamed_paths));
+		std::move(group_result.failures.begin(), group_result.failures.end(), std::back_inserter(merged.failures));
+	}
+	return merged;
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "search.hpp"
+#include "retag.hpp"
+
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <unordered_map>
+#include <mutex>
+#include <future>
+#include <atomic>
+#include <optional>
+
+// Remembers the hash of every file that has been hashed, so files that haven't changed are never read again.
+// A hash is only used if the file has the same size and modified time as when it was hashed.
+class file_hash_cache {
+public:
+
+	void load();
+	void load(const std::filesystem::path& path);
+	void save() const;
+
+	// The hashes are found and stored from all cores at once.
+	std::optional<uint64_t> find(const std::filesystem::path& path, const fs::file_status& status) const;
+	void store(const std::filesystem::path& path, const fs::file_status& status, uint64_t hash);
+
+	// Renaming a file doesn't change the contents or the modified time, so the hash is kept.
+	void rename_paths(const std::vector<std::pair<std::filesystem::path, std::filesystem::path>>& renames);
+
+	size_t size() const;
+
+private:
+
+	struct cached_hash {
+		uint64_t size{ 0 };
+		int64_t modified_time{ 0 };
+		uint64_t hash{ 0 };
+	};
+
+	std::filesystem::path file_path;
+	std::unordered_map<std::string, cached_hash> hashes;
+	mutable std::mutex mutex;
+
+};
+
+struct duplicate_group {
+	uint64_t size{ 0 };
+	uint64_t hash{ 0 };
+	std::vector<std::filesystem::path> paths;
+
+	// True if every copy had the tags of all the copies when the group was found.
+	bool has_same_tags{ false };
+
+	// The tags of all the copies, in the order they are first found.
+	std::vector<std::string> merged_tags() const;
+
+	uint64_t wasted_bytes() const {
+		return size * (paths.size() - 1);
+	}
+};
+
+// Finds the files in the caches with the same contents on a background thread. The files are grouped by size first,
+// and only the files with the same size as another file are hashed, on as many cores as the devices allow reads at once.
+class duplicate_finder {
+public:
+
+	struct result {
+		std::vector<duplicate_group> groups; // the most wasted space first.
+		size_t files_hashed{ 0 };
+		size_t cached_hashes{ 0 };
+		size_t failures{ 0 };
+		long long milliseconds{ 0 };
+	};
+
+	duplicate_finder(const search_path_cache_list& caches, file_hash_cache& hashes);
+	duplicate_finder(const duplicate_finder&) = delete;
+	duplicate_finder(duplicate_finder&&) = delete;
+
+	duplicate_finder& operator=(const duplicate_finder&) = delete;
+	duplicate_finder& operator=(duplicate_finder&&) = delete;
+
+	// Zero until the files with the same size have been found.
+	uint64_t bytes_to_hash() const;
+	uint64_t bytes_hashed() const;
+
+	bool is_done() const;
+	void wait() const;
+
+	// Returns the result the first time it's called after the search is done.
+	std::optional<result> finish();
+
+private:
+
+	result find_duplicates();
+
+	std::vector<std::filesystem::path> candidates;
+	file_hash_cache& hashes;
+	const int max_reads;
+	std::atomic<uint64_t> total_bytes{ 0 };
+	std::atomic<uint64_t> done_bytes{ 0 };
+	std::future<result> future_result; // last, so the search is done before the rest is destroyed.
+
+};
+
+// Gives every copy the tags of all the copies. Copies that already have all the tags are not changed.
+// The groups are found by hash, so a copy is only changed if it's the same as the first byte for byte.
+bulk_retag::result write_merged_tags(const duplicate_group& group);
+
+// Same as write_merged_tags, but the caches and the hashes are updated with the new paths.
+bulk_retag::result merge_duplicate_tags(const duplicate_group& group, search_path_cache_list& caches, file_hash_cache& hashes);
+
+// Merges the tags of the copies in the groups on a background thread, spread over the cores like the hashing. Like bulk_retag,
+// the caches and the hashes are updated with the new paths by finish().
+class duplicate_merge {
+public:
+
+	duplicate_merge(std::vector<duplicate_group> groups, search_path_cache_list& caches, file_hash_cache& hashes);
+	duplicate_merge(const duplicate_merge&) = delete;
+	duplicate_merge(duplicate_merge&&) = delete;
+
+	duplicate_merge& operator=(const duplicate_merge&) = delete;
+	duplicate_merge& operator=(duplicate_merge&&) = delete;
+
+	size_t groups_done() const;
+	size_t group_count() const;
+	bool is_done() const;
+
+	// Returns the result the first time it's called after the tags are written.
+	std::optional<bulk_retag::result> finish();
+
+private:
+
+	bulk_retag::result merge_groups();
+
+	std::vector<duplicate_group> groups;
+	search_path_cache_list& caches;
+	file_hash_cache& hashes;
+	const int max_reads;
+	std::atomic<size_t> done{ 0 };
+	std::future<bulk_retag::result> future_result; // last, so the tags are written before the rest is destroyed.
+
+};
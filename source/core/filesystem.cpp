@@ -0,0 +1,598 @@
+#include "filesystem.hpp"
+#include "uring.hpp"
+#include "hash.hpp"
+#include "io.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <thread>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <cstdio>
+#endif
+
+namespace fs {
+
+// counted per thread, so the calls made by the frame aren't mixed up with the scans and loaders in the background.
+static thread_local uint64_t calls{ 0 };
+
+static std::shared_ptr<backend>& backend_slot() {
+	static std::shared_ptr<backend> active_backend{ [] () -> std::shared_ptr<backend> {
+#if MILKY_IO_URING
+		if (uring_backend::is_supported()) {
+			return std::make_shared<uring_backend>();
+		}
+#endif
+		return std::make_shared<native_backend>();
+	}() };
+	return active_backend;
+}
+
+std::vector<file_status> backend::stat_many(const std::vector<std::filesystem::path>& paths) {
+	std::vector<file_status> statuses;
+	statuses.reserve(paths.size());
+	for (const auto& path : paths) {
+		std::error_code error;
+		statuses.push_back(stat(path, error));
+	}
+	return statuses;
+}
+
+std::vector<std::optional<std::string>> backend::read_many(const std::vector<std::filesystem::path>& paths, size_t max_bytes) {
+	std::vector<std::optional<std::string>> files;
+	files.reserve(paths.size());
+	for (const auto& path : paths) {
+		std::error_code error;
+		auto data = read(path, max_bytes, error);
+		files.push_back(error ? std::nullopt : std::make_optional(std::move(data)));
+	}
+	return files;
+}
+
+std::vector<std::filesystem::path> native_backend::enumerate(const std::filesystem::path& directory, bool recursive, std::error_code& error) {
+	if (!std::filesystem::is_directory(directory, error)) {
+		if (!error) {
+			error = std::make_error_code(std::errc::not_a_directory);
+		}
+		return {};
+	}
+	return no::entries_in_directory(directory, no::entry_inclusion::everything, recursive);
+}
+
+file_status native_backend::stat(const std::filesystem::path& path, std::error_code& error) {
+	file_status result;
+#if defined(__linux__)
+	struct statx status {};
+	if (statx(AT_FDCWD, path.c_str(), AT_STATX_DONT_SYNC, STATX_TYPE | STATX_MTIME | STATX_SIZE, &status) != 0) {
+		error = std::error_code{ errno, std::generic_category() };
+		return result;
+	}
+	return from_statx(status);
+#else
+	// on Windows, the directory entry is filled by a single query, and the getters below use that.
+	const std::filesystem::directory_entry entry{ path, error };
+	if (error) {
+		return result;
+	}
+	if (entry.is_directory(error)) {
+		result.type = file_type::directory;
+	} else if (entry.is_regular_file(error)) {
+		result.type = file_type::file;
+		result.size = entry.file_size(error);
+	} else {
+		result.type = entry.exists(error) ? file_type::other : file_type::none;
+	}
+	result.modified_time = static_cast<int64_t>(entry.last_write_time(error).time_since_epoch().count());
+	return result;
+#endif
+}
+
+#if defined(__linux__)
+file_status from_statx(const struct statx& status) {
+	file_status result;
+	if (S_ISDIR(status.stx_mode)) {
+		result.type = file_type::directory;
+	} else if (S_ISREG(status.stx_mode)) {
+		result.type = file_type::file;
+		result.size = status.stx_size;
+	} else {
+		result.type = file_type::other;
+	}
+	result.modified_time = static_cast<int64_t>(status.stx_mtime.tv_sec) * 1000000000 + status.stx_mtime.tv_nsec;
+	return result;
+}
+#endif
+
+bool native_backend::equivalent(const std::filesystem::path& a, const std::filesystem::path& b, std::error_code& error) {
+	return std::filesystem::equivalent(a, b, error);
+}
+
+void native_backend::rename(const std::filesystem::path& from, const std::filesystem::path& to, std::error_code& error) {
+#if defined(__linux__)
+	if (renameat2(AT_FDCWD, from.c_str(), AT_FDCWD, to.c_str(), RENAME_NOREPLACE) == 0) {
+		return;
+	}
+	if (errno != EINVAL && errno != ENOSYS) {
+		error = std::error_code{ errno, std::generic_category() };
+		return;
+	}
+	// the filesystem can't rename without replacing, but a link fails if the new path exists.
+	if (link(from.c_str(), to.c_str()) == 0) {
+		if (unlink(from.c_str()) != 0) {
+			error = std::error_code{ errno, std::generic_category() };
+			unlink(to.c_str());
+		}
+		return;
+	}
+	if (errno == EEXIST) {
+		error = std::make_error_code(std::errc::file_exists);
+		return;
+	}
+#endif
+	// nothing better is available here, so a file created between the check and the rename is still replaced.
+	if (std::filesystem::exists(std::filesystem::symlink_status(to, error))) {
+		error = std::make_error_code(std::errc::file_exists);
+		return;
+	}
+	error = {}; // the path not existing is reported as an error too.
+	std::filesystem::rename(from, to, error);
+}
+
+device_info native_backend::device(const std::filesystem::path& path, std::error_code& error) {
+	device_info result;
+#if defined(__linux__)
+	struct statx status {};
+	if (statx(AT_FDCWD, path.c_str(), AT_STATX_DONT_SYNC, STATX_TYPE, &status) != 0) {
+		error = std::error_code{ errno, std::generic_category() };
+		return result;
+	}
+	result.id = (static_cast<uint64_t>(status.stx_dev_major) << 32) | status.stx_dev_minor;
+	// a partition doesn't have its own queue, so the disk it's on is checked instead.
+	const auto block_device = "/sys/dev/block/" + std::to_string(status.stx_dev_major) + ":" + std::to_string(status.stx_dev_minor);
+	for (const auto* queue : { "/queue/rotational", "/../queue/rotational" }) {
+		if (std::ifstream file{ block_device + queue }) {
+			int rotational{ 0 };
+			file >> rotational;
+			result.is_rotational = rotational == 1;
+			break;
+		}
+	}
+	return result;
+#else
+	// the drive letter or network share. whether it's rotational isn't known without opening the volume.
+	const auto root_name = std::filesystem::absolute(path, error).root_name().u8string();
+	result.id = hash_bytes(root_name.data(), root_name.size());
+	return result;
+#endif
+}
+
+std::string native_backend::read(const std::filesystem::path& path, size_t max_bytes, std::error_code& error) {
+	std::ifstream file{ path, std::ios::binary };
+	if (!file) {
+		error = std::make_error_code(std::errc::no_such_file_or_directory);
+		return {};
+	}
+	file.seekg(0, std::ios::end);
+	const auto size = static_cast<std::streamoff>(file.tellg());
+	file.seekg(0, std::ios::beg);
+	if (size < 0) {
+		error = std::make_error_code(std::errc::io_error);
+		return {};
+	}
+	std::string data(static_cast<size_t>(std::min<uint64_t>(static_cast<uint64_t>(size), max_bytes)), '\0');
+	file.read(data.data(), static_cast<std::streamsize>(data.size()));
+	if (file.bad()) {
+		error = std::make_error_code(std::errc::io_error); // f.ex when reading a directory.
+		return {};
+	}
+	data.resize(static_cast<size_t>(file.gcount()));
+	return data;
+}
+
+// The blocks are the same size on every platform, since they are hashed one at a time.
+static constexpr size_t hash_block_size{ 1024 * 1024 };
+
+#if defined(__linux__)
+// Fills the block unless the end of the file is reached, since a read can be short before the end.
+static size_t read_block(int file, char* block, off_t offset, std::error_code& error) {
+	size_t length{ 0 };
+	while (length < hash_block_size) {
+		const auto count = pread(file, block + length, hash_block_size - length, offset + static_cast<off_t>(length));
+		if (count < 0 && errno == EINTR) {
+			continue;
+		}
+		if (count < 0) {
+			error = std::error_code{ errno, std::generic_category() };
+			return 0;
+		}
+		if (count == 0) {
+			break;
+		}
+		length += static_cast<size_t>(count);
+	}
+	return length;
+}
+
+// Read into buffers instead of mapped, since a mapped file that is truncated meanwhile raises SIGBUS.
+static int open_for_blocks(const std::filesystem::path& path, off_t& size, std::error_code& error) {
+	const int file{ open(path.c_str(), O_RDONLY | O_CLOEXEC) };
+	if (file < 0) {
+		error = std::error_code{ errno, std::generic_category() };
+		return -1;
+	}
+	struct stat status {};
+	if (fstat(file, &status) != 0 || !S_ISREG(status.st_mode)) {
+		error = std::make_error_code(std::errc::io_error);
+		close(file);
+		return -1;
+	}
+	posix_fadvise(file, 0, 0, POSIX_FADV_SEQUENTIAL);
+	size = status.st_size;
+	return file;
+}
+#endif
+
+uint64_t native_backend::hash(const std::filesystem::path& path, std::error_code& error) {
+	uint64_t hash{ 0 };
+#if defined(__linux__)
+	off_t size{ 0 };
+	const int file{ open_for_blocks(path, size, error) };
+	if (file < 0) {
+		return 0;
+	}
+	thread_local std::vector<char> block(hash_block_size);
+	off_t offset{ 0 };
+	for (bool is_first_block{ true }; ; is_first_block = false) {
+		const size_t length{ read_block(file, block.data(), offset, error) };
+		if (error) {
+			close(file);
+			return 0;
+		}
+		if (length > 0 || is_first_block) {
+			hash = hash_bytes(block.data(), length, hash);
+		}
+		offset += static_cast<off_t>(length);
+		if (length < hash_block_size) {
+			break;
+		}
+	}
+	close(file);
+	if (offset != size) {
+		error = std::make_error_code(std::errc::io_error); // changed while it was read.
+		return 0;
+	}
+	return hash;
+#else
+	std::ifstream file{ path, std::ios::binary };
+	if (!file) {
+		error = std::make_error_code(std::errc::no_such_file_or_directory);
+		return 0;
+	}
+	// the blocks must be the same as on Linux, so an empty last block is only hashed if the file is empty.
+	std::string block(hash_block_size, '\0');
+	for (bool is_first_block{ true }; file; is_first_block = false) {
+		file.read(block.data(), static_cast<std::streamsize>(block.size()));
+		if (file.bad()) {
+			error = std::make_error_code(std::errc::io_error);
+			return 0;
+		}
+		const auto length = static_cast<size_t>(file.gcount());
+		if (length > 0 || is_first_block) {
+			hash = hash_bytes(block.data(), length, hash);
+		}
+	}
+	return hash;
+#endif
+}
+
+bool native_backend::same_contents(const std::filesystem::path& a, const std::filesystem::path& b, std::error_code& error) {
+#if defined(__linux__)
+	off_t a_size{ 0 };
+	off_t b_size{ 0 };
+	const int a_file{ open_for_blocks(a, a_size, error) };
+	if (a_file < 0) {
+		return false;
+	}
+	const int b_file{ open_for_blocks(b, b_size, error) };
+	if (b_file < 0) {
+		close(a_file);
+		return false;
+	}
+	thread_local std::vector<char> a_block(hash_block_size);
+	thread_local std::vector<char> b_block(hash_block_size);
+	bool is_same{ a_size == b_size };
+	for (off_t offset{ 0 }; is_same; ) {
+		const size_t a_length{ read_block(a_file, a_block.data(), offset, error) };
+		const size_t b_length{ error ? 0 : read_block(b_file, b_block.data(), offset, error) };
+		if (error) {
+			is_same = false;
+			break;
+		}
+		is_same = a_length == b_length && std::equal(a_block.begin(), a_block.begin() + a_length, b_block.begin());
+		offset += static_cast<off_t>(a_length);
+		if (a_length < hash_block_size) {
+			break;
+		}
+	}
+	close(a_file);
+	close(b_file);
+	return is_same;
+#else
+	std::ifstream a_file{ a, std::ios::binary };
+	std::ifstream b_file{ b, std::ios::binary };
+	if (!a_file || !b_file) {
+		error = std::make_error_code(std::errc::no_such_file_or_directory);
+		return false;
+	}
+	std::string a_block(hash_block_size, '\0');
+	std::string b_block(hash_block_size, '\0');
+	while (a_file && b_file) {
+		a_file.read(a_block.data(), static_cast<std::streamsize>(a_block.size()));
+		b_file.read(b_block.data(), static_cast<std::streamsize>(b_block.size()));
+		if (a_file.bad() || b_file.bad()) {
+			error = std::make_error_code(std::errc::io_error);
+			return false;
+		}
+		if (a_file.gcount() != b_file.gcount() || a_block.compare(0, static_cast<size_t>(a_file.gcount()), b_block, 0, static_cast<size_t>(b_file.gcount())) != 0) {
+			return false;
+		}
+	}
+	return !a_file == !b_file;
+#endif
+}
+
+std::optional<std::string> native_backend::read_attribute(const std::filesystem::path& path, const std::string& name, std::error_code& error) {
+#if defined(__linux__)
+	// most attributes are short, so the size is only asked for if the first try doesn't fit.
+	std::string value(256, '\0');
+	while (true) {
+		const auto size = getxattr(path.c_str(), name.c_str(), value.data(), value.size());
+		if (size >= 0) {
+			value.resize(static_cast<size_t>(size));
+			return value;
+		}
+		if (errno == ENODATA) {
+			return std::nullopt;
+		}
+		if (errno != ERANGE) {
+			error = std::error_code{ errno, std::generic_category() };
+			return std::nullopt;
+		}
+		const auto needed_size = getxattr(path.c_str(), name.c_str(), nullptr, 0);
+		if (needed_size < 0) {
+			error = std::error_code{ errno, std::generic_category() };
+			return std::nullopt;
+		}
+		value.resize(static_cast<size_t>(needed_size) + 1); // in case it grew in between.
+	}
+#else
+	error = std::make_error_code(std::errc::operation_not_supported);
+	return std::nullopt;
+#endif
+}
+
+void native_backend::write_attribute(const std::filesystem::path& path, const std::string& name, const std::string& value, std::error_code& error) {
+#if defined(__linux__)
+	if (setxattr(path.c_str(), name.c_str(), value.data(), value.size(), 0) != 0) {
+		error = std::error_code{ errno, std::generic_category() };
+	}
+#else
+	error = std::make_error_code(std::errc::operation_not_supported);
+#endif
+}
+
+void native_backend::remove_attribute(const std::filesystem::path& path, const std::string& name, std::error_code& error) {
+#if defined(__linux__)
+	if (removexattr(path.c_str(), name.c_str()) != 0 && errno != ENODATA) {
+		error = std::error_code{ errno, std::generic_category() };
+	}
+#else
+	error = std::make_error_code(std::errc::operation_not_supported);
+#endif
+}
+
+simulated_backend::simulated_backend(std::shared_ptr<backend> target, const simulated_options& options)
+	: target{ std::move(target) }, options{ options }, random{ options.seed } {}
+
+bool simulated_backend::simulate(const simulated_operation& operation, std::error_code& error) {
+	if (operation.latency_microseconds > 0) {
+		std::this_thread::sleep_for(std::chrono::microseconds{ operation.latency_microseconds });
+	}
+	if (operation.failure_rate <= 0.0) {
+		return false;
+	}
+	std::lock_guard lock{ random_mutex };
+	if (std::uniform_real_distribution<double>{ 0.0, 1.0 }(random) < operation.failure_rate) {
+		error = std::make_error_code(std::errc::io_error);
+		return true;
+	}
+	return false;
+}
+
+std::vector<std::filesystem::path> simulated_backend::enumerate(const std::filesystem::path& directory, bool recursive, std::error_code& error) {
+	if (simulate(options.enumerate, error)) {
+		return {};
+	}
+	auto paths = target->enumerate(directory, recursive, error);
+	if (options.enumerate_per_entry.latency_microseconds > 0) {
+		std::this_thread::sleep_for(std::chrono::microseconds{ options.enumerate_per_entry.latency_microseconds } * paths.size());
+	}
+	return paths;
+}
+
+file_status simulated_backend::stat(const std::filesystem::path& path, std::error_code& error) {
+	if (simulate(options.stat, error)) {
+		return {};
+	}
+	return target->stat(path, error);
+}
+
+bool simulated_backend::equivalent(const std::filesystem::path& a, const std::filesystem::path& b, std::error_code& error) {
+	// equivalent stats both paths.
+	if (simulate(options.stat, error) || simulate(options.stat, error)) {
+		return false;
+	}
+	return target->equivalent(a, b, error);
+}
+
+void simulated_backend::rename(const std::filesystem::path& from, const std::filesystem::path& to, std::error_code& error) {
+	if (!simulate(options.rename, error)) {
+		target->rename(from, to, error);
+	}
+}
+
+device_info simulated_backend::device(const std::filesystem::path& path, std::error_code& error) {
+	if (simulate(options.stat, error)) {
+		return {};
+	}
+	return target->device(path, error);
+}
+
+std::string simulated_backend::read(const std::filesystem::path& path, size_t max_bytes, std::error_code& error) {
+	if (simulate(options.read, error)) {
+		return {};
+	}
+	return target->read(path, max_bytes, error);
+}
+
+uint64_t simulated_backend::hash(const std::filesystem::path& path, std::error_code& error) {
+	if (simulate(options.hash, error)) {
+		return 0;
+	}
+	return target->hash(path, error);
+}
+
+bool simulated_backend::same_contents(const std::filesystem::path& a, const std::filesystem::path& b, std::error_code& error) {
+	// both files are read.
+	if (simulate(options.read, error) || simulate(options.read, error)) {
+		return false;
+	}
+	return target->same_contents(a, b, error);
+}
+
+std::optional<std::string> simulated_backend::read_attribute(const std::filesystem::path& path, const std::string& name, std::error_code& error) {
+	if (simulate(options.attribute, error)) {
+		return std::nullopt;
+	}
+	return target->read_attribute(path, name, error);
+}
+
+void simulated_backend::write_attribute(const std::filesystem::path& path, const std::string& name, const std::string& value, std::error_code& error) {
+	if (!simulate(options.attribute, error)) {
+		target->write_attribute(path, name, value, error);
+	}
+}
+
+void simulated_backend::remove_attribute(const std::filesystem::path& path, const std::string& name, std::error_code& error) {
+	if (!simulate(options.attribute, error)) {
+		target->remove_attribute(path, name, error);
+	}
+}
+
+void set_backend(std::shared_ptr<backend> new_backend) {
+	std::atomic_store(&backend_slot(), std::move(new_backend));
+}
+
+std::shared_ptr<backend> current_backend() {
+	return std::atomic_load(&backend_slot());
+}
+
+std::vector<std::filesystem::path> enumerate(const std::filesystem::path& directory, bool recursive) {
+	calls++;
+	std::error_code error;
+	return current_backend()->enumerate(directory, recursive, error);
+}
+
+file_status stat(const std::filesystem::path& path) {
+	calls++;
+	std::error_code error;
+	return current_backend()->stat(path, error);
+}
+
+bool is_directory(const std::filesystem::path& path) {
+	return stat(path).type == file_type::directory;
+}
+
+bool equivalent(const std::filesystem::path& a, const std::filesystem::path& b) {
+	calls++;
+	std::error_code error;
+	return current_backend()->equivalent(a, b, error);
+}
+
+void rename(const std::filesystem::path& from, const std::filesystem::path& to, std::error_code& error) {
+	calls++;
+	current_backend()->rename(from, to, error);
+}
+
+device_info device(const std::filesystem::path& path) {
+	calls++;
+	std::error_code error;
+	return current_backend()->device(path, error);
+}
+
+std::string read(const std::filesystem::path& path, size_t max_bytes, std::error_code& error) {
+	calls++;
+	return current_backend()->read(path, max_bytes, error);
+}
+
+uint64_t hash(const std::filesystem::path& path, std::error_code& error) {
+	calls++;
+	return current_backend()->hash(path, error);
+}
+
+bool same_contents(const std::filesystem::path& a, const std::filesystem::path& b, std::error_code& error) {
+	calls++;
+	return current_backend()->same_contents(a, b, error);
+}
+
+std::optional<std::string> read_attribute(const std::filesystem::path& path, const std::string& name, std::error_code& error) {
+	calls++;
+	return current_backend()->read_attribute(path, name, error);
+}
+
+void write_attribute(const std::filesystem::path& path, const std::string& name, const std::string& value, std::error_code& error) {
+	calls++;
+	current_backend()->write_attribute(path, name, value, error);
+}
+
+void remove_attribute(const std::filesystem::path& path, const std::string& name, std::error_code& error) {
+	calls++;
+	current_backend()->remove_attribute(path, name, error);
+}
+
+std::vector<file_status> stat_many(const std::vector<std::filesystem::path>& paths) {
+	calls += paths.size();
+	return current_backend()->stat_many(paths);
+}
+
+std::vector<file_status> stat_many(const std::vector<std::filesystem::path>& paths, size_t max_in_flight) {
+	const size_t batch_size{ std::max<size_t>(max_in_flight, 1) };
+	if (paths.size() <= batch_size) {
+		return stat_many(paths);
+	}
+	std::vector<file_status> statuses;
+	statuses.reserve(paths.size());
+	for (size_t begin{ 0 }; begin < paths.size(); begin += batch_size) {
+		const size_t end{ std::min(begin + batch_size, paths.size()) };
+		const auto batch = stat_many({ paths.begin() + begin, paths.begin() + end });
+		statuses.insert(statuses.end(), batch.begin(), batch.end());
+	}
+	return statuses;
+}
+
+std::vector<std::optional<std::string>> read_many(const std::vector<std::filesystem::path>& paths, size_t max_bytes) {
+	calls += paths.size();
+	return current_backend()->read_many(paths, max_bytes);
+}
+
+uint64_t call_count() {
+	return calls;
+}
+
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <filesystem>
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <optional>
+#include <cstdint>
+
+// All filesystem access by the browser, the search cache and the thumbnail loader goes through the
+// current backend, so slow or unreliable storage can be simulated. The free functions are counted for each
+// thread, so the debug overlay can show how many calls the main thread made during a frame.
+namespace fs {
+
+enum class file_type { none, file, directory, other };
+
+struct file_status {
+	file_type type{ file_type::none };
+	uint64_t size{ 0 };
+	int64_t modified_time{ 0 }; // only comparable with other times from the same backend.
+};
+
+struct device_info {
+	uint64_t id{ 0 };
+	bool is_rotational{ false }; // a spinning disk, which is slow to read from many places at once.
+};
+
+class backend {
+public:
+
+	virtual ~backend() = default;
+
+	virtual std::vector<std::filesystem::path> enumerate(const std::filesystem::path& directory, bool recursive, std::error_code& error) = 0;
+	virtual file_status stat(const std::filesystem::path& path, std::error_code& error) = 0;
+	virtual bool equivalent(const std::filesystem::path& a, const std::filesystem::path& b, std::error_code& error) = 0;
+	// Fails with file_exists instead of replacing a file that is already at the new path.
+	virtual void rename(const std::filesystem::path& from, const std::filesystem::path& to, std::error_code& error) = 0;
+
+	// The device the path is stored on. If the kind of device is unknown, it's not rotational.
+	virtual device_info device(const std::filesystem::path& path, std::error_code& error) = 0;
+
+	// Reads at most max_bytes from the start of the file.
+	virtual std::string read(const std::filesystem::path& path, size_t max_bytes, std::error_code& error) = 0;
+
+	// Hashes the whole file with hash_bytes, one block at a time. The result doesn't depend on the backend.
+	virtual uint64_t hash(const std::filesystem::path& path, std::error_code& error) = 0;
+	// Compares the files one block at a time, since a hash can be the same for different contents.
+	virtual bool same_contents(const std::filesystem::path& a, const std::filesystem::path& b, std::error_code& error) = 0;
+
+	// Extended attributes. Nullopt if the file doesn't have the attribute. Fails if the platform or filesystem doesn't support them.
+	virtual std::optional<std::string> read_attribute(const std::filesystem::path& path, const std::string& name, std::error_code& error) = 0;
+	virtual void write_attribute(const std::filesystem::path& path, const std::string& name, const std::string& value, std::error_code& error) = 0;
+	// Removing an attribute the file doesn't have is not an error.
+	virtual void remove_attribute(const std::filesystem::path& path, const std::string& name, std::error_code& error) = 0;
+
+	// Batched versions, which backends can override to have many operations in flight at once.
+	// A failed stat has the type none, and a failed read is nullopt.
+	virtual std::vector<file_status> stat_many(const std::vector<std::filesystem::path>& paths);
+	virtual std::vector<std::optional<std::string>> read_many(const std::vector<std::filesystem::path>& paths, size_t max_bytes);
+
+};
+
+class native_backend : public backend {
+public:
+
+	std::vector<std::filesystem::path> enumerate(const std::filesystem::path& directory, bool recursive, std::error_code& error) override;
+	file_status stat(const std::filesystem::path& path, std::error_code& error) override;
+	bool equivalent(const std::filesystem::path& a, const std::filesystem::path& b, std::error_code& error) override;
+	void rename(const std::filesystem::path& from, const std::filesystem::path& to, std::error_code& error) override;
+	device_info device(const std::filesystem::path& path, std::error_code& error) override;
+	std::string read(const std::filesystem::path& path, size_t max_bytes, std::error_code& error) override;
+	uint64_t hash(const std::filesystem::path& path, std::error_code& error) override;
+	bool same_contents(const std::filesystem::path& a, const std::filesystem::path& b, std::error_code& error) override;
+	std::optional<std::string> read_attribute(const std::filesystem::path& path, const std::string& name, std::error_code& error) override;
+	void write_attribute(const std::filesystem::path& path, const std::string& name, const std::string& value, std::error_code& error) override;
+	void remove_attribute(const std::filesystem::path& path, const std::string& name, std::error_code& error) override;
+
+};
+
+struct simulated_operation {
+	int latency_microseconds{ 0 };
+	double failure_rate{ 0.0 }; // 0 to 1.
+};
+
+struct simulated_options {
+	simulated_operation enumerate;
+	simulated_operation enumerate_per_entry; // added once for every path found, no failures.
+	simulated_operation stat;
+	simulated_operation rename;
+	simulated_operation read;
+	simulated_operation hash;
+	simulated_operation attribute;
+	uint32_t seed{ 1234 };
+};
+
+// Passes every operation on to another backend after a delay, and fails some of them on purpose.
+class simulated_backend : public backend {
+public:
+
+	simulated_backend(std::shared_ptr<backend> target, const simulated_options& options);
+
+	std::vector<std::filesystem::path> enumerate(const std::filesystem::path& directory, bool recursive, std::error_code& error) override;
+	file_status stat(const std::filesystem::path& path, std::error_code& error) override;
+	bool equivalent(const std::filesystem::path& a, const std::filesystem::path& b, std::error_code& error) override;
+	void rename(const std::filesystem::path& from, const std::filesystem::path& to, std::error_code& error) override;
+	device_info device(const std::filesystem::path& path, std::error_code& error) override;
+	std::string read(const std::filesystem::path& path, size_t max_bytes, std::error_code& error) override;
+	uint64_t hash(const std::filesystem::path& path, std::error_code& error) override;
+	bool same_contents(const std::filesystem::path& a, const std::filesystem::path& b, std::error_code& error) override;
+	std::optional<std::string> read_attribute(const std::filesystem::path& path, const std::string& name, std::error_code& error) override;
+	void write_attribute(const std::filesystem::path& path, const std::string& name, const std::string& value, std::error_code& error) override;
+	void remove_attribute(const std::filesystem::path& path, const std::string& name, std::error_code& error) override;
+
+private:
+
+	// Waits for the latency, and returns true if the operation should fail.
+	bool simulate(const simulated_operation& operation, std::error_code& error);
+
+	std::shared_ptr<backend> target;
+	simulated_options options;
+	std::mutex random_mutex;
+	std::mt19937 random;
+
+};
+
+// The native backend is used until another is set.
+void set_backend(std::shared_ptr<backend> new_backend);
+std::shared_ptr<backend> current_backend();
+
+std::vector<std::filesystem::path> enumerate(const std::filesystem::path& directory, bool recursive);
+file_status stat(const std::filesystem::path& path);
+bool is_directory(const std::filesystem::path& path);
+bool equivalent(const std::filesystem::path& a, const std::filesystem::path& b);
+void rename(const std::filesystem::path& from, const std::filesystem::path& to, std::error_code& error);
+device_info device(const std::filesystem::path& path);
+std::string read(const std::filesystem::path& path, size_t max_bytes, std::error_code& error);
+uint64_t hash(const std::filesystem::path& path, std::error_code& error);
+bool same_contents(const std::filesystem::path& a, const std::filesystem::path& b, std::error_code& error);
+std::optional<std::string> read_attribute(const std::filesystem::path& path, const std::string& name, std::error_code& error);
+void write_attribute(const std::filesystem::path& path, const std::string& name, const std::string& value, std::error_code& error);
+void remove_attribute(const std::filesystem::path& path, const std::string& name, std::error_code& error);
+std::vector<file_status> stat_many(const std::vector<std::filesystem::path>& paths);
+// At most max_in_flight stats are given to the backend at once, so a batch doesn't flood a slow device.
+std::vector<file_status> stat_many(const std::vector<std::filesystem::path>& paths, size_t max_in_flight);
+std::vector<std::optional<std::string>> read_many(const std::vector<std::filesystem::path>& paths, size_t max_bytes);
+
+// The calls made by the calling thread.
+uint64_t call_count();
+
+}
@@ -0,0 +1,101 @@
+#include "frame_scheduler.hpp"
+#include "profiler.hpp"
+
+void frame_scheduler::post(task_priority priority, const char* name, std::function<bool()> step) {
+	std::lock_guard lock{ mutex };
+	queues[static_cast<int>(priority)].push_back({ name, std::move(step) });
+}
+
+void frame_scheduler::run() {
+	PROFILE_ZONE("frame_tasks");
+	const auto start = std::chrono::steady_clock::now();
+	frame_stats stats;
+	bool overran{ false };
+	std::array<bool, priority_count> has_stepped{};
+	while (true) {
+		task next;
+		int priority{ 0 };
+		{
+			std::lock_guard lock{ mutex };
+			priority = next_priority(stats.steps == 0);
+			if (priority == priority_count) {
+				break;
+			}
+			next = std::move(queues[priority].front());
+			queues[priority].pop_front();
+		}
+		bool has_more_steps{ false };
+		{
+			PROFILE_ZONE(next.name);
+			has_more_steps = next.step();
+		}
+		stats.steps++;
+		has_stepped[priority] = true;
+		if (has_more_steps) {
+			// first in its queue, so a task that was started is finished before the next one of the same priority.
+			std::lock_guard lock{ mutex };
+			queues[priority].push_front(std::move(next));
+		}
+		const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+		if (elapsed >= budget) {
+			if (elapsed > budget) {
+				overran = true;
+				if (const auto overrun = (elapsed - budget).count(); overrun > worst_overrun) {
+					worst_overrun = overrun;
+					worst_overrun_name = next.name;
+				}
+			}
+			break;
+		}
+	}
+	stats.microseconds = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+	{
+		std::lock_guard lock{ mutex };
+		for (int priority{ 0 }; priority < priority_count; priority++) {
+			stats.queued_tasks[priority] = queues[priority].size();
+			frames_without_step[priority] = has_stepped[priority] || queues[priority].empty() ? 0 : frames_without_step[priority] + 1;
+		}
+	}
+	overrun_frame_count += overran ? 1 : 0;
+	last_frame_stats = stats;
+}
+
+int frame_scheduler::next_priority(bool is_first_step) const {
+	if (is_first_step) {
+		for (int priority{ 1 }; priority < priority_count; priority++) {
+			if (!queues[priority].empty() && frames_without_step[priority] >= max_frames_without_step) {
+				return priority;
+			}
+		}
+	}
+	int priority{ 0 };
+	while (priority < priority_count && queues[priority].empty()) {
+		priority++;
+	}
+	return priority;
+}
+
+size_t frame_scheduler::queued_tasks() const {
+	std::lock_guard lock{ mutex };
+	size_t count{ 0 };
+	for (const auto& queue : queues) {
+		count += queue.size();
+	}
+	return count;
+}
+
+const frame_scheduler::frame_stats& frame_scheduler::last_frame() const {
+	return last_frame_stats;
+}
+
+uint64_t frame_scheduler::overrun_frames() const {
+	return overrun_frame_count;
+}
+
+long long frame_scheduler::worst_overrun_microseconds() const {
+	return worst_overrun;
+}
+
+const char* frame_scheduler::worst_overrun_task() const {
+	return worst_overrun_name;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <functional>
+#include <deque>
+#include <array>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+
+enum class task_priority { high, normal, low };
+
+// Runs the work that has to be done on the main thread in small steps, the most important first, until the time
+// budget of the frame is used. The rest waits for the next frame, so a large batch of work doesn't stall a frame.
+class frame_scheduler {
+public:
+
+	static constexpr int priority_count{ 3 };
+
+	struct frame_stats {
+		std::array<size_t, priority_count> queued_tasks{}; // by priority, after the frame.
+		size_t steps{ 0 };
+		long long microseconds{ 0 };
+	};
+
+	// A frame is about 16 ms at 60 FPS, and the interface needs most of it.
+	std::chrono::microseconds budget{ 4000 };
+
+	// A queue that got no step for this many frames gets the first step of the next frame, so a steady stream of
+	// high priority tasks can't hold back the others forever.
+	int max_frames_without_step{ 8 };
+
+	frame_scheduler() = default;
+	frame_scheduler(const frame_scheduler&) = delete;
+	frame_scheduler(frame_scheduler&&) = delete;
+
+	frame_scheduler& operator=(const frame_scheduler&) = delete;
+	frame_scheduler& operator=(frame_scheduler&&) = delete;
+
+	// The step is called until it returns false, and should only do as much work as takes a fraction of the budget.
+	// Tasks can be posted from any thread, including from a step. The name must be a string literal.
+	void post(task_priority priority, const char* name, std::function<bool()> step);
+
+	// Runs steps until the budget is used, the most important first. At least one step is run every frame, even if
+	// a step takes longer than the budget.
+	void run();
+
+	size_t queued_tasks() const;
+	const frame_stats& last_frame() const;
+
+	// The frames where the steps took longer than the budget, and the step that went over it the most.
+	uint64_t overrun_frames() const;
+	long long worst_overrun_microseconds() const;
+	const char* worst_overrun_task() const;
+
+private:
+
+	struct task {
+		const char* name{ nullptr };
+		std::function<bool()> step;
+	};
+
+	int next_priority(bool is_first_step) const;
+
+	std::array<std::deque<task>, priority_count> queues;
+	std::array<int, priority_count> frames_without_step{};
+	mutable std::mutex mutex; // only held to change the queues, so a step can post new tasks.
+	frame_stats last_frame_stats;
+	uint64_t overrun_frame_count{ 0 };
+	long long worst_overrun{ 0 };
+	const char* worst_overrun_name{ nullptr };
+
+};
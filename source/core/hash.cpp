@@ -0,0 +1,80 @@
+#include "hash.hpp"
+
+#include <cstring>
+
+static constexpr uint64_t prime_1{ 0x9E3779B185EBCA87ull };
+static constexpr uint64_t prime_2{ 0xC2B2AE3D27D4EB4Full };
+static constexpr uint64_t prime_3{ 0x165667B19E3779F9ull };
+static constexpr uint64_t prime_4{ 0x85EBCA77C2B2AE63ull };
+static constexpr uint64_t prime_5{ 0x27D4EB2F165667C5ull };
+
+static uint64_t rotate_left(uint64_t value, int bits) {
+	return (value << bits) | (value >> (64 - bits));
+}
+
+// the result is the same on every platform, since the hashes are saved. all supported platforms are little endian.
+static uint64_t read_64(const unsigned char* data) {
+	uint64_t value{ 0 };
+	std::memcpy(&value, data, sizeof(value));
+	return value;
+}
+
+static uint32_t read_32(const unsigned char* data) {
+	uint32_t value{ 0 };
+	std::memcpy(&value, data, sizeof(value));
+	return value;
+}
+
+static uint64_t round(uint64_t accumulator, uint64_t input) {
+	accumulator += input * prime_2;
+	accumulator = rotate_left(accumulator, 31);
+	return accumulator * prime_1;
+}
+
+static uint64_t merge_round(uint64_t accumulator, uint64_t value) {
+	accumulator ^= round(0, value);
+	return accumulator * prime_1 + prime_4;
+}
+
+uint64_t hash_bytes(const void* data, size_t size, uint64_t seed) {
+	const auto* bytes = static_cast<const unsigned char*>(data);
+	const auto* end = bytes + size;
+	uint64_t hash{ 0 };
+	if (size >= 32) {
+		// four independent lanes, so the multiplications can run in parallel.
+		uint64_t lanes[4]{ seed + prime_1 + prime_2, seed + prime_2, seed, seed - prime_1 };
+		const auto* last_stripe = end - 32;
+		for (; bytes <= last_stripe; bytes += 32) {
+			lanes[0] = round(lanes[0], read_64(bytes));
+			lanes[1] = round(lanes[1], read_64(bytes + 8));
+			lanes[2] = round(lanes[2], read_64(bytes + 16));
+			lanes[3] = round(lanes[3], read_64(bytes + 24));
+		}
+		hash = rotate_left(lanes[0], 1) + rotate_left(lanes[1], 7) + rotate_left(lanes[2], 12) + rotate_left(lanes[3], 18);
+		for (const auto lane : lanes) {
+			hash = merge_round(hash, lane);
+		}
+	} else {
+		hash = seed + prime_5;
+	}
+	hash += static_cast<uint64_t>(size);
+	for (; bytes + 8 <= end; bytes += 8) {
+		hash ^= round(0, read_64(bytes));
+		hash = rotate_left(hash, 27) * prime_1 + prime_4;
+	}
+	if (bytes + 4 <= end) {
+		hash ^= static_cast<uint64_t>(read_32(bytes)) * prime_1;
+		hash = rotate_left(hash, 23) * prime_2 + prime_3;
+		bytes += 4;
+	}
+	for (; bytes < end; bytes++) {
+		hash ^= static_cast<uint64_t>(*bytes) * prime_5;
+		hash = rotate_left(hash, 11) * prime_1;
+	}
+	hash ^= hash >> 33;
+	hash *= prime_2;
+	hash ^= hash >> 29;
+	hash *= prime_3;
+	hash ^= hash >> 32;
+	return hash;
+}
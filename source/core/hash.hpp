@@ -0,0 +1,8 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// A fast non-cryptographic 64-bit hash (XXH64). Good enough to tell files apart, but not to protect against tampering.
+// Large data can be hashed in blocks by passing the hash of the previous block as the seed of the next.
+uint64_t hash_bytes(const void* data, size_t size, uint64_t seed = 0);
@@ -0,0 +1,371 @@
+#include "image.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <csetjmp>
+#include <cstdio>
+#include <new>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MILKY_SSE2 1
+#endif
+
+#if MILKY_JPEG
+#include <jpeglib.h>
+#endif
+
+#if MILKY_PNG
+#include <png.h>
+#endif
+
+#if MILKY_WEBP
+#include <webp/decode.h>
+#endif
+
+namespace {
+
+// A small file can claim to be a huge image, so the size is checked before the pixels are allocated.
+// This is 128 MB of pixels, and a larger image is left to the platform.
+constexpr uint64_t max_decoded_pixels{ 32 * 1024 * 1024 };
+
+bool is_decodable_size(uint64_t width, uint64_t height) {
+	return width > 0 && height > 0 && width * height <= max_decoded_pixels;
+}
+
+// The largest size with the same aspect ratio that fits in the square.
+void fit_size(int width, int height, int max_size, int& fitted_width, int& fitted_height) {
+	if (width <= max_size && height <= max_size) {
+		fitted_width = width;
+		fitted_height = height;
+		return;
+	}
+	const double scale{ static_cast<double>(max_size) / static_cast<double>(std::max(width, height)) };
+	fitted_width = std::max(1, static_cast<int>(std::lround(width * scale)));
+	fitted_height = std::max(1, static_cast<int>(std::lround(height * scale)));
+}
+
+#if MILKY_JPEG
+
+struct jpeg_error_handler {
+	jpeg_error_mgr manager;
+	std::jmp_buf jump;
+};
+
+// the default handler exits the program, so jump back to the decoder instead.
+void exit_on_jpeg_error(j_common_ptr info) {
+	std::longjmp(reinterpret_cast<jpeg_error_handler*>(info->err)->jump, 1);
+}
+
+void ignore_jpeg_message(j_common_ptr) {}
+
+// Everything that changes after setjmp is owned by the caller, so nothing is left indeterminate by longjmp.
+bool read_jpeg(std::string_view data, int max_size, bool scale_on_decode, decoded_image& image, int& target_width, int& target_height) {
+	jpeg_decompress_struct info{};
+	jpeg_error_handler error{};
+	info.err = jpeg_std_error(&error.manager);
+	error.manager.error_exit = exit_on_jpeg_error;
+	error.manager.output_message = ignore_jpeg_message;
+	if (setjmp(error.jump)) {
+		jpeg_destroy_decompress(&info);
+		return false;
+	}
+	jpeg_create_decompress(&info);
+	jpeg_mem_src(&info, reinterpret_cast<const unsigned char*>(data.data()), static_cast<unsigned long>(data.size()));
+	jpeg_read_header(&info, TRUE);
+	fit_size(static_cast<int>(info.image_width), static_cast<int>(info.image_height), max_size, target_width, target_height);
+	// the largest reduction that still gives at least the target size, so the final downscale keeps the quality.
+	info.scale_num = 1;
+	info.scale_denom = 1;
+	if (scale_on_decode) {
+		for (unsigned int denominator{ 8 }; denominator > 1; denominator /= 2) {
+			const auto scaled_width = static_cast<int>((info.image_width + denominator - 1) / denominator);
+			const auto scaled_height = static_cast<int>((info.image_height + denominator - 1) / denominator);
+			if (scaled_width >= target_width && scaled_height >= target_height) {
+				info.scale_denom = denominator;
+				break;
+			}
+		}
+	}
+#ifdef JCS_EXTENSIONS
+	info.out_color_space = JCS_EXT_RGBA; // only in libjpeg-turbo.
+#else
+	info.out_color_space = JCS_RGB;
+#endif
+	jpeg_calc_output_dimensions(&info);
+	if (!is_decodable_size(info.output_width, info.output_height)) {
+		jpeg_destroy_decompress(&info);
+		return false;
+	}
+	try {
+		image.pixels.resize(static_cast<size_t>(info.output_width) * static_cast<size_t>(info.output_height));
+	} catch (...) {
+		jpeg_destroy_decompress(&info);
+		throw;
+	}
+	jpeg_start_decompress(&info);
+	image.width = static_cast<int>(info.output_width);
+	image.height = static_cast<int>(info.output_height);
+	while (info.output_scanline < info.output_height) {
+		auto pixels = image.pixels.data() + static_cast<size_t>(info.output_scanline) * image.width;
+		auto row = reinterpret_cast<JSAMPROW>(pixels);
+		jpeg_read_scanlines(&info, &row, 1);
+#ifndef JCS_EXTENSIONS
+		// the row is read as RGB into the start of the RGBA row, and spread out from the end so nothing is overwritten.
+		for (int x{ image.width - 1 }; x >= 0; x--) {
+			pixels[x] = static_cast<uint32_t>(row[x * 3]) | static_cast<uint32_t>(row[x * 3 + 1]) << 8 | static_cast<uint32_t>(row[x * 3 + 2]) << 16 | 0xFF000000u;
+		}
+#endif
+	}
+	jpeg_finish_decompress(&info);
+	jpeg_destroy_decompress(&info);
+	return true;
+}
+
+std::optional<decoded_image> decode_jpeg(std::string_view data, int max_size, bool scale_on_decode) {
+	decoded_image image;
+	int target_width{ 0 };
+	int target_height{ 0 };
+	if (!read_jpeg(data, max_size, scale_on_decode, image, target_width, target_height)) {
+		return std::nullopt;
+	}
+	if (image.width != target_width || image.height != target_height) {
+		return downscale(image, target_width, target_height);
+	}
+	return image;
+}
+
+#endif
+
+#if MILKY_PNG
+
+// png can't be decoded at a reduced size, so it's always decoded fully.
+std::optional<decoded_image> decode_png(std::string_view data, int max_size) {
+	png_image png{};
+	png.version = PNG_IMAGE_VERSION;
+	if (!png_image_begin_read_from_memory(&png, data.data(), data.size())) {
+		return std::nullopt;
+	}
+	png.format = PNG_FORMAT_RGBA;
+	if (!is_decodable_size(png.width, png.height)) {
+		png_image_free(&png);
+		return std::nullopt;
+	}
+	decoded_image image;
+	image.width = static_cast<int>(png.width);
+	image.height = static_cast<int>(png.height);
+	try {
+		image.pixels.resize(static_cast<size_t>(image.width) * static_cast<size_t>(image.height));
+	} catch (...) {
+		png_image_free(&png);
+		throw;
+	}
+	if (!png_image_finish_read(&png, nullptr, image.pixels.data(), 0, nullptr)) {
+		png_image_free(&png);
+		return std::nullopt;
+	}
+	int target_width{ 0 };
+	int target_height{ 0 };
+	fit_size(image.width, image.height, max_size, target_width, target_height);
+	if (image.width != target_width || image.height != target_height) {
+		return downscale(image, target_width, target_height);
+	}
+	return image;
+}
+
+#endif
+
+#if MILKY_WEBP
+
+std::optional<decoded_image> decode_webp(std::string_view data, int max_size, bool scale_on_decode) {
+	const auto bytes = reinterpret_cast<const uint8_t*>(data.data());
+	WebPDecoderConfig config;
+	if (!WebPInitDecoderConfig(&config) || WebPGetFeatures(bytes, data.size(), &config.input) != VP8_STATUS_OK) {
+		return std::nullopt;
+	}
+	int target_width{ 0 };
+	int target_height{ 0 };
+	fit_size(config.input.width, config.input.height, max_size, target_width, target_height);
+	const bool is_scaled{ scale_on_decode && is_decodable_size(target_width, target_height) };
+	if (!is_scaled && !is_decodable_size(config.input.width, config.input.height)) {
+		return std::nullopt;
+	}
+	if (is_scaled) {
+		// the decoder scales while decoding, so the result is already the final size.
+		config.options.use_scaling = 1;
+		config.options.scaled_width = target_width;
+		config.options.scaled_height = target_height;
+	}
+	config.output.colorspace = MODE_RGBA;
+	if (WebPDecode(bytes, data.size(), &config) != VP8_STATUS_OK) {
+		WebPFreeDecBuffer(&config.output);
+		return std::nullopt;
+	}
+	decoded_image image;
+	image.width = config.output.width;
+	image.height = config.output.height;
+	image.pixels.resize(static_cast<size_t>(image.width) * static_cast<size_t>(image.height));
+	const auto& rgba = config.output.u.RGBA;
+	for (int y{ 0 }; y < image.height; y++) {
+		std::memcpy(image.pixels.data() + static_cast<size_t>(y) * image.width, rgba.rgba + static_cast<size_t>(y) * rgba.stride, static_cast<size_t>(image.width) * 4);
+	}
+	WebPFreeDecBuffer(&config.output);
+	if (image.width != target_width || image.height != target_height) {
+		return downscale(image, target_width, target_height);
+	}
+	return image;
+}
+
+#endif
+
+// The source pixels that cover a destination pixel, and how much of it each covers.
+struct filter_span {
+	int first{ 0 };
+	std::vector<float> weights;
+};
+
+std::vector<filter_span> make_filter_spans(int source_size, int destination_size) {
+	const double scale{ static_cast<double>(source_size) / static_cast<double>(destination_size) };
+	std::vector<filter_span> spans(destination_size);
+	for (int i{ 0 }; i < destination_size; i++) {
+		const double begin{ i * scale };
+		const double end{ std::min((i + 1) * scale, static_cast<double>(source_size)) };
+		auto& span = spans[i];
+		span.first = static_cast<int>(begin);
+		for (int source{ span.first }; source < end; source++) {
+			const double covered{ std::min<double>(source + 1, end) - std::max<double>(source, begin) };
+			span.weights.push_back(static_cast<float>(covered / scale));
+		}
+	}
+	return spans;
+}
+
+#if MILKY_SSE2
+
+inline __m128 load_pixel(uint32_t pixel) {
+	const __m128i zero{ _mm_setzero_si128() };
+	const __m128i bytes{ _mm_cvtsi32_si128(static_cast<int>(pixel)) };
+	return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(bytes, zero), zero));
+}
+
+inline uint32_t store_pixel(__m128 channels) {
+	const __m128i integers{ _mm_cvtps_epi32(channels) };
+	const __m128i shorts{ _mm_packs_epi32(integers, integers) };
+	return static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_packus_epi16(shorts, shorts)));
+}
+
+#endif
+
+}
+
+image_format detect_image_format(std::string_view header) {
+	auto starts_with = [&](std::string_view prefix, size_t offset = 0) {
+		return header.size() >= offset + prefix.size() && header.substr(offset, prefix.size()) == prefix;
+	};
+	if (starts_with("\xFF\xD8\xFF")) {
+		return image_format::jpeg;
+	}
+	if (starts_with("\x89PNG\r\n\x1A\n")) {
+		return image_format::png;
+	}
+	if (starts_with("RIFF") && starts_with("WEBP", 8)) {
+		return image_format::webp;
+	}
+	return image_format::unknown;
+}
+
+std::optional<decoded_image> decode_thumbnail(std::string_view data, int max_size, bool scale_on_decode) {
+	try {
+		switch (detect_image_format(data)) {
+#if MILKY_JPEG
+		case image_format::jpeg:
+			return decode_jpeg(data, max_size, scale_on_decode);
+#endif
+#if MILKY_PNG
+		case image_format::png:
+			return decode_png(data, max_size);
+#endif
+#if MILKY_WEBP
+		case image_format::webp:
+			return decode_webp(data, max_size, scale_on_decode);
+#endif
+		default:
+			return std::nullopt;
+		}
+	} catch (const std::bad_alloc&) {
+		return std::nullopt;
+	}
+}
+
+decoded_image downscale(const decoded_image& source, int width, int height) {
+	decoded_image result;
+	result.width = width;
+	result.height = height;
+	result.pixels.resize(static_cast<size_t>(width) * static_cast<size_t>(height));
+	const auto columns = make_filter_spans(source.width, width);
+	const auto rows = make_filter_spans(source.height, height);
+	// the rows are filtered horizontally first, and the filtered rows are then combined vertically.
+	std::vector<float> filtered(static_cast<size_t>(width) * static_cast<size_t>(source.height) * 4);
+	for (int y{ 0 }; y < source.height; y++) {
+		const uint32_t* source_row{ source.pixels.data() + static_cast<size_t>(y) * source.width };
+		float* filtered_row{ filtered.data() + static_cast<size_t>(y) * width * 4 };
+		for (int x{ 0 }; x < width; x++) {
+			const auto& span = columns[x];
+#if MILKY_SSE2
+			__m128 sum{ _mm_setzero_ps() };
+			for (size_t i{ 0 }; i < span.weights.size(); i++) {
+				sum = _mm_add_ps(sum, _mm_mul_ps(load_pixel(source_row[span.first + i]), _mm_set1_ps(span.weights[i])));
+			}
+			_mm_storeu_ps(filtered_row + x * 4, sum);
+#else
+			float sum[4]{};
+			for (size_t i{ 0 }; i < span.weights.size(); i++) {
+				const auto bytes = reinterpret_cast<const uint8_t*>(&source_row[span.first + i]);
+				for (int channel{ 0 }; channel < 4; channel++) {
+					sum[channel] += bytes[channel] * span.weights[i];
+				}
+			}
+			std::memcpy(filtered_row + x * 4, sum, sizeof(sum));
+#endif
+		}
+	}
+	for (int y{ 0 }; y < height; y++) {
+		const auto& span = rows[y];
+		uint32_t* destination_row{ result.pixels.data() + static_cast<size_t>(y) * width };
+		for (int x{ 0 }; x < width; x++) {
+#if MILKY_SSE2
+			__m128 sum{ _mm_setzero_ps() };
+			for (size_t i{ 0 }; i < span.weights.size(); i++) {
+				const float* filtered_pixel{ filtered.data() + (static_cast<size_t>(span.first + i) * width + x) * 4 };
+				sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(filtered_pixel), _mm_set1_ps(span.weights[i])));
+			}
+			destination_row[x] = store_pixel(sum);
+#else
+			float sum[4]{};
+			for (size_t i{ 0 }; i < span.weights.size(); i++) {
+				const float* filtered_pixel{ filtered.data() + (static_cast<size_t>(span.first + i) * width + x) * 4 };
+				for (int channel{ 0 }; channel < 4; channel++) {
+					sum[channel] += filtered_pixel[channel] * span.weights[i];
+				}
+			}
+			uint8_t bytes[4];
+			for (int channel{ 0 }; channel < 4; channel++) {
+				bytes[channel] = static_cast<uint8_t>(std::clamp(std::lround(sum[channel]), 0L, 255L));
+			}
+			std::memcpy(&destination_row[x], bytes, sizeof(bytes));
+#endif
+		}
+	}
+	return result;
+}
+
+decoded_image downscale_to_fit(const decoded_image& source, int max_size) {
+	int width{ 0 };
+	int height{ 0 };
+	fit_size(source.width, source.height, max_size, width, height);
+	if (width == source.width && height == source.height) {
+		return source;
+	}
+	return downscale(source, width, height);
+}
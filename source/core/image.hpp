@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string_view>
+#include <optional>
+#include <vector>
+#include <cstdint>
+
+enum class image_format { unknown, jpeg, png, webp };
+
+// 8 bit RGBA, stored in that order in memory.
+struct decoded_image {
+	int width{ 0 };
+	int height{ 0 };
+	std::vector<uint32_t> pixels;
+};
+
+// Looks at the first bytes of the file. 16 bytes are enough.
+image_format detect_image_format(std::string_view header);
+
+// Decodes the image so it fits within max_size x max_size, keeping the aspect ratio. Smaller images are not enlarged.
+// If the codec supports it, the image is decoded at a reduced size first (JPEG DCT scaling, WebP scaling),
+// which is much faster than decoding everything and throwing most of it away.
+std::optional<decoded_image> decode_thumbnail(std::string_view data, int max_size, bool scale_on_decode = true);
+
+// Area averaging downscale. Only shrinks, so the size must not be larger than the source.
+decoded_image downscale(const decoded_image& source, int width, int height);
+
+// Downscales so the image fits within max_size x max_size, like decode_thumbnail. Returns a copy if it already fits.
+decoded_image downscale_to_fit(const decoded_image& source, int max_size);
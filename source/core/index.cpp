@@ -0,0 +1,547 @@
+#include "index.hpp"
+
+#include <algorithm>
+#include <cctype>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+static int count_bits(uint64_t word) {
+#if defined(_MSC_VER)
+	return static_cast<int>(__popcnt64(word));
+#else
+	return __builtin_popcountll(word);
+#endif
+}
+
+static int lowest_bit(uint64_t word) {
+#if defined(_MSC_VER)
+	unsigned long index{ 0 };
+	_BitScanForward64(&index, word);
+	return static_cast<int>(index);
+#else
+	return __builtin_ctzll(word);
+#endif
+}
+
+static std::vector<uint32_t> unique_trigrams(std::string_view folded_text) {
+	std::vector<uint32_t> trigrams;
+	for (size_t i{ 0 }; i + 2 < folded_text.size(); i++) {
+		const auto a = static_cast<uint8_t>(folded_text[i]);
+		const auto b = static_cast<uint8_t>(folded_text[i + 1]);
+		const auto c = static_cast<uint8_t>(folded_text[i + 2]);
+		trigrams.push_back(static_cast<uint32_t>(a) << 16 | static_cast<uint32_t>(b) << 8 | c);
+	}
+	std::sort(trigrams.begin(), trigrams.end());
+	trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+	return trigrams;
+}
+
+std::string name_index::fold(std::string_view text) {
+	std::string folded{ text };
+	for (auto& character : folded) {
+		character = static_cast<char>(std::tolower(static_cast<unsigned char>(character)));
+	}
+	return folded;
+}
+
+void name_index::posting_list::add(uint32_t id) {
+	if (count > 0 && id <= last_id) {
+		late_ids.push_back(id);
+		encode_if_needed();
+	} else {
+		append(id);
+	}
+}
+
+void name_index::posting_list::remove(uint32_t id) {
+	removed_ids.push_back(id);
+	encode_if_needed();
+}
+
+void name_index::posting_list::append(uint32_t id) {
+	uint32_t delta{ count > 0 ? id - last_id : id };
+	while (delta >= 0x80) {
+		deltas.push_back(static_cast<uint8_t>(delta | 0x80));
+		delta >>= 7;
+	}
+	deltas.push_back(static_cast<uint8_t>(delta));
+	last_id = id;
+	count++;
+}
+
+void name_index::posting_list::encode_if_needed() {
+	const size_t kept_aside{ late_ids.size() + removed_ids.size() };
+	if (kept_aside < std::max<size_t>(min_ids_before_encoding, count / 4)) {
+		return;
+	}
+	const auto ids = decode();
+	deltas = {};
+	late_ids = {};
+	removed_ids = {};
+	count = 0;
+	last_id = 0;
+	for (const auto id : ids) {
+		append(id);
+	}
+}
+
+std::vector<uint32_t> name_index::posting_list::decode() const {
+	std::vector<uint32_t> ids;
+	ids.reserve(count + late_ids.size());
+	uint32_t id{ 0 };
+	uint32_t delta{ 0 };
+	int shift{ 0 };
+	for (const auto byte : deltas) {
+		delta |= static_cast<uint32_t>(byte & 0x7F) << shift;
+		if (byte & 0x80) {
+			shift += 7;
+			continue;
+		}
+		id += delta;
+		ids.push_back(id);
+		delta = 0;
+		shift = 0;
+	}
+	if (!late_ids.empty()) {
+		auto sorted_late_ids = late_ids;
+		std::sort(sorted_late_ids.begin(), sorted_late_ids.end());
+		const auto middle = ids.insert(ids.end(), sorted_late_ids.begin(), sorted_late_ids.end());
+		std::inplace_merge(ids.begin(), middle, ids.end());
+	}
+	if (!removed_ids.empty()) {
+		// an id is only added when it's not in the list, and only removed when it is, so an id that was removed and added
+		// again is in the list twice, and removed once.
+		auto sorted_removed_ids = removed_ids;
+		std::sort(sorted_removed_ids.begin(), sorted_removed_ids.end());
+		std::vector<uint32_t> kept_ids;
+		kept_ids.reserve(ids.size());
+		std::set_difference(ids.begin(), ids.end(), sorted_removed_ids.begin(), sorted_removed_ids.end(), std::back_inserter(kept_ids));
+		ids = std::move(kept_ids);
+	}
+	ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+	return ids;
+}
+
+size_t name_index::posting_list::size() const {
+	return count + late_ids.size() - removed_ids.size();
+}
+
+void name_index::add_trigrams(uint32_t id, const std::vector<uint32_t>& trigrams) {
+	for (const auto trigram : trigrams) {
+		postings[trigram].add(id);
+	}
+}
+
+void name_index::remove_trigrams(uint32_t id, const std::vector<uint32_t>& trigrams) {
+	for (const auto trigram : trigrams) {
+		if (auto list = postings.find(trigram); list != postings.end()) {
+			list->second.remove(id);
+			if (list->second.size() == 0) {
+				postings.erase(list);
+			}
+		}
+	}
+}
+
+void name_index::add(uint32_t id, std::string_view name) {
+	add_trigrams(id, unique_trigrams(fold(name)));
+}
+
+void name_index::remove(uint32_t id, std::string_view name) {
+	remove_trigrams(id, unique_trigrams(fold(name)));
+}
+
+void name_index::rename(uint32_t id, std::string_view old_name, std::string_view new_name) {
+	const auto old_trigrams = unique_trigrams(fold(old_name));
+	const auto new_trigrams = unique_trigrams(fold(new_name));
+	std::vector<uint32_t> removed_trigrams;
+	std::vector<uint32_t> added_trigrams;
+	std::set_difference(old_trigrams.begin(), old_trigrams.end(), new_trigrams.begin(), new_trigrams.end(), std::back_inserter(removed_trigrams));
+	std::set_difference(new_trigrams.begin(), new_trigrams.end(), old_trigrams.begin(), old_trigrams.end(), std::back_inserter(added_trigrams));
+	remove_trigrams(id, removed_trigrams);
+	add_trigrams(id, added_trigrams);
+}
+
+std::optional<std::vector<uint32_t>> name_index::candidates(std::string_view text) const {
+	const auto trigrams = unique_trigrams(fold(text));
+	if (trigrams.empty()) {
+		return std::nullopt;
+	}
+	std::vector<const posting_list*> lists;
+	for (const auto trigram : trigrams) {
+		if (const auto list = postings.find(trigram); list != postings.end()) {
+			lists.push_back(&list->second);
+		} else {
+			return std::vector<uint32_t>{};
+		}
+	}
+	// starting with the shortest list keeps the intersections small.
+	std::sort(lists.begin(), lists.end(), [](const auto a, const auto b) {
+		return a->size() < b->size();
+	});
+	auto ids = lists[0]->decode();
+	for (size_t i{ 1 }; i < lists.size() && !ids.empty(); i++) {
+		const auto other_ids = lists[i]->decode();
+		std::vector<uint32_t> intersection;
+		std::set_intersection(ids.begin(), ids.end(), other_ids.begin(), other_ids.end(), std::back_inserter(intersection));
+		ids = std::move(intersection);
+	}
+	return ids;
+}
+
+size_t name_index::memory_usage() const {
+	size_t bytes{ 0 };
+	for (const auto& [trigram, list] : postings) {
+		bytes += sizeof(trigram) + sizeof(list) + list.deltas.capacity() + (list.late_ids.capacity() + list.removed_ids.capacity()) * sizeof(uint32_t);
+	}
+	return bytes;
+}
+
+bool id_bitmap::block::is_bitmap() const {
+	return !bits.empty();
+}
+
+bool id_bitmap::block::test(uint16_t value) const {
+	if (is_bitmap()) {
+		return bits[value / 64] & (1ull << (value % 64));
+	}
+	return std::binary_search(values.begin(), values.end(), value);
+}
+
+void id_bitmap::block::set(uint16_t value) {
+	if (is_bitmap()) {
+		const uint64_t bit{ 1ull << (value % 64) };
+		count += (bits[value / 64] & bit) ? 0 : 1;
+		bits[value / 64] |= bit;
+		return;
+	}
+	if (const auto found = std::lower_bound(values.begin(), values.end(), value); found == values.end() || *found != value) {
+		values.insert(found, value);
+		count++;
+		if (values.size() > max_array_size) {
+			to_bitmap();
+		}
+	}
+}
+
+void id_bitmap::block::reset(uint16_t value) {
+	if (is_bitmap()) {
+		const uint64_t bit{ 1ull << (value % 64) };
+		count -= (bits[value / 64] & bit) ? 1 : 0;
+		bits[value / 64] &= ~bit;
+		// not as soon as it fits in an array, so setting and resetting the same id doesn't convert every time.
+		if (count <= max_array_size / 2) {
+			to_array();
+		}
+		return;
+	}
+	if (const auto found = std::lower_bound(values.begin(), values.end(), value); found != values.end() && *found == value) {
+		values.erase(found);
+		count--;
+	}
+}
+
+void id_bitmap::block::to_bitmap() {
+	bits.assign(bitmap_words, 0);
+	for (const auto value : values) {
+		bits[value / 64] |= 1ull << (value % 64);
+	}
+	values = {};
+}
+
+void id_bitmap::block::to_array() {
+	values.clear();
+	values.reserve(count);
+	for (size_t word{ 0 }; word < bits.size(); word++) {
+		for (uint64_t remaining{ bits[word] }; remaining != 0; remaining &= remaining - 1) {
+			values.push_back(static_cast<uint16_t>(word * 64 + lowest_bit(remaining)));
+		}
+	}
+	bits = {};
+}
+
+void id_bitmap::block::unite(const block& other) {
+	if (other.is_bitmap() && !is_bitmap()) {
+		auto own_values = std::move(values);
+		bits = other.bits;
+		values = {};
+		for (const auto value : own_values) {
+			bits[value / 64] |= 1ull << (value % 64);
+		}
+	} else if (other.is_bitmap()) {
+		for (size_t word{ 0 }; word < bitmap_words; word++) {
+			bits[word] |= other.bits[word];
+		}
+	} else if (is_bitmap()) {
+		for (const auto value : other.values) {
+			bits[value / 64] |= 1ull << (value % 64);
+		}
+	} else {
+		std::vector<uint16_t> united;
+		united.reserve(values.size() + other.values.size());
+		std::set_union(values.begin(), values.end(), other.values.begin(), other.values.end(), std::back_inserter(united));
+		values = std::move(united);
+		count = static_cast<uint32_t>(values.size());
+		if (values.size() > max_array_size) {
+			to_bitmap();
+		}
+		return;
+	}
+	count = 0;
+	for (const auto word : bits) {
+		count += count_bits(word);
+	}
+}
+
+void id_bitmap::block::intersect(const block& other) {
+	if (is_bitmap() && other.is_bitmap()) {
+		count = 0;
+		for (size_t word{ 0 }; word < bitmap_words; word++) {
+			bits[word] &= other.bits[word];
+			count += count_bits(bits[word]);
+		}
+		if (count <= max_array_size) {
+			to_array();
+		}
+		return;
+	}
+	// the result is never larger than the array, so it's an array.
+	const auto& array = is_bitmap() ? other.values : values;
+	const auto& filter = is_bitmap() ? *this : other;
+	std::vector<uint16_t> intersection;
+	if (filter.is_bitmap()) {
+		std::copy_if(array.begin(), array.end(), std::back_inserter(intersection), [&filter](uint16_t value) {
+			return filter.test(value);
+		});
+	} else {
+		std::set_intersection(array.begin(), array.end(), filter.values.begin(), filter.values.end(), std::back_inserter(intersection));
+	}
+	values = std::move(intersection);
+	bits = {};
+	count = static_cast<uint32_t>(values.size());
+}
+
+size_t id_bitmap::block::count_intersection(const block& other) const {
+	if (is_bitmap() && other.is_bitmap()) {
+		size_t total{ 0 };
+		for (size_t word{ 0 }; word < bitmap_words; word++) {
+			total += count_bits(bits[word] & other.bits[word]);
+		}
+		return total;
+	}
+	if (is_bitmap() || other.is_bitmap()) {
+		const auto& array = is_bitmap() ? other.values : values;
+		const auto& bitmap = is_bitmap() ? *this : other;
+		return static_cast<size_t>(std::count_if(array.begin(), array.end(), [&bitmap](uint16_t value) {
+			return bitmap.test(value);
+		}));
+	}
+	size_t total{ 0 };
+	auto a = values.begin();
+	auto b = other.values.begin();
+	while (a != values.end() && b != other.values.end()) {
+		if (*a < *b) {
+			a++;
+		} else if (*b < *a) {
+			b++;
+		} else {
+			total++;
+			a++;
+			b++;
+		}
+	}
+	return total;
+}
+
+void id_bitmap::set(uint32_t id) {
+	const auto key = static_cast<uint16_t>(id >> 16);
+	auto found = std::lower_bound(blocks.begin(), blocks.end(), key, [](const block& block, uint16_t key) {
+		return block.key < key;
+	});
+	if (found == blocks.end() || found->key != key) {
+		found = blocks.insert(found, block{});
+		found->key = key;
+	}
+	found->set(static_cast<uint16_t>(id));
+}
+
+void id_bitmap::reset(uint32_t id) {
+	const auto key = static_cast<uint16_t>(id >> 16);
+	const auto found = std::lower_bound(blocks.begin(), blocks.end(), key, [](const block& block, uint16_t key) {
+		return block.key < key;
+	});
+	if (found != blocks.end() && found->key == key) {
+		found->reset(static_cast<uint16_t>(id));
+		if (found->count == 0) {
+			blocks.erase(found);
+		}
+	}
+}
+
+bool id_bitmap::test(uint32_t id) const {
+	const auto key = static_cast<uint16_t>(id >> 16);
+	const auto found = std::lower_bound(blocks.begin(), blocks.end(), key, [](const block& block, uint16_t key) {
+		return block.key < key;
+	});
+	return found != blocks.end() && found->key == key && found->test(static_cast<uint16_t>(id));
+}
+
+bool id_bitmap::empty() const {
+	return blocks.empty();
+}
+
+size_t id_bitmap::count() const {
+	size_t total{ 0 };
+	for (const auto& block : blocks) {
+		total += block.count;
+	}
+	return total;
+}
+
+void id_bitmap::unite(const id_bitmap& other) {
+	std::vector<block> united;
+	united.reserve(blocks.size() + other.blocks.size());
+	auto a = blocks.begin();
+	auto b = other.blocks.begin();
+	while (a != blocks.end() || b != other.blocks.end()) {
+		if (b == other.blocks.end() || (a != blocks.end() && a->key < b->key)) {
+			united.push_back(std::move(*a++));
+		} else if (a == blocks.end() || b->key < a->key) {
+			united.push_back(*b++);
+		} else {
+			a->unite(*b++);
+			united.push_back(std::move(*a++));
+		}
+	}
+	blocks = std::move(united);
+}
+
+void id_bitmap::intersect(const id_bitmap& other) {
+	std::vector<block> intersection;
+	auto b = other.blocks.begin();
+	for (auto& block : blocks) {
+		while (b != other.blocks.end() && b->key < block.key) {
+			b++;
+		}
+		if (b == other.blocks.end()) {
+			break;
+		}
+		if (b->key == block.key) {
+			block.intersect(*b);
+			if (block.count > 0) {
+				intersection.push_back(std::move(block));
+			}
+		}
+	}
+	blocks = std::move(intersection);
+}
+
+size_t id_bitmap::count_intersection(const id_bitmap& other) const {
+	size_t total{ 0 };
+	auto b = other.blocks.begin();
+	for (const auto& block : blocks) {
+		while (b != other.blocks.end() && b->key < block.key) {
+			b++;
+		}
+		if (b == other.blocks.end()) {
+			break;
+		}
+		if (b->key == block.key) {
+			total += block.count_intersection(*b);
+		}
+	}
+	return total;
+}
+
+std::vector<uint32_t> id_bitmap::ids() const {
+	std::vector<uint32_t> result;
+	result.reserve(count());
+	for (const auto& block : blocks) {
+		const uint32_t high{ static_cast<uint32_t>(block.key) << 16 };
+		if (!block.is_bitmap()) {
+			for (const auto value : block.values) {
+				result.push_back(high | value);
+			}
+			continue;
+		}
+		for (size_t word{ 0 }; word < block.bits.size(); word++) {
+			for (uint64_t remaining{ block.bits[word] }; remaining != 0; remaining &= remaining - 1) {
+				result.push_back(high | static_cast<uint32_t>(word * 64 + lowest_bit(remaining)));
+			}
+		}
+	}
+	return result;
+}
+
+size_t id_bitmap::memory_usage() const {
+	size_t bytes{ blocks.capacity() * sizeof(block) };
+	for (const auto& block : blocks) {
+		bytes += block.values.capacity() * sizeof(uint16_t) + block.bits.capacity() * sizeof(uint64_t);
+	}
+	return bytes;
+}
+
+void tag_index::add(uint32_t id, const std::vector<std::string>& tags) {
+	if (!tags.empty() && id >= tag_numbers_by_id.size()) {
+		tag_numbers_by_id.resize(id + 1);
+	}
+	for (const auto& tag : tags) {
+		auto [entry, is_new] = bitmaps.try_emplace(tag);
+		if (is_new) {
+			entry->second.number = static_cast<uint32_t>(tag_names.size());
+			tag_names.push_back(tag);
+		}
+		if (!entry->second.ids.test(id)) {
+			entry->second.ids.set(id);
+			tag_numbers_by_id[id].push_back(entry->second.number);
+		}
+	}
+}
+
+void tag_index::remove(uint32_t id, const std::vector<std::string>& tags) {
+	for (const auto& tag : tags) {
+		if (auto entry = bitmaps.find(tag); entry != bitmaps.end() && entry->second.ids.test(id)) {
+			entry->second.ids.reset(id);
+			auto& numbers = tag_numbers_by_id[id];
+			numbers.erase(std::find(numbers.begin(), numbers.end(), entry->second.number));
+		}
+	}
+}
+
+const id_bitmap* tag_index::find(const std::string& tag) const {
+	const auto entry = bitmaps.find(tag);
+	return entry != bitmaps.end() ? &entry->second.ids : nullptr;
+}
+
+std::vector<std::string> tag_index::all_tags() const {
+	std::vector<std::string> tags;
+	for (const auto& [tag, entry] : bitmaps) {
+		if (!entry.ids.empty()) {
+			tags.push_back(tag);
+		}
+	}
+	return tags;
+}
+
+std::vector<std::string> tag_index::tags_of(uint32_t id) const {
+	std::vector<std::string> tags;
+	if (id < tag_numbers_by_id.size()) {
+		for (const auto number : tag_numbers_by_id[id]) {
+			tags.push_back(tag_names[number]);
+		}
+	}
+	return tags;
+}
+
+size_t tag_index::memory_usage() const {
+	size_t bytes{ tag_names.capacity() * sizeof(std::string) + tag_numbers_by_id.capacity() * sizeof(std::vector<uint32_t>) };
+	for (const auto& [tag, entry] : bitmaps) {
+		bytes += tag.capacity() + sizeof(entry) + entry.ids.memory_usage();
+	}
+	for (const auto& numbers : tag_numbers_by_id) {
+		bytes += numbers.capacity() * sizeof(uint32_t);
+	}
+	return bytes;
+}
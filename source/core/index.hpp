@@ -0,0 +1,135 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <optional>
+#include <cstdint>
+
+// Maps every three character sequence in a file name to the ids of the files with that sequence in their name.
+// Ids are mostly added in increasing order, so they are stored as variable-length deltas to save memory.
+// Ids that are added out of order or removed are kept aside, and merged into the deltas when there are many.
+class name_index {
+public:
+
+	// Names are indexed and searched case-insensitively.
+	static std::string fold(std::string_view text);
+
+	void add(uint32_t id, std::string_view name);
+	void remove(uint32_t id, std::string_view name);
+
+	// Only the trigrams that are in one of the names are changed.
+	void rename(uint32_t id, std::string_view old_name, std::string_view new_name);
+
+	// Returns the sorted ids of the names that contain every trigram in the text.
+	// The names must still be checked, since the trigrams may be found in a different order.
+	// Returns nullopt if the text is too short to use the index.
+	std::optional<std::vector<uint32_t>> candidates(std::string_view text) const;
+
+	size_t memory_usage() const;
+
+private:
+
+	struct posting_list {
+		// the lists are encoded again when this many ids are kept aside, or a quarter of the encoded ids if that's more.
+		static constexpr size_t min_ids_before_encoding{ 64 };
+
+		std::vector<uint8_t> deltas;
+		std::vector<uint32_t> late_ids; // ids that were added after a greater id. unsorted.
+		std::vector<uint32_t> removed_ids; // ids that are still in the deltas or the late ids. unsorted.
+		uint32_t last_id{ 0 };
+		uint32_t count{ 0 }; // the ids in the deltas.
+
+		void add(uint32_t id);
+		void remove(uint32_t id);
+		void append(uint32_t id);
+		void encode_if_needed();
+		std::vector<uint32_t> decode() const;
+		size_t size() const;
+	};
+
+	void add_trigrams(uint32_t id, const std::vector<uint32_t>& trigrams);
+	void remove_trigrams(uint32_t id, const std::vector<uint32_t>& trigrams);
+
+	std::unordered_map<uint32_t, posting_list> postings;
+
+};
+
+// A set of path ids. The ids are split into blocks of 65536, and a block is a sorted array of the ids in it while it
+// has few, and a bitmap when it has many, like a Roaring bitmap. A tag that few files have only takes memory for those,
+// and a common tag takes at most a bit for every path.
+class id_bitmap {
+public:
+
+	void set(uint32_t id);
+	void reset(uint32_t id);
+	bool test(uint32_t id) const;
+	bool empty() const;
+	size_t count() const;
+
+	void unite(const id_bitmap& other);
+	void intersect(const id_bitmap& other);
+
+	// The number of ids in both, without making the intersection.
+	size_t count_intersection(const id_bitmap& other) const;
+
+	// Returns the sorted ids.
+	std::vector<uint32_t> ids() const;
+
+	size_t memory_usage() const;
+
+private:
+
+	struct block {
+		// An array has at most this many ids, which takes as much memory as the bitmap.
+		static constexpr size_t max_array_size{ 4096 };
+		static constexpr size_t bitmap_words{ 1024 };
+
+		uint16_t key{ 0 }; // the high 16 bits of the ids.
+		uint32_t count{ 0 };
+		std::vector<uint16_t> values; // sorted low 16 bits, while the block is an array.
+		std::vector<uint64_t> bits; // bitmap_words words, when the block is a bitmap.
+
+		bool is_bitmap() const;
+		bool test(uint16_t value) const;
+		void set(uint16_t value);
+		void reset(uint16_t value);
+		void to_bitmap();
+		void to_array();
+		void unite(const block& other);
+		void intersect(const block& other);
+		size_t count_intersection(const block& other) const;
+	};
+
+	std::vector<block> blocks; // sorted by key. empty blocks are removed.
+
+};
+
+// Maps every tag to the ids of the files with that tag, and every file to its tags.
+class tag_index {
+public:
+
+	void add(uint32_t id, const std::vector<std::string>& tags);
+	void remove(uint32_t id, const std::vector<std::string>& tags);
+
+	// Returns nullptr if no file has the tag.
+	const id_bitmap* find(const std::string& tag) const;
+	std::vector<std::string> all_tags() const;
+
+	std::vector<std::string> tags_of(uint32_t id) const;
+
+	size_t memory_usage() const;
+
+private:
+
+	struct tag_ids {
+		uint32_t number{ 0 };
+		id_bitmap ids;
+	};
+
+	std::unordered_map<std::string, tag_ids> bitmaps;
+	std::vector<std::string> tag_names; // by number.
+	std::vector<std::vector<uint32_t>> tag_numbers_by_id; // unsorted, and empty for the files without tags.
+
+};
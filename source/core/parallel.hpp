@@ -0,0 +1,75 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <thread>
+#include <vector>
+
+inline int worker_thread_count() {
+	const int count{ static_cast<int>(std::thread::hardware_concurrency()) };
+	return count > 0 ? count : 1;
+}
+
+// Calls work(index) for every index in [0, count), spread over at most max_threads threads.
+// Indices are handed out one at a time, so uneven work is balanced between the threads.
+template<typename F>
+void parallel_for(size_t count, int max_threads, F&& work) {
+	const size_t thread_count{ std::min(static_cast<size_t>(std::max(max_threads, 1)), count) };
+	std::atomic<size_t> next_index{ 0 };
+	auto worker = [&] {
+		for (size_t index{ next_index++ }; index < count; index = next_index++) {
+			work(index);
+		}
+	};
+	std::vector<std::future<void>> workers;
+	for (size_t i{ 1 }; i < thread_count; i++) {
+		workers.push_back(std::async(std::launch::async, worker));
+	}
+	worker();
+	for (auto& future : workers) {
+		future.get();
+	}
+}
+
+// Same as above, spread over all cores.
+template<typename F>
+void parallel_for(size_t count, F&& work) {
+	parallel_for(count, worker_thread_count(), std::forward<F>(work));
+}
+
+// Sorts the range in parallel. The range is split into one slice per thread,
+// and the sorted slices are merged pairwise until one slice remains.
+template<typename T, typename Compare>
+void parallel_sort(std::vector<T>& values, Compare compare) {
+	constexpr size_t minimum_slice_size{ 4096 };
+	const size_t slice_count{ std::clamp(values.size() / minimum_slice_size, static_cast<size_t>(1), static_cast<size_t>(worker_thread_count())) };
+	if (slice_count == 1) {
+		std::sort(values.begin(), values.end(), compare);
+		return;
+	}
+	std::vector<size_t> bounds;
+	for (size_t slice{ 0 }; slice <= slice_count; slice++) {
+		bounds.push_back(values.size() * slice / slice_count);
+	}
+	parallel_for(slice_count, [&](size_t slice) {
+		std::sort(values.begin() + bounds[slice], values.begin() + bounds[slice + 1], compare);
+	});
+	while (bounds.size() > 2) {
+		const size_t merge_count{ (bounds.size() - 1) / 2 };
+		parallel_for(merge_count, [&](size_t merge) {
+			const auto first = values.begin() + bounds[merge * 2];
+			const auto middle = values.begin() + bounds[merge * 2 + 1];
+			const auto last = values.begin() + bounds[merge * 2 + 2];
+			std::inplace_merge(first, middle, last, compare);
+		});
+		std::vector<size_t> merged_bounds;
+		for (size_t i{ 0 }; i < bounds.size(); i += 2) {
+			merged_bounds.push_back(bounds[i]);
+		}
+		if (merged_bounds.back() != bounds.back()) {
+			merged_bounds.push_back(bounds.back());
+		}
+		bounds = std::move(merged_bounds);
+	}
+}
@@ -0,0 +1,161 @@
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace profiler {
+
+namespace {
+
+constexpr size_t events_per_thread{ 16384 };
+
+struct zone_event {
+	const char* name{ nullptr };
+	int64_t start{ 0 };
+	int64_t duration{ 0 };
+};
+
+// Only the owning thread writes, so the lock is uncontended except while the events are being read.
+struct event_ring {
+	std::mutex mutex;
+	std::vector<zone_event> events;
+	size_t written{ 0 };
+	int thread_id{ 0 };
+
+	template<typename F>
+	void for_each(F&& function) {
+		const size_t count{ std::min(written, events.size()) };
+		for (size_t i{ written - count }; i < written; i++) {
+			function(events[i % events.size()]);
+		}
+	}
+};
+
+// The ring of a thread that has exited is reused by the next new thread, so there are never more rings than threads
+// alive at once, even though parallel_for starts new threads all the time. The events of the exited thread are kept
+// until the new thread overwrites them, so they can still be exported.
+std::mutex rings_mutex;
+std::vector<std::shared_ptr<event_ring>> rings;
+std::vector<event_ring*> free_rings;
+
+const auto epoch = std::chrono::steady_clock::now();
+
+struct ring_owner {
+	event_ring* ring{ nullptr };
+
+	~ring_owner() {
+		if (ring) {
+			std::lock_guard lock{ rings_mutex };
+			free_rings.push_back(ring);
+		}
+	}
+};
+
+event_ring& thread_ring() {
+	thread_local ring_owner owner;
+	if (!owner.ring) {
+		std::lock_guard lock{ rings_mutex };
+		if (!free_rings.empty()) {
+			owner.ring = free_rings.back();
+			free_rings.pop_back();
+		} else {
+			auto& ring = rings.emplace_back(std::make_shared<event_ring>());
+			ring->events.resize(events_per_thread);
+			ring->thread_id = static_cast<int>(rings.size());
+			owner.ring = ring.get();
+		}
+	}
+	return *owner.ring;
+}
+
+std::vector<std::shared_ptr<event_ring>> all_rings() {
+	std::lock_guard lock{ rings_mutex };
+	return rings;
+}
+
+std::string escape_json(const char* text) {
+	std::string escaped;
+	for (; *text; text++) {
+		if (*text == '"' || *text == '\\') {
+			escaped += '\\';
+		}
+		escaped += *text;
+	}
+	return escaped;
+}
+
+}
+
+void set_enabled(bool enabled) {
+	active.store(enabled, std::memory_order_relaxed);
+}
+
+int64_t now() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void record(const char* name, int64_t start, int64_t duration) {
+	auto& ring = thread_ring();
+	std::lock_guard lock{ ring.mutex };
+	ring.events[ring.written % ring.events.size()] = { name, start, duration };
+	ring.written++;
+}
+
+std::vector<zone_stats> collect_stats() {
+	std::map<std::string, std::vector<int64_t>> durations;
+	for (const auto& ring : all_rings()) {
+		std::lock_guard lock{ ring->mutex };
+		ring->for_each([&](const zone_event& event) {
+			durations[event.name].push_back(event.duration);
+		});
+	}
+	auto percentile = [](const std::vector<int64_t>& sorted, double fraction) {
+		const auto index = static_cast<size_t>(fraction * static_cast<double>(sorted.size() - 1) + 0.5);
+		return static_cast<double>(sorted[index]) / 1.0e6;
+	};
+	std::vector<zone_stats> stats;
+	for (auto& [name, zone_durations] : durations) {
+		std::sort(zone_durations.begin(), zone_durations.end());
+		auto& zone = stats.emplace_back();
+		zone.name = name;
+		zone.count = zone_durations.size();
+		zone.p50_milliseconds = percentile(zone_durations, 0.5);
+		zone.p99_milliseconds = percentile(zone_durations, 0.99);
+	}
+	return stats;
+}
+
+bool export_chrome_trace(const std::filesystem::path& path) {
+	std::ofstream file{ path, std::ios::binary };
+	if (!file) {
+		return false;
+	}
+	file << std::fixed << std::setprecision(3);
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	bool first{ true };
+	for (const auto& ring : all_rings()) {
+		std::lock_guard lock{ ring->mutex };
+		ring->for_each([&](const zone_event& event) {
+			// chrome wants microseconds.
+			file << (first ? "" : ",") << "\n{\"name\":\"" << escape_json(event.name) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << ring->thread_id
+				<< ",\"ts\":" << static_cast<double>(event.start) / 1000.0 << ",\"dur\":" << static_cast<double>(event.duration) / 1000.0 << "}";
+			first = false;
+		});
+	}
+	file << "\n]}\n";
+	return static_cast<bool>(file);
+}
+
+void clear() {
+	for (const auto& ring : all_rings()) {
+		std::lock_guard lock{ ring->mutex };
+		ring->written = 0;
+	}
+}
+
+}
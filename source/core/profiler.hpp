@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <filesystem>
+
+// Scoped timing zones for the hot paths. Every thread records into its own ring buffer, so only the
+// latest events are kept. When the profiler is switched off a zone costs a single relaxed load, and
+// building without MILKY_PROFILER removes the zones entirely.
+
+#if MILKY_PROFILER
+#define PROFILE_CONCATENATE_INNER(a, b) a##b
+#define PROFILE_CONCATENATE(a, b) PROFILE_CONCATENATE_INNER(a, b)
+#define PROFILE_ZONE(name) profiler::scoped_zone PROFILE_CONCATENATE(profile_zone_, __LINE__){ name }
+#else
+#define PROFILE_ZONE(name)
+#endif
+
+namespace profiler {
+
+inline std::atomic<bool> active{ false };
+
+struct zone_stats {
+	std::string name;
+	size_t count{ 0 };
+	double p50_milliseconds{ 0.0 };
+	double p99_milliseconds{ 0.0 };
+};
+
+void set_enabled(bool enabled);
+
+inline bool is_enabled() {
+	return active.load(std::memory_order_relaxed);
+}
+
+int64_t now();
+
+// The name must be a string literal, or otherwise outlive the profiler.
+void record(const char* name, int64_t start, int64_t duration);
+
+// Percentiles over the events that are still in the ring buffers, sorted by name.
+std::vector<zone_stats> collect_stats();
+
+// Writes the events in the ring buffers as Chrome trace JSON, which can be opened in chrome://tracing or Perfetto.
+bool export_chrome_trace(const std::filesystem::path& path);
+
+void clear();
+
+class scoped_zone {
+public:
+
+	scoped_zone(const char* name) : name{ name }, start{ is_enabled() ? now() : -1 } {}
+	scoped_zone(const scoped_zone&) = delete;
+	scoped_zone(scoped_zone&&) = delete;
+
+	~scoped_zone() {
+		if (start >= 0) {
+			record(name, start, now() - start);
+		}
+	}
+
+	scoped_zone& operator=(const scoped_zone&) = delete;
+	scoped_zone& operator=(scoped_zone&&) = delete;
+
+private:
+
+	const char* name{ nullptr };
+	int64_t start{ -1 };
+
+};
+
+}
@@ -0,0 +1,144 @@
+#include "retag.hpp"
+#include "tags.hpp"
+#include "parallel.hpp"
+#include "profiler.hpp"
+#include "debug.hpp"
+
+std::vector<std::string> apply_tag_operation(const tag_operation& operation, std::vector<std::string> tags) {
+	if (operation.kind == tag_operation_kind::add) {
+		if (std::find(tags.begin(), tags.end(), operation.tag) == tags.end()) {
+			tags.push_back(operation.tag);
+		}
+		return tags;
+	}
+	const auto found_tag = std::find(tags.begin(), tags.end(), operation.tag);
+	if (found_tag == tags.end()) {
+		return tags;
+	}
+	tags.erase(found_tag);
+	if (operation.kind != tag_operation_kind::remove && std::find(tags.begin(), tags.end(), operation.new_tag) == tags.end()) {
+		tags.push_back(operation.new_tag);
+	}
+	return tags;
+}
+
+bulk_retag::bulk_retag(const tag_operation& operation, search_path_cache_list& caches) : current_operation{ operation }, caches{ caches } {
+	// the index is only read here, so the caches can be changed while the files are renamed.
+	for (const auto& cache : caches.caches) {
+		auto lock = cache->lock();
+		if (operation.kind == tag_operation_kind::mirror) {
+			std::copy_if(cache->paths().begin(), cache->paths().end(), std::back_inserter(paths), [](const auto& path) {
+				return !path.empty();
+			});
+		} else if (const auto ids = cache->tag_ids().find(operation.tag)) {
+			for (const auto id : ids->ids()) {
+				paths.push_back(cache->paths()[id]);
+			}
+		}
+	}
+	// nested search directories have some of the same files.
+	std::sort(paths.begin(), paths.end());
+	paths.erase(std::unique(paths.begin(), paths.end()), paths.end());
+	future_result = std::async(std::launch::async, &bulk_retag::rename_files, this);
+}
+
+bulk_retag::bulk_retag(const tag_operation& operation, std::vector<std::filesystem::path> paths, search_path_cache_list& caches)
+	: current_operation{ operation }, caches{ caches }, paths{ std::move(paths) }, changes_registry{ false } {
+	future_result = std::async(std::launch::async, &bulk_retag::rename_files, this);
+}
+
+const tag_operation& bulk_retag::operation() const {
+	return current_operation;
+}
+
+size_t bulk_retag::files_done() const {
+	return done;
+}
+
+size_t bulk_retag::file_count() const {
+	return paths.size();
+}
+
+bool bulk_retag::is_done() const {
+	return future_result.valid() && no::is_future_ready(future_result);
+}
+
+void bulk_retag::wait() const {
+	if (future_result.valid()) {
+		future_result.wait();
+	}
+}
+
+std::optional<bulk_retag::result> bulk_retag::finish() {
+	if (!is_done()) {
+		return std::nullopt;
+	}
+	auto finished = future_result.get();
+	caches.rename_paths(finished.renamed_paths);
+	// the other files may still have the tag, so the registry is left alone.
+	if (!changes_registry) {
+		INFO("Wrote the tags of " << finished.renamed_paths.size() << " chosen files. " << finished.failures.size() << " failed.");
+		return finished;
+	}
+	if (finished.failures.empty()) {
+		update_registry();
+	} else if (current_operation.kind != tag_operation_kind::mirror) {
+		// the files that failed still have the old tag, so it's kept until the operation is run again.
+		WARNING("The registry was not changed, since the tags of some files could not be written.");
+	}
+	INFO("Wrote the tags of " << finished.renamed_paths.size() << " files with tag " << current_operation.tag << ". " << finished.failures.size() << " failed.");
+	return finished;
+}
+
+bulk_retag::result bulk_retag::rename_files() {
+	PROFILE_ZONE("bulk_retag");
+	std::vector<std::filesystem::path> new_paths(paths.size());
+	std::vector<std::error_code> errors(paths.size());
+	std::vector<uint8_t> written(paths.size()); // not bool, since the threads write next to each other.
+	parallel_for(paths.size(), [&](size_t index) {
+		const auto& path = paths[index];
+		const auto old_tags = tags::read_tags(path);
+		if (current_operation.kind == tag_operation_kind::mirror) {
+			const auto name_tags = tags::parse_tags(path.filename().u8string());
+			if (tags::make_tag_string(name_tags) != tags::make_tag_string(old_tags)) {
+				new_paths[index] = tags::rename_with_tags(path, old_tags, errors[index]);
+				written[index] = 1;
+			}
+		} else if (const auto new_tags = apply_tag_operation(current_operation, old_tags); new_tags != old_tags) {
+			new_paths[index] = tags::write_tags(path, new_tags, errors[index]);
+			written[index] = 1;
+		}
+		done++;
+	});
+	result finished;
+	for (size_t index{ 0 }; index < paths.size(); index++) {
+		if (errors[index]) {
+			finished.failures.push_back({ paths[index], errors[index].message() });
+		} else if (written[index]) {
+			finished.renamed_paths.emplace_back(paths[index], new_paths[index]);
+		}
+	}
+	return finished;
+}
+
+void bulk_retag::update_registry() {
+	const auto& [kind, tag, new_tag] = current_operation;
+	if (kind == tag_operation_kind::mirror) {
+		return;
+	}
+	if (kind == tag_operation_kind::rename && !tags::find_tag(new_tag)) {
+		// renaming keeps the group, colors and description.
+		if (auto renamed_tag = tags::find_tag(tag)) {
+			renamed_tag->name = new_tag;
+			if (renamed_tag->pretty_name == tag) {
+				renamed_tag->pretty_name = new_tag;
+			}
+			tags::replace_tag(tag, renamed_tag.value());
+		}
+		tags::replace_tag_in_implications(tag, new_tag);
+		return;
+	}
+	// merging into an existing tag, or removing it.
+	tags::delete_tag(tag);
+	tags::replace_tag_in_implications(tag, kind == tag_operation_kind::remove ? "" : new_tag);
+}
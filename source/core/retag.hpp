@@ -0,0 +1,73 @@
+#pragma once
+
+#include "search.hpp"
+
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <future>
+#include <atomic>
+#include <optional>
+
+// Mirroring renames every file so its name has the tags in its attribute, and doesn't change any tags.
+// Adding is only done to chosen files.
+enum class tag_operation_kind { rename, merge, remove, mirror, add };
+
+struct tag_operation {
+	tag_operation_kind kind{ tag_operation_kind::rename };
+	std::string tag; // not used when mirroring.
+	std::string new_tag; // the new name, or the tag to merge into. Not used when adding or removing.
+};
+
+// Returns the tags a file with these tags should have after the operation.
+std::vector<std::string> apply_tag_operation(const tag_operation& operation, std::vector<std::string> tags);
+
+// Renames every indexed file with the tag, spread over all cores. The caches and the registry are not changed until
+// all the files have been renamed, and are then updated in one go by finish(), so nothing sees a half finished operation.
+class bulk_retag {
+public:
+
+	struct failure {
+		std::filesystem::path path;
+		std::string message;
+	};
+
+	struct result {
+		// Every file whose tags were written. The new path is the same as the old if the tags are stored in an attribute.
+		std::vector<std::pair<std::filesystem::path, std::filesystem::path>> renamed_paths;
+		std::vector<failure> failures;
+	};
+
+	bulk_retag(const tag_operation& operation, search_path_cache_list& caches);
+
+	// Only writes these files, so the registry is never changed.
+	bulk_retag(const tag_operation& operation, std::vector<std::filesystem::path> paths, search_path_cache_list& caches);
+	bulk_retag(const bulk_retag&) = delete;
+	bulk_retag(bulk_retag&&) = delete;
+
+	bulk_retag& operator=(const bulk_retag&) = delete;
+	bulk_retag& operator=(bulk_retag&&) = delete;
+
+	const tag_operation& operation() const;
+	size_t files_done() const;
+	size_t file_count() const;
+	bool is_done() const;
+	void wait() const;
+
+	// Updates the caches and the registry. Returns the result the first time it's called after the renames are done.
+	// The registry is only changed if every file was written. A file is never replaced, so a name that is taken is a failure.
+	std::optional<result> finish();
+
+private:
+
+	result rename_files();
+	void update_registry();
+
+	tag_operation current_operation;
+	search_path_cache_list& caches;
+	std::vector<std::filesystem::path> paths;
+	bool changes_registry{ true };
+	std::atomic<size_t> done{ 0 };
+	std::future<result> future_result; // last, so the renames are done before the rest is destroyed.
+
+};
@@ -0,0 +1,208 @@
+#include "saved_search.hpp"
+#include "tags.hpp"
+#include "profiler.hpp"
+#include "io.hpp"
+#include "assets.hpp"
+#include "debug.hpp"
+
+static void write_strings(no::io_stream& stream, const std::vector<std::string>& strings) {
+	stream.write(static_cast<int32_t>(strings.size()));
+	for (const auto& string : strings) {
+		stream.write(string);
+	}
+}
+
+static std::vector<std::string> read_strings(no::io_stream& stream) {
+	std::vector<std::string> strings(static_cast<size_t>(stream.read<int32_t>()));
+	for (auto& string : strings) {
+		string = stream.read<std::string>();
+	}
+	return strings;
+}
+
+// The paths next to each other in the same directory are written with the directory once.
+static void write_paths(no::io_stream& stream, const std::vector<std::filesystem::path>& paths) {
+	std::vector<size_t> directory_starts;
+	for (size_t i{ 0 }; i < paths.size(); i++) {
+		if (i == 0 || paths[i].parent_path() != paths[i - 1].parent_path()) {
+			directory_starts.push_back(i);
+		}
+	}
+	stream.write(static_cast<int32_t>(directory_starts.size()));
+	for (size_t i{ 0 }; i < directory_starts.size(); i++) {
+		const size_t begin{ directory_starts[i] };
+		const size_t end{ i + 1 < directory_starts.size() ? directory_starts[i + 1] : paths.size() };
+		stream.write(paths[begin].parent_path().u8string());
+		stream.write(static_cast<int32_t>(end - begin));
+		for (size_t path_index{ begin }; path_index < end; path_index++) {
+			stream.write(paths[path_index].filename().u8string());
+		}
+	}
+}
+
+static std::vector<std::filesystem::path> read_paths(no::io_stream& stream) {
+	std::vector<std::filesystem::path> paths;
+	const auto directory_count = stream.read<int32_t>();
+	for (int32_t directory_index{ 0 }; directory_index < directory_count; directory_index++) {
+		const auto directory = std::filesystem::u8path(stream.read<std::string>());
+		const auto name_count = stream.read<int32_t>();
+		for (int32_t name_index{ 0 }; name_index < name_count; name_index++) {
+			paths.push_back(directory / std::filesystem::u8path(stream.read<std::string>()));
+		}
+	}
+	return paths;
+}
+
+// Nullopt if a cache is still being scanned. The views are read with the cache locks, so this is safe on any thread.
+static std::optional<std::vector<std::filesystem::path>> find_view_paths(const std::string& name, const std::vector<const search_path_cache*>& caches) {
+	std::vector<std::filesystem::path> paths;
+	for (const auto cache : caches) {
+		auto view_paths = cache->view_paths(name);
+		if (!view_paths) {
+			return std::nullopt;
+		}
+		std::move(view_paths->begin(), view_paths->end(), std::back_inserter(paths));
+	}
+	if (caches.size() > 1) {
+		// nested search directories have some of the same files.
+		std::sort(paths.begin(), paths.end());
+		paths.erase(std::unique(paths.begin(), paths.end()), paths.end());
+	}
+	return paths;
+}
+
+// The views can only be used once every directory has a cache.
+static std::vector<const search_path_cache*> scanned_caches(const search_path_cache_list& caches) {
+	std::vector<const search_path_cache*> scanned;
+	if (!caches.has_waiting_directories()) {
+		for (const auto& cache : caches.caches) {
+			scanned.push_back(cache.get());
+		}
+	}
+	return scanned;
+}
+
+void saved_search_list::load() {
+	load(no::asset_path("milky.searches"));
+}
+
+void saved_search_list::load(const std::filesystem::path& path) {
+	PROFILE_ZONE("load_saved_searches");
+	wait();
+	file_path = path;
+	saved_searches.clear();
+	no::io_stream stream;
+	no::file::read(file_path, stream);
+	if (stream.empty()) {
+		return;
+	}
+	const auto search_count = stream.read<int32_t>();
+	for (int32_t search_index{ 0 }; search_index < search_count; search_index++) {
+		auto& search = saved_searches.emplace_back();
+		search.name = stream.read<std::string>();
+		search.include_tags = read_strings(stream);
+		search.exclude_tags = read_strings(stream);
+		search.name_contains = stream.read<std::string>();
+		search.paths = std::make_shared<std::vector<std::filesystem::path>>(read_paths(stream));
+	}
+}
+
+void saved_search_list::save(const search_path_cache_list& caches) {
+	if (future_save.valid() && !no::is_future_ready(future_save)) {
+		must_save_again = true;
+		return;
+	}
+	must_save_again = false;
+	// the caches are never removed, and the saved results are shared, so the thread only gets copies of the queries.
+	future_save = std::async(std::launch::async, [path{ file_path }, searches{ saved_searches }, caches{ scanned_caches(caches) }] {
+		PROFILE_ZONE("save_saved_searches");
+		no::io_stream stream;
+		stream.write(static_cast<int32_t>(searches.size()));
+		for (const auto& search : searches) {
+			stream.write(search.name);
+			write_strings(stream, search.include_tags);
+			write_strings(stream, search.exclude_tags);
+			stream.write(search.name_contains);
+			const auto view_paths = caches.empty() ? std::nullopt : find_view_paths(search.name, caches);
+			write_paths(stream, view_paths ? view_paths.value() : *search.paths);
+		}
+		no::file::write(path, stream);
+	});
+}
+
+void saved_search_list::wait() {
+	if (future_save.valid()) {
+		future_save.wait();
+	}
+}
+
+void saved_search_list::add(saved_search search, search_path_cache_list& caches) {
+	remove(search.name, caches);
+	const auto query = make_query(search);
+	for (auto& cache : caches.caches) {
+		cache->add_view(search.name, query);
+	}
+	saved_searches.push_back(std::move(search));
+	save(caches);
+}
+
+void saved_search_list::remove(const std::string& name, search_path_cache_list& caches) {
+	for (auto& cache : caches.caches) {
+		cache->remove_view(name);
+	}
+	saved_searches.erase(std::remove_if(saved_searches.begin(), saved_searches.end(), [&name](const auto& search) {
+		return search.name == name;
+	}), saved_searches.end());
+}
+
+void saved_search_list::update(search_path_cache_list& caches) {
+	// the queries accept the tags implying the include tags, so the views are found again when the rules change.
+	const bool must_expand{ implications_version != tags::get_implications_version() };
+	implications_version = tags::get_implications_version();
+	for (const auto& search : saved_searches) {
+		std::optional<search_query> query;
+		for (auto& cache : caches.caches) {
+			if (must_expand || !cache->has_view(search.name)) {
+				if (!query) {
+					query = make_query(search);
+				}
+				cache->add_view(search.name, query.value());
+			}
+		}
+	}
+	if (must_save_again && no::is_future_ready(future_save)) {
+		save(caches);
+	}
+}
+
+std::vector<std::filesystem::path> saved_search_list::paths(const std::string& name, const search_path_cache_list& caches) {
+	const auto search = std::find_if(saved_searches.begin(), saved_searches.end(), [&name](const auto& search) {
+		return search.name == name;
+	});
+	if (search == saved_searches.end()) {
+		return {};
+	}
+	const auto searched_caches = scanned_caches(caches);
+	if (searched_caches.empty()) {
+		return *search->paths;
+	}
+	auto view_paths = find_view_paths(name, searched_caches);
+	if (!view_paths) {
+		return *search->paths; // still scanning.
+	}
+	search->paths = std::make_shared<std::vector<std::filesystem::path>>(view_paths.value());
+	return std::move(view_paths.value());
+}
+
+const std::vector<saved_search>& saved_search_list::searches() const {
+	return saved_searches;
+}
+
+search_query saved_search_list::make_query(const saved_search& search) {
+	search_query query;
+	query.include_tags = search.include_tags;
+	query.exclude_tags = search.exclude_tags;
+	query.name_contains = search.name_contains;
+	query.expand_implications();
+	return query;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "search.hpp"
+
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <memory>
+#include <future>
+
+struct saved_search {
+	std::string name;
+	std::vector<std::string> include_tags;
+	std::vector<std::string> exclude_tags;
+	std::string name_contains;
+	// the result when it was saved. used until the caches are scanned. shared with the thread that saves it.
+	std::shared_ptr<const std::vector<std::filesystem::path>> paths{ std::make_shared<std::vector<std::filesystem::path>>() };
+};
+
+// Saved searches are kept as views in the search caches, so they are never searched again after the scan.
+// They are saved next to milky.tags with their results, so they can be opened before the caches are scanned.
+// The results are written one directory at a time on a background thread.
+class saved_search_list {
+public:
+
+	saved_search_list() = default;
+	saved_search_list(const saved_search_list&) = delete;
+	saved_search_list(saved_search_list&&) = delete;
+
+	saved_search_list& operator=(const saved_search_list&) = delete;
+	saved_search_list& operator=(saved_search_list&&) = delete;
+
+	void load();
+	void load(const std::filesystem::path& path);
+
+	// If a save is running, the searches are saved again by update once it's done.
+	void save(const search_path_cache_list& caches);
+	void wait();
+
+	// Replaces the saved search with the same name.
+	void add(saved_search search, search_path_cache_list& caches);
+	void remove(const std::string& name, search_path_cache_list& caches);
+
+	// Adds the views to caches that were added since last time, and adds them all again if the implication rules changed.
+	void update(search_path_cache_list& caches);
+
+	// The current result, or the saved result if the caches are still being scanned.
+	std::vector<std::filesystem::path> paths(const std::string& name, const search_path_cache_list& caches);
+
+	const std::vector<saved_search>& searches() const;
+
+private:
+
+	static search_query make_query(const saved_search& search);
+
+	std::filesystem::path file_path;
+	std::vector<saved_search> saved_searches;
+	uint64_t implications_version{ 0 }; // the version of the rules the views were expanded with.
+	bool must_save_again{ false };
+	std::future<void> future_save; // last, so the file is written before the rest is destroyed.
+
+};
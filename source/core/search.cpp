@@ -0,0 +1,953 @@
+#include "search.hpp"
+#include "tags.hpp"
+#include "parallel.hpp"
+#include "profiler.hpp"
+#include "filesystem.hpp"
+#include "io.hpp"
+#include "timer.hpp"
+#include "debug.hpp"
+
+void search_query::expand_implications() {
+	accepted_include_tags.clear();
+	for (const auto& tag : include_tags) {
+		accepted_include_tags.push_back(tags::get_implying_tags(tag));
+	}
+}
+
+// The files with the exclude tags. The tags are always read from the index, since they may be stored outside the name.
+static std::vector<const id_bitmap*> find_excluded_ids(const tag_index& index, const search_query& query) {
+	std::vector<const id_bitmap*> excluded_ids;
+	for (const auto& tag : query.exclude_tags) {
+		if (const auto ids = index.find(tag)) {
+			excluded_ids.push_back(ids);
+		}
+	}
+	return excluded_ids;
+}
+
+// The include tags are found with the tag index, so only the name and exclude tags are checked for each path.
+static bool matches_query(const std::filesystem::path& path, uint32_t id, const std::string& folded_name, const std::vector<const id_bitmap*>& excluded_ids) {
+	if (path.empty()) {
+		return false; // removed from the cache.
+	}
+	if (!folded_name.empty()) {
+		const auto name = name_index::fold(tags::filename_without_tags(path.filename().u8string()));
+		if (name.find(folded_name) == std::string::npos) {
+			return false;
+		}
+	}
+	return std::none_of(excluded_ids.begin(), excluded_ids.end(), [id](const auto ids) {
+		return ids->test(id);
+	});
+}
+
+// Returns the sorted ids of the paths with every include tag, or a tag accepted in its place.
+static std::vector<uint32_t> ids_with_include_tags(const tag_index& index, const search_query& query) {
+	id_bitmap matching;
+	for (size_t i{ 0 }; i < query.include_tags.size(); i++) {
+		id_bitmap with_tag;
+		if (i < query.accepted_include_tags.size() && !query.accepted_include_tags[i].empty()) {
+			for (const auto& tag : query.accepted_include_tags[i]) {
+				if (const auto ids = index.find(tag)) {
+					with_tag.unite(*ids);
+				}
+			}
+		} else if (const auto ids = index.find(query.include_tags[i])) {
+			with_tag = *ids;
+		}
+		if (i == 0) {
+			matching = std::move(with_tag);
+		} else {
+			matching.intersect(with_tag);
+		}
+	}
+	return matching.ids();
+}
+
+// Same as matches_query, but also checks the include tags, for when a single path is changed. The cache must be locked.
+static bool matches_every_tag(const search_path_cache& cache, uint32_t id, const search_query& query, const std::string& folded_name) {
+	const auto& index = cache.tag_ids();
+	if (!matches_query(cache.paths()[id], id, folded_name, find_excluded_ids(index, query))) {
+		return false;
+	}
+	auto has_tag = [&index, id](const auto& tag) {
+		const auto ids = index.find(tag);
+		return ids && ids->test(id);
+	};
+	for (size_t i{ 0 }; i < query.include_tags.size(); i++) {
+		if (i < query.accepted_include_tags.size() && !query.accepted_include_tags[i].empty()) {
+			if (!std::any_of(query.accepted_include_tags[i].begin(), query.accepted_include_tags[i].end(), has_tag)) {
+				return false;
+			}
+		} else if (!has_tag(query.include_tags[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// The ids that may match the query, found with the name and tag indices. Nullopt if every path must be checked.
+// The cache must be locked.
+static std::optional<std::vector<uint32_t>> find_candidate_ids(const name_index& names, const tag_index& tag_ids, const search_query& query, const std::string& folded_name) {
+	std::optional<std::vector<uint32_t>> ids;
+	if (!folded_name.empty()) {
+		ids = names.candidates(folded_name);
+	}
+	if (!query.include_tags.empty()) {
+		auto tagged_ids = ids_with_include_tags(tag_ids, query);
+		if (ids) {
+			std::vector<uint32_t> intersection;
+			std::set_intersection(ids->begin(), ids->end(), tagged_ids.begin(), tagged_ids.end(), std::back_inserter(intersection));
+			ids = std::move(intersection);
+		} else {
+			ids = std::move(tagged_ids);
+		}
+	}
+	return ids;
+}
+
+// Counts the ids with each tag in the tag indices, only counting the ids in the filter of the cache if it's set.
+// The caches must be locked.
+static std::unordered_map<std::string, size_t> count_tags(const std::vector<const search_path_cache*>& caches, const std::vector<const id_bitmap*>& filters) {
+	struct tag_bitmap {
+		const std::string* name{ nullptr };
+		const id_bitmap* ids{ nullptr };
+		const id_bitmap* filter{ nullptr };
+		size_t count{ 0 };
+	};
+	std::vector<std::vector<std::string>> cache_tags;
+	std::vector<tag_bitmap> bitmaps;
+	for (const auto cache : caches) {
+		cache_tags.push_back(cache->tag_ids().all_tags());
+	}
+	for (size_t cache_index{ 0 }; cache_index < caches.size(); cache_index++) {
+		for (const auto& tag : cache_tags[cache_index]) {
+			bitmaps.push_back({ &tag, caches[cache_index]->tag_ids().find(tag), filters[cache_index] });
+		}
+	}
+	parallel_for(bitmaps.size(), [&](size_t index) {
+		auto& bitmap = bitmaps[index];
+		bitmap.count = bitmap.filter ? bitmap.ids->count_intersection(*bitmap.filter) : bitmap.ids->count();
+	});
+	std::unordered_map<std::string, size_t> counts;
+	for (const auto& bitmap : bitmaps) {
+		if (bitmap.count > 0) {
+			counts[*bitmap.name] += bitmap.count;
+		}
+	}
+	return counts;
+}
+
+std::optional<search_result> run_search(const search_query& query, const std::function<bool()>& is_cancelled) {
+	PROFILE_ZONE("search");
+	constexpr size_t paths_per_chunk{ 16384 };
+	struct search_chunk {
+		const std::vector<std::filesystem::path>* source{ nullptr };
+		const std::vector<uint32_t>* ids{ nullptr }; // if set, the range is in this list instead of the source.
+		const std::vector<const id_bitmap*>* excluded_ids{ nullptr };
+		size_t cache_index{ 0 };
+		size_t begin{ 0 };
+		size_t end{ 0 };
+		std::vector<std::filesystem::path> paths;
+		std::vector<uint32_t> path_ids; // only kept when counting facets.
+	};
+	no::timer filter_timer;
+	filter_timer.start();
+	const auto folded_name = name_index::fold(query.name_contains);
+	std::vector<std::shared_lock<std::shared_mutex>> locks;
+	std::vector<std::optional<std::vector<uint32_t>>> candidate_ids(query.caches.size());
+	std::vector<std::vector<const id_bitmap*>> excluded_ids(query.caches.size());
+	std::vector<search_chunk> chunks;
+	search_result result;
+	result.generation = query.generation;
+	for (size_t cache_index{ 0 }; cache_index < query.caches.size(); cache_index++) {
+		const auto cache = query.caches[cache_index];
+		locks.push_back(cache->lock());
+		const auto& paths = cache->paths();
+		auto& ids = candidate_ids[cache_index];
+		ids = find_candidate_ids(cache->names(), cache->tag_ids(), query, folded_name);
+		excluded_ids[cache_index] = find_excluded_ids(cache->tag_ids(), query);
+		const size_t count{ ids ? ids->size() : paths.size() };
+		for (size_t begin{ 0 }; begin < count; begin += paths_per_chunk) {
+			auto& chunk = chunks.emplace_back();
+			chunk.source = &paths;
+			chunk.ids = ids ? &ids.value() : nullptr;
+			chunk.excluded_ids = &excluded_ids[cache_index];
+			chunk.cache_index = cache_index;
+			chunk.begin = begin;
+			chunk.end = std::min(begin + paths_per_chunk, count);
+		}
+		result.paths_searched += count;
+	}
+	parallel_for(chunks.size(), [&](size_t chunk_index) {
+		auto& chunk = chunks[chunk_index];
+		if (is_cancelled && is_cancelled()) {
+			return;
+		}
+		for (size_t i{ chunk.begin }; i < chunk.end; i++) {
+			const uint32_t id{ chunk.ids ? (*chunk.ids)[i] : static_cast<uint32_t>(i) };
+			const auto& path = (*chunk.source)[id];
+			if (matches_query(path, id, folded_name, *chunk.excluded_ids)) {
+				chunk.paths.emplace_back(path);
+				if (query.count_facets) {
+					chunk.path_ids.push_back(id);
+				}
+			}
+		}
+	});
+	if (is_cancelled && is_cancelled()) {
+		return std::nullopt;
+	}
+	// the chunks are merged in the order they were created, so the result is the same regardless of thread timing.
+	size_t total_paths{ 0 };
+	for (const auto& chunk : chunks) {
+		total_paths += chunk.paths.size();
+	}
+	result.paths.reserve(total_paths);
+	for (auto& chunk : chunks) {
+		std::move(chunk.paths.begin(), chunk.paths.end(), std::back_inserter(result.paths));
+	}
+	if (query.count_facets) {
+		// the facets are the popcounts of every tag bitmap intersected with the bitmap of the results.
+		std::vector<id_bitmap> found_ids(query.caches.size());
+		for (const auto& chunk : chunks) {
+			for (const auto id : chunk.path_ids) {
+				found_ids[chunk.cache_index].set(id);
+			}
+		}
+		std::vector<const id_bitmap*> filters;
+		for (const auto& ids : found_ids) {
+			filters.push_back(&ids);
+		}
+		for (const auto& [tag, count] : count_tags(query.caches, filters)) {
+			result.facets.push_back({ tag, count });
+		}
+		std::sort(result.facets.begin(), result.facets.end(), [](const auto& a, const auto& b) {
+			return a.count != b.count ? a.count > b.count : a.tag < b.tag;
+		});
+	}
+	result.milliseconds = filter_timer.milliseconds();
+	result.thread_count = std::min(worker_thread_count(), static_cast<int>(chunks.size()));
+	return result;
+}
+
+std::vector<discovered_tag> discover_tags(const std::vector<const search_path_cache*>& caches) {
+	PROFILE_ZONE("discover_tags");
+	std::vector<std::shared_lock<std::shared_mutex>> locks;
+	for (const auto cache : caches) {
+		locks.push_back(cache->lock());
+	}
+	std::vector<discovered_tag> discovered;
+	if (caches.size() < 2) {
+		for (const auto& [name, count] : count_tags(caches, std::vector<const id_bitmap*>(caches.size()))) {
+			discovered.push_back({ name, count });
+		}
+	} else {
+		// nested search directories have some of the same files, so the paths are counted instead of the ids.
+		std::unordered_map<std::string, std::vector<const std::filesystem::path*>> tag_paths;
+		for (const auto cache : caches) {
+			const auto& paths = cache->paths();
+			for (const auto& tag : cache->tag_ids().all_tags()) {
+				auto& tagged_paths = tag_paths[tag];
+				for (const auto id : cache->tag_ids().find(tag)->ids()) {
+					tagged_paths.push_back(&paths[id]);
+				}
+			}
+		}
+		for (const auto& [name, paths] : tag_paths) {
+			discovered.push_back({ name, 0 });
+		}
+		parallel_for(discovered.size(), [&](size_t index) {
+			auto& paths = tag_paths.find(discovered[index].name)->second;
+			std::sort(paths.begin(), paths.end(), [](const auto a, const auto b) {
+				return *a < *b;
+			});
+			discovered[index].file_count = static_cast<size_t>(std::unique(paths.begin(), paths.end(), [](const auto a, const auto b) {
+				return *a == *b;
+			}) - paths.begin());
+		});
+	}
+	std::sort(discovered.begin(), discovered.end(), [](const auto& a, const auto& b) {
+		return a.file_count != b.file_count ? a.file_count > b.file_count : a.name < b.name;
+	});
+	return discovered;
+}
+
+void mark_registered_tags(std::vector<discovered_tag>& tags) {
+	for (auto& tag : tags) {
+		tag.is_registered = tags::find_tag(tag.name).has_value();
+	}
+}
+
+search_executor::search_executor() {
+	thread = std::thread{ &search_executor::run, this };
+}
+
+search_executor::~search_executor() {
+	{
+		std::lock_guard lock{ mutex };
+		stopping = true;
+		latest_generation++; // cancels the query being executed.
+	}
+	condition.notify_one();
+	thread.join();
+}
+
+uint64_t search_executor::submit(search_query query) {
+	std::lock_guard lock{ mutex };
+	query.generation = ++latest_generation;
+	pending_query = std::move(query);
+	finished_result.reset();
+	condition.notify_one();
+	return latest_generation;
+}
+
+std::optional<search_result> search_executor::poll() {
+	std::lock_guard lock{ mutex };
+	auto result = std::move(finished_result);
+	finished_result.reset();
+	return result;
+}
+
+bool search_executor::is_busy() const {
+	std::lock_guard lock{ mutex };
+	return busy || pending_query.has_value();
+}
+
+void search_executor::run() {
+	while (true) {
+		search_query query;
+		{
+			std::unique_lock lock{ mutex };
+			condition.wait(lock, [this] {
+				return stopping || pending_query.has_value();
+			});
+			if (stopping) {
+				return;
+			}
+			query = std::move(pending_query.value());
+			pending_query.reset();
+			busy = true;
+		}
+		auto result = run_search(query, [this, generation{ query.generation }] {
+			return is_stale(generation);
+		});
+		std::lock_guard lock{ mutex };
+		busy = false;
+		if (result.has_value() && !is_stale(query.generation)) {
+			finished_result = std::move(result);
+		}
+	}
+}
+
+bool search_executor::is_stale(uint64_t generation) const {
+	return generation != latest_generation;
+}
+
+search_path_cache::search_path_cache(const std::filesystem::path& path) : search_path{ path } {
+	change_thread = std::thread{ &search_path_cache::apply_changes, this };
+	// might take a few seconds.
+	future_scan = std::async(std::launch::async, scan, path, excluded_search_paths, max_reads);
+}
+
+search_path_cache::search_path_cache(const std::filesystem::path& path, std::vector<std::filesystem::path> paths) : search_path{ path }, is_listed{ true } {
+	change_thread = std::thread{ &search_path_cache::apply_changes, this };
+	future_scan = std::async(std::launch::async, index_paths, std::move(paths), max_reads);
+}
+
+search_path_cache::search_path_cache(const std::filesystem::path& path, excluding excluded, int max_reads)
+	: search_path{ path }, excluded_search_paths{ std::move(excluded.directories) }, max_reads{ std::max(max_reads, 1) } {
+	change_thread = std::thread{ &search_path_cache::apply_changes, this };
+	future_scan = std::async(std::launch::async, scan, path, excluded_search_paths, this->max_reads);
+}
+
+search_path_cache::~search_path_cache() {
+	{
+		std::lock_guard lock{ changes_mutex };
+		stopping = true;
+	}
+	changes_condition.notify_all();
+	change_thread.join();
+}
+
+// Without a trailing separator, so the paths can be compared one part at a time.
+static std::filesystem::path normal_directory(const std::filesystem::path& path) {
+	auto normal = path.lexically_normal();
+	if (!normal.has_filename() && normal.has_relative_path()) {
+		normal = normal.parent_path();
+	}
+	return normal;
+}
+
+static bool is_same_or_inside(const std::filesystem::path& path, const std::filesystem::path& directory) {
+	return std::mismatch(directory.begin(), directory.end(), path.begin(), path.end()).first == directory.end();
+}
+
+// Lists everything below the directory except what's in the excluded directories. Only the directories leading to
+// an excluded directory are listed one level at a time, and the rest are listed recursively by the backend.
+static std::vector<std::filesystem::path> enumerate_except(const std::filesystem::path& directory, const std::vector<std::filesystem::path>& excluded_directories, int max_reads) {
+	const auto normal = normal_directory(directory);
+	const bool leads_to_excluded{ std::any_of(excluded_directories.begin(), excluded_directories.end(), [&normal](const auto& excluded) {
+		return is_same_or_inside(excluded, normal);
+	}) };
+	if (!leads_to_excluded) {
+		return fs::enumerate(directory, true);
+	}
+	auto entries = fs::enumerate(directory, false);
+	const auto statuses = fs::stat_many(entries, static_cast<size_t>(max_reads));
+	std::vector<std::filesystem::path> paths;
+	for (size_t i{ 0 }; i < entries.size(); i++) {
+		const bool is_excluded{ std::find(excluded_directories.begin(), excluded_directories.end(), normal_directory(entries[i])) != excluded_directories.end() };
+		if (statuses[i].type == fs::file_type::directory && !is_excluded) {
+			auto inside = enumerate_except(entries[i], excluded_directories, max_reads);
+			std::move(inside.begin(), inside.end(), std::back_inserter(paths));
+		}
+		paths.push_back(std::move(entries[i])); // the excluded directory itself is still found here.
+	}
+	return paths;
+}
+
+search_path_cache::scan_result search_path_cache::scan(const std::filesystem::path& path, const std::vector<std::filesystem::path>& excluded_directories, int max_reads) {
+	PROFILE_ZONE("scan");
+	std::vector<std::filesystem::path> normal_excluded_directories;
+	for (const auto& excluded : excluded_directories) {
+		normal_excluded_directories.push_back(normal_directory(excluded));
+	}
+	// the paths aren't stat'ed here. only the results that are sorted need it, and they are stat'ed in batches then.
+	return index_paths(enumerate_except(path, normal_excluded_directories, max_reads), max_reads);
+}
+
+search_path_cache::scan_result search_path_cache::index_paths(std::vector<std::filesystem::path> paths, int max_reads) {
+	PROFILE_ZONE("index_paths");
+	constexpr size_t paths_per_batch{ 4096 };
+	scan_result result;
+	result.paths = std::move(paths);
+	// the tags may be in extended attributes, which are read one file at a time, so they are read on as many cores as
+	// the device is allowed to have reads in flight.
+	std::vector<std::vector<std::string>> path_tags(result.paths.size());
+	parallel_for((result.paths.size() + paths_per_batch - 1) / paths_per_batch, std::min(max_reads, worker_thread_count()), [&](size_t batch) {
+		const size_t end{ std::min((batch + 1) * paths_per_batch, result.paths.size()) };
+		for (size_t id{ batch * paths_per_batch }; id < end; id++) {
+			path_tags[id] = tags::read_tags(result.paths[id]);
+		}
+	});
+	for (size_t id{ 0 }; id < result.paths.size(); id++) {
+		result.names.add(static_cast<uint32_t>(id), tags::filename_without_tags(result.paths[id].filename().u8string()));
+		result.tag_ids.add(static_cast<uint32_t>(id), path_tags[id]);
+	}
+	return result;
+}
+
+const std::filesystem::path& search_path_cache::directory() const {
+	return search_path;
+}
+
+void search_path_cache::wait() {
+	if (future_scan.valid()) {
+		future_scan.wait();
+		update();
+	}
+	{
+		std::unique_lock lock{ changes_mutex };
+		changes_condition.wait(lock, [this] {
+			return pending_changes.empty() && !applying_change;
+		});
+	}
+	update();
+}
+
+void search_path_cache::wait_for_scan() const {
+	if (future_scan.valid()) {
+		future_scan.wait();
+	}
+}
+
+void search_path_cache::rescan() {
+	if (future_scan.valid()) {
+		must_rescan = true; // the running scan may have read the tags before they were moved.
+		return;
+	}
+	start_scan();
+}
+
+void search_path_cache::start_scan() {
+	if (!is_listed) {
+		future_scan = std::async(std::launch::async, scan, search_path, excluded_search_paths, max_reads);
+		return;
+	}
+	std::vector<std::filesystem::path> paths;
+	{
+		std::shared_lock lock{ mutex };
+		std::copy_if(cached_paths.begin(), cached_paths.end(), std::back_inserter(paths), [](const auto& path) {
+			return !path.empty();
+		});
+	}
+	future_scan = std::async(std::launch::async, index_paths, std::move(paths), max_reads);
+}
+
+bool search_path_cache::update() {
+	if (no::is_future_ready(future_scan)) {
+		// the result is moved into the change, and std::function has to be copyable.
+		auto result = std::make_shared<scan_result>(future_scan.get());
+		post_change([this, result] {
+			merge_scan(std::move(*result));
+		});
+	}
+	if (must_rescan && !future_scan.valid()) {
+		must_rescan = false;
+		start_scan();
+	}
+	std::vector<std::pair<std::string, int64_t>> usage;
+	bool merged{ false };
+	{
+		std::lock_guard lock{ changes_mutex };
+		usage.swap(pending_usage);
+		merged = std::exchange(has_merged_scan, false);
+	}
+	for (const auto& [tag, count] : usage) {
+		tags::add_usage(tag, count);
+	}
+	return merged;
+}
+
+void search_path_cache::post_change(std::function<void()> change) {
+	{
+		std::lock_guard lock{ changes_mutex };
+		pending_changes.push_back(std::move(change));
+	}
+	changes_condition.notify_all();
+}
+
+void search_path_cache::apply_changes() {
+	while (true) {
+		std::function<void()> change;
+		{
+			std::unique_lock lock{ changes_mutex };
+			changes_condition.wait(lock, [this] {
+				return stopping || !pending_changes.empty();
+			});
+			if (stopping) {
+				return;
+			}
+			change = std::move(pending_changes.front());
+			pending_changes.pop_front();
+			applying_change = true;
+		}
+		try {
+			change();
+		} catch (const std::exception& exception) {
+			WARNING("Failed to update the cache of " << search_path << ": " << exception.what());
+		}
+		{
+			std::lock_guard lock{ changes_mutex };
+			applying_change = false;
+		}
+		changes_condition.notify_all();
+	}
+}
+
+void search_path_cache::merge_scan(scan_result result) {
+	PROFILE_ZONE("merge_scan");
+	{
+		// the paths of an earlier scan are replaced, so their usage is taken away again.
+		std::lock_guard lock{ changes_mutex };
+		for (const auto& tag : cached_tag_ids.all_tags()) {
+			pending_usage.emplace_back(tag, -static_cast<int64_t>(cached_tag_ids.find(tag)->count()));
+		}
+		for (const auto& tag : result.tag_ids.all_tags()) {
+			pending_usage.emplace_back(tag, static_cast<int64_t>(result.tag_ids.find(tag)->count()));
+		}
+	}
+	// the views are found in the result before locking, so the searches aren't held up meanwhile.
+	std::vector<id_bitmap> view_ids;
+	for (const auto& view : views) {
+		view_ids.push_back(find_view_ids(view, result.paths, result.names, result.tag_ids));
+	}
+	std::unique_lock lock{ mutex };
+	cached_paths = std::move(result.paths);
+	cached_names = std::move(result.names);
+	cached_tag_ids = std::move(result.tag_ids);
+	is_scanned = true;
+	for (size_t i{ 0 }; i < views.size(); i++) {
+		views[i].ids = std::move(view_ids[i]);
+	}
+	change_count++;
+	change_log.clear(); // every id may have changed.
+	change_log_start = change_count;
+	lock.unlock();
+	std::lock_guard changes_lock{ changes_mutex };
+	has_merged_scan = true;
+}
+
+void search_path_cache::log_change(uint32_t id) {
+	constexpr size_t max_logged_changes{ 1 << 20 };
+	change_count++;
+	change_log.emplace_back(change_count, id);
+	if (change_log.size() > max_logged_changes) {
+		change_log_start = change_log.front().first;
+		change_log.pop_front();
+	}
+}
+
+std::optional<std::vector<uint32_t>> search_path_cache::changed_ids_since(uint64_t version) const {
+	if (version < change_log_start || version > change_count) {
+		return std::nullopt;
+	}
+	std::vector<uint32_t> ids;
+	for (auto change = change_log.rbegin(); change != change_log.rend() && change->first > version; change++) {
+		ids.push_back(change->second);
+	}
+	std::sort(ids.begin(), ids.end());
+	ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+	return ids;
+}
+
+std::future<void> search_path_cache::post_read(std::function<void()> read) {
+	// std::function has to be copyable, so the task is shared.
+	auto task = std::make_shared<std::packaged_task<void()>>(std::move(read));
+	auto future = task->get_future();
+	post_change([task] {
+		(*task)();
+	});
+	return future;
+}
+
+void search_path_cache::queue_usage(const std::vector<std::string>& tags, int64_t count) {
+	std::lock_guard lock{ changes_mutex };
+	for (const auto& tag : tags) {
+		pending_usage.emplace_back(tag, count);
+	}
+}
+
+bool search_path_cache::is_scanning() const {
+	return future_scan.valid() && !no::is_future_ready(future_scan);
+}
+
+bool search_path_cache::is_waiting_for_update() const {
+	if (no::is_future_ready(future_scan)) {
+		return true;
+	}
+	std::lock_guard lock{ changes_mutex };
+	return has_merged_scan || !pending_usage.empty();
+}
+
+const std::vector<std::filesystem::path>& search_path_cache::excluded_directories() const {
+	return excluded_search_paths;
+}
+
+uint64_t search_path_cache::version() const {
+	return change_count;
+}
+
+std::shared_lock<std::shared_mutex> search_path_cache::lock() const {
+	return std::shared_lock{ mutex };
+}
+
+const std::vector<std::filesystem::path>& search_path_cache::paths() const {
+	return cached_paths;
+}
+
+const name_index& search_path_cache::names() const {
+	return cached_names;
+}
+
+const tag_index& search_path_cache::tag_ids() const {
+	return cached_tag_ids;
+}
+
+void search_path_cache::add_path(const std::filesystem::path& path) {
+	post_change([this, path] {
+		const auto tags = tags::read_tags(path);
+		std::unique_lock lock{ mutex };
+		const auto id = static_cast<uint32_t>(cached_paths.size());
+		cached_paths.push_back(path);
+		cached_names.add(id, tags::filename_without_tags(path.filename().u8string()));
+		cached_tag_ids.add(id, tags);
+		update_views(id);
+		log_change(id);
+	});
+}
+
+void search_path_cache::remove_path(const std::filesystem::path& path) {
+	post_change([this, path] {
+		std::unique_lock lock{ mutex };
+		if (const auto id = find_path_id(path)) {
+			cached_tag_ids.remove(id.value(), cached_tag_ids.tags_of(id.value()));
+			cached_names.remove(id.value(), tags::filename_without_tags(cached_paths[id.value()].filename().u8string()));
+			cached_paths[id.value()].clear();
+			update_views(id.value());
+			log_change(id.value());
+		}
+	});
+}
+
+void search_path_cache::rename_path(const std::filesystem::path& from, const std::filesystem::path& to) {
+	post_change([this, from, to] {
+		const auto new_tags = tags::read_tags(to);
+		std::unique_lock lock{ mutex };
+		rename_path_locked(from, to, new_tags);
+	});
+}
+
+void search_path_cache::rename_paths(const std::vector<std::pair<std::filesystem::path, std::filesystem::path>>& renames) {
+	post_change([this, renames] {
+		// the tags may have to be read from the files, so that is done before locking.
+		std::vector<std::vector<std::string>> new_tags(renames.size());
+		for (size_t i{ 0 }; i < renames.size(); i++) {
+			new_tags[i] = tags::read_tags(renames[i].second);
+		}
+		std::unique_lock lock{ mutex };
+		for (size_t i{ 0 }; i < renames.size(); i++) {
+			rename_path_locked(renames[i].first, renames[i].second, new_tags[i]);
+		}
+	});
+}
+
+void search_path_cache::rename_path_locked(const std::filesystem::path& from, const std::filesystem::path& to, const std::vector<std::string>& new_tags) {
+	const auto id = find_path_id(from);
+	if (!id) {
+		return;
+	}
+	const auto old_name = tags::filename_without_tags(from.filename().u8string());
+	const auto new_name = tags::filename_without_tags(to.filename().u8string());
+	const auto old_tags = cached_tag_ids.tags_of(id.value());
+	queue_usage(old_tags, -1);
+	queue_usage(new_tags, 1);
+	cached_tag_ids.remove(id.value(), old_tags);
+	cached_tag_ids.add(id.value(), new_tags);
+	cached_paths[id.value()] = to;
+	if (old_name != new_name) {
+		cached_names.rename(id.value(), old_name, new_name);
+	}
+	update_views(id.value());
+	log_change(id.value());
+}
+
+void search_path_cache::add_view(const std::string& name, const search_query& query) {
+	{
+		std::lock_guard lock{ changes_mutex };
+		if (std::find(view_names.begin(), view_names.end(), name) == view_names.end()) {
+			view_names.push_back(name);
+		}
+	}
+	view new_view{ name, query, name_index::fold(query.name_contains) };
+	new_view.query.caches.clear();
+	post_change([this, new_view{ std::move(new_view) }]() mutable {
+		if (is_scanned) {
+			new_view.ids = find_view_ids(new_view, cached_paths, cached_names, cached_tag_ids); // searches can go on meanwhile.
+		}
+		std::unique_lock lock{ mutex };
+		views.erase(std::remove_if(views.begin(), views.end(), [&new_view](const auto& view) {
+			return view.name == new_view.name;
+		}), views.end());
+		views.push_back(std::move(new_view));
+	});
+}
+
+void search_path_cache::remove_view(const std::string& name) {
+	{
+		std::lock_guard lock{ changes_mutex };
+		view_names.erase(std::remove(view_names.begin(), view_names.end(), name), view_names.end());
+	}
+	post_change([this, name] {
+		std::unique_lock lock{ mutex };
+		views.erase(std::remove_if(views.begin(), views.end(), [&name](const auto& view) {
+			return view.name == name;
+		}), views.end());
+	});
+}
+
+bool search_path_cache::has_view(const std::string& name) const {
+	std::lock_guard lock{ changes_mutex };
+	return std::find(view_names.begin(), view_names.end(), name) != view_names.end();
+}
+
+std::optional<std::vector<std::filesystem::path>> search_path_cache::view_paths(const std::string& name) const {
+	std::shared_lock lock{ mutex };
+	if (!is_scanned) {
+		return std::nullopt;
+	}
+	for (const auto& view : views) {
+		if (view.name == name) {
+			std::vector<std::filesystem::path> paths;
+			for (const auto id : view.ids.ids()) {
+				paths.push_back(cached_paths[id]);
+			}
+			return paths;
+		}
+	}
+	return std::nullopt;
+}
+
+id_bitmap search_path_cache::find_view_ids(const view& view, const std::vector<std::filesystem::path>& paths, const name_index& names, const tag_index& tag_ids) {
+	PROFILE_ZONE("find_view_ids");
+	constexpr size_t paths_per_chunk{ 16384 };
+	const auto candidate_ids = find_candidate_ids(names, tag_ids, view.query, view.folded_name);
+	const auto excluded_ids = find_excluded_ids(tag_ids, view.query);
+	const size_t count{ candidate_ids ? candidate_ids->size() : paths.size() };
+	std::vector<std::vector<uint32_t>> matching_ids((count + paths_per_chunk - 1) / paths_per_chunk);
+	parallel_for(matching_ids.size(), [&](size_t chunk) {
+		const size_t end{ std::min((chunk + 1) * paths_per_chunk, count) };
+		for (size_t i{ chunk * paths_per_chunk }; i < end; i++) {
+			const uint32_t id{ candidate_ids ? (*candidate_ids)[i] : static_cast<uint32_t>(i) };
+			if (matches_query(paths[id], id, view.folded_name, excluded_ids)) {
+				matching_ids[chunk].push_back(id);
+			}
+		}
+	});
+	id_bitmap view_ids;
+	for (const auto& ids : matching_ids) {
+		for (const auto id : ids) {
+			view_ids.set(id);
+		}
+	}
+	return view_ids;
+}
+
+void search_path_cache::update_views(uint32_t id) {
+	for (auto& view : views) {
+		if (matches_every_tag(*this, id, view.query, view.folded_name)) {
+			view.ids.set(id);
+		} else {
+			view.ids.reset(id);
+		}
+	}
+}
+
+std::optional<uint32_t> search_path_cache::find_path_id(const std::filesystem::path& path) const {
+	// tagging only changes the tag part of the name, so the name index narrows this down to a few paths.
+	const auto name = tags::filename_without_tags(path.filename().u8string());
+	if (const auto ids = cached_names.candidates(name)) {
+		for (const auto id : ids.value()) {
+			if (cached_paths[id] == path) {
+				return id;
+			}
+		}
+		return std::nullopt;
+	}
+	if (const auto found = std::find(cached_paths.begin(), cached_paths.end(), path); found != cached_paths.end()) {
+		return static_cast<uint32_t>(found - cached_paths.begin());
+	}
+	return std::nullopt;
+}
+
+static std::filesystem::path canonical_directory(const std::filesystem::path& path) {
+	std::error_code error;
+	if (auto canonical = std::filesystem::weakly_canonical(path, error); !error) {
+		return normal_directory(canonical);
+	}
+	return normal_directory(std::filesystem::absolute(path, error));
+}
+
+void search_path_cache_list::add_search_directory(const std::filesystem::path& directory) {
+	search_directory added{ directory, canonical_directory(directory), fs::device(directory) };
+	for (const auto& existing : search_directories) {
+		if (is_same_or_inside(added.canonical_path, existing.canonical_path) || fs::equivalent(existing.path, directory)) {
+			return; // already scanned with the other directory.
+		}
+	}
+	// the directories inside that are still waiting are scanned with this one instead.
+	search_directories.erase(std::remove_if(search_directories.begin(), search_directories.end(), [&added](const auto& existing) {
+		return !existing.cache && is_same_or_inside(existing.canonical_path, added.canonical_path);
+	}), search_directories.end());
+	search_directories.push_back(std::move(added));
+	start_scans();
+}
+
+void search_path_cache_list::start_scans() {
+	for (auto& directory : search_directories) {
+		if (directory.cache) {
+			continue;
+		}
+		const auto max_scans = directory.device.is_rotational ? max_scans_per_rotational_device : max_scans_per_device;
+		const auto scans = std::count_if(search_directories.begin(), search_directories.end(), [&directory](const auto& other) {
+			return other.cache && other.cache->is_scanning() && other.device.id == directory.device.id;
+		});
+		if (scans >= std::max(max_scans, 1)) {
+			continue;
+		}
+		// the directories inside that have been started already keep their own caches.
+		search_path_cache::excluding excluded;
+		for (const auto& other : search_directories) {
+			if (other.cache && is_same_or_inside(other.canonical_path, directory.canonical_path)) {
+				excluded.directories.push_back(directory.path / other.canonical_path.lexically_relative(directory.canonical_path));
+			}
+		}
+		const auto max_reads = directory.device.is_rotational ? max_reads_per_rotational_device : max_reads_per_device;
+		const auto reads_per_scan = std::max(max_reads / std::max(max_scans, 1), 1);
+		directory.cache = caches.emplace_back(std::make_unique<search_path_cache>(directory.path, std::move(excluded), reads_per_scan)).get();
+	}
+}
+
+std::vector<std::filesystem::path> search_path_cache_list::directories() const {
+	std::vector<std::filesystem::path> paths;
+	for (const auto& directory : search_directories) {
+		paths.push_back(directory.path);
+	}
+	return paths;
+}
+
+bool search_path_cache_list::has_finished_scans() const {
+	return std::any_of(caches.begin(), caches.end(), [](const auto& cache) {
+		return cache->is_waiting_for_update();
+	});
+}
+
+bool search_path_cache_list::has_waiting_directories() const {
+	return std::any_of(search_directories.begin(), search_directories.end(), [](const auto& directory) {
+		return !directory.cache;
+	});
+}
+
+void search_path_cache_list::wait() {
+	// the waiting scans start as the others on the same device are done, so this waits for one scan at a time.
+	start_scans();
+	while (has_waiting_directories()) {
+		const auto scanning = std::find_if(caches.begin(), caches.end(), [](const auto& cache) {
+			return cache->is_scanning();
+		});
+		if (scanning == caches.end()) {
+			break;
+		}
+		(*scanning)->wait_for_scan();
+		start_scans();
+	}
+	for (auto& cache : caches) {
+		cache->wait();
+	}
+}
+
+int search_path_cache_list::max_reads() const {
+	int reads{ max_reads_per_device };
+	for (const auto& directory : search_directories) {
+		reads = std::min(reads, directory.device.is_rotational ? max_reads_per_rotational_device : max_reads_per_device);
+	}
+	return std::max(reads, 1);
+}
+
+void search_path_cache_list::rescan() {
+	for (auto& cache : caches) {
+		cache->rescan();
+	}
+}
+
+void search_path_cache_list::rename_path(const std::filesystem::path& from, const std::filesystem::path& to) {
+	for (auto& cache : caches) {
+		cache->rename_path(from, to);
+	}
+}
+
+void search_path_cache_list::rename_paths(const std::vector<std::pair<std::filesystem::path, std::filesystem::path>>& renames) {
+	for (auto& cache : caches) {
+		cache->rename_paths(renames);
+	}
+}
+
+bool search_path_cache_list::update() {
+	start_scans();
+	bool any_updated{ false };
+	for (auto& cache : caches) {
+		any_updated |= cache->update();
+	}
+	return any_updated;
+}
\ No newline at end of file
@@ -0,0 +1,312 @@
+#pragma once
+
+#include "index.hpp"
+#include "filesystem.hpp"
+
+#include <vector>
+#include <string>
+#include <filesystem>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <future>
+#include <optional>
+#include <deque>
+#include <unordered_map>
+#include <algorithm>
+#include <functional>
+#include <utility>
+
+class search_path_cache;
+
+struct search_query {
+	std::vector<std::string> include_tags;
+	std::vector<std::string> exclude_tags;
+	std::string name_contains;
+	std::vector<const search_path_cache*> caches;
+	uint64_t generation{ 0 };
+
+	// Counts how many of the results have each tag.
+	bool count_facets{ false };
+
+	// For every include tag, the tags that are accepted in its place. Only the include tag itself if empty.
+	std::vector<std::vector<std::string>> accepted_include_tags;
+
+	// Accepts the tags that imply the include tags. The registry isn't thread safe, so this is done before submitting.
+	void expand_implications();
+};
+
+class search_path_cache {
+public:
+
+	// The directories below the search directory that are scanned by other caches.
+	struct excluding {
+		std::vector<std::filesystem::path> directories;
+	};
+
+	// How many files a scan reads at once when it has the device to itself.
+	static constexpr int default_max_reads{ 64 };
+
+	search_path_cache(const std::filesystem::path& path);
+	// Indexes these paths instead of scanning the directory. Used when the paths are already known.
+	search_path_cache(const std::filesystem::path& path, std::vector<std::filesystem::path> paths);
+	// Scans the directory except the excluded directories, but still finds the excluded directories themselves.
+	// The scan has at most max_reads stats or tag reads in flight at once, so scans can share a device.
+	search_path_cache(const std::filesystem::path& path, excluding excluded, int max_reads = default_max_reads);
+	search_path_cache(const search_path_cache&) = delete;
+	search_path_cache(search_path_cache&&) = delete;
+
+	~search_path_cache();
+
+	search_path_cache& operator=(const search_path_cache&) = delete;
+	search_path_cache& operator=(search_path_cache&&) = delete;
+
+	const std::filesystem::path& directory() const;
+
+	// Starts moving the paths into the cache once the scan is done, and adds the tag usage of the applied changes
+	// to the registry. Returns true the first time it's called after the paths were moved.
+	bool update();
+	// Waits for the scan and every change posted so far.
+	void wait();
+	// Waits for the scan, without moving the paths into the cache.
+	void wait_for_scan() const;
+
+	// Scans again once the running scan is done, f.ex when the tags are read from somewhere else. The views are found again.
+	void rescan();
+
+	// True until the scan is done, even if the paths haven't been moved into the cache yet.
+	bool is_scanning() const;
+
+	// True if the scan is done or changes were applied, but update hasn't been called since.
+	bool is_waiting_for_update() const;
+
+	const std::vector<std::filesystem::path>& excluded_directories() const;
+
+	// Changed every time the paths or tags change. Zero until the scan is done.
+	uint64_t version() const;
+
+	// The paths are changed on the change thread, so hold this lock while using them.
+	// A path is empty if it was removed, so the ids of the other paths stay the same.
+	std::shared_lock<std::shared_mutex> lock() const;
+	const std::vector<std::filesystem::path>& paths() const;
+	const name_index& names() const;
+	const tag_index& tag_ids() const;
+
+	// The ids of the paths changed since the version, so a copy of the cache can be updated instead of copied again.
+	// Nullopt if the changes aren't known that far back, f.ex from before the last scan. Call it with the lock, or on the change thread.
+	std::optional<std::vector<uint32_t>> changed_ids_since(uint64_t version) const;
+
+	// Runs the function on the change thread after the changes posted so far. The paths can be read without the lock
+	// there, since nothing else changes them, so a slow read doesn't hold up the searches.
+	std::future<void> post_read(std::function<void()> read);
+
+	// Keeps the cache up to date when files are changed by the program, without scanning again.
+	// The changes are applied in order on the change thread, so the caller never waits for a search to finish.
+	// The tags of a file can change without a rename if they are stored in an attribute, so renaming to the same path reads them again.
+	void add_path(const std::filesystem::path& path);
+	void remove_path(const std::filesystem::path& path);
+	void rename_path(const std::filesystem::path& from, const std::filesystem::path& to);
+
+	// Same as rename_path, but searches never see only some of the paths renamed.
+	void rename_paths(const std::vector<std::pair<std::filesystem::path, std::filesystem::path>>& renames);
+
+	// A view is a query whose result is kept up to date as paths are added, removed and renamed,
+	// so it never has to be searched again. The views are found on the change thread, and again when a scan is done.
+	// Adding a view replaces the view with the same name, so it can be added again when its query is expanded again.
+	void add_view(const std::string& name, const search_query& query);
+	void remove_view(const std::string& name);
+	bool has_view(const std::string& name) const;
+
+	// Nullopt if there is no such view, or the paths are still being scanned.
+	std::optional<std::vector<std::filesystem::path>> view_paths(const std::string& name) const;
+
+private:
+
+	struct view {
+		std::string name;
+		search_query query;
+		std::string folded_name;
+		id_bitmap ids;
+	};
+
+	struct scan_result {
+		std::vector<std::filesystem::path> paths;
+		name_index names;
+		tag_index tag_ids;
+	};
+
+	static scan_result scan(const std::filesystem::path& path, const std::vector<std::filesystem::path>& excluded_directories, int max_reads);
+	static scan_result index_paths(std::vector<std::filesystem::path> paths, int max_reads);
+	void start_scan();
+	std::optional<uint32_t> find_path_id(const std::filesystem::path& path) const;
+	void rename_path_locked(const std::filesystem::path& from, const std::filesystem::path& to, const std::vector<std::string>& new_tags);
+	// Reads the paths of a scan that hasn't been moved into the cache yet, or of the cache from the change thread.
+	static id_bitmap find_view_ids(const view& view, const std::vector<std::filesystem::path>& paths, const name_index& names, const tag_index& tag_ids);
+	void update_views(uint32_t id);
+
+	// Only the change thread takes the unique lock, so it can read the paths without locking.
+	void post_change(std::function<void()> change);
+	void apply_changes();
+	void merge_scan(scan_result result);
+	void queue_usage(const std::vector<std::string>& tags, int64_t count);
+	void log_change(uint32_t id);
+
+	const std::filesystem::path search_path;
+	const std::vector<std::filesystem::path> excluded_search_paths;
+	const bool is_listed{ false }; // the paths were given instead of scanned, so they are indexed again instead.
+	const int max_reads{ default_max_reads };
+	std::vector<std::filesystem::path> cached_paths;
+	name_index cached_names;
+	tag_index cached_tag_ids;
+	std::vector<view> views;
+	bool is_scanned{ false };
+	std::atomic<uint64_t> change_count{ 0 };
+	std::deque<std::pair<uint64_t, uint32_t>> change_log; // the version after each change, and the id it changed.
+	uint64_t change_log_start{ 0 }; // the log has every change after this version.
+	mutable std::shared_mutex mutex;
+
+	std::thread change_thread;
+	mutable std::mutex changes_mutex;
+	std::condition_variable changes_condition;
+	std::deque<std::function<void()>> pending_changes;
+	std::vector<std::pair<std::string, int64_t>> pending_usage; // the registry isn't thread safe, so update adds it.
+	std::vector<std::string> view_names; // including the views that are still waiting to be added.
+	bool has_merged_scan{ false };
+	bool applying_change{ false };
+	bool stopping{ false };
+
+	bool must_rescan{ false };
+	std::future<scan_result> future_scan; // last, so the scan is finished before the rest is destroyed.
+
+};
+
+// Manages the search directories. A directory inside another search directory isn't scanned again, and a directory
+// around other search directories skips them when it's scanned, so no file is in more than one cache.
+// A directory waits for its scan to start if too many directories on the same device are scanned already.
+class search_path_cache_list {
+public:
+
+	// Only the directories that have started scanning have a cache. The caches are never removed.
+	std::vector<std::unique_ptr<search_path_cache>> caches;
+
+	// How many directories on the same device are scanned at once. A spinning disk is faster to scan one directory at a time.
+	int max_scans_per_device{ 4 };
+	int max_scans_per_rotational_device{ 1 };
+
+	// How many files are read at once on the same device, split between the directories that may be scanned on it at
+	// once. A spinning disk orders a few reads by where they are, but more only make it seek back and forth.
+	int max_reads_per_device{ search_path_cache::default_max_reads };
+	int max_reads_per_rotational_device{ 4 };
+
+	search_path_cache_list() = default;
+	search_path_cache_list(const search_path_cache_list&) = delete;
+	search_path_cache_list(search_path_cache_list&&) = delete;
+
+	search_path_cache_list& operator=(const search_path_cache_list&) = delete;
+	search_path_cache_list& operator=(search_path_cache_list&&) = delete;
+
+	void add_search_directory(const std::filesystem::path& path);
+
+	// Includes the directories that are waiting for their scan to start.
+	std::vector<std::filesystem::path> directories() const;
+	bool has_waiting_directories() const;
+
+	// Starts the scans that are allowed to start, and moves the finished scans into the caches.
+	bool update();
+	void wait();
+
+	// The fewest reads at once that the devices of the search directories allow, for work that reads files from all of them.
+	int max_reads() const;
+
+	// Scans every directory with a cache again.
+	void rescan();
+
+	// The first part of update, for when moving the finished scans into the caches has to wait for its turn.
+	void start_scans();
+	bool has_finished_scans() const;
+
+	void rename_path(const std::filesystem::path& from, const std::filesystem::path& to);
+	void rename_paths(const std::vector<std::pair<std::filesystem::path, std::filesystem::path>>& renames);
+
+private:
+
+	struct search_directory {
+		std::filesystem::path path;
+		std::filesystem::path canonical_path; // to find the directories inside each other.
+		fs::device_info device;
+		const search_path_cache* cache{ nullptr }; // nullptr until the scan is started.
+	};
+
+	std::vector<search_directory> search_directories;
+
+};
+
+struct tag_facet {
+	std::string tag;
+	size_t count{ 0 };
+};
+
+struct search_result {
+	uint64_t generation{ 0 };
+	std::vector<std::filesystem::path> paths;
+	std::vector<tag_facet> facets; // the most common tags first. only if the query counts them.
+	size_t paths_searched{ 0 };
+	long long milliseconds{ 0 };
+	int thread_count{ 0 };
+
+	double paths_per_second() const {
+		return static_cast<double>(paths_searched) * 1000.0 / static_cast<double>(std::max(milliseconds, 1LL));
+	}
+};
+
+// Searches the caches on all cores. Returns nullopt if cancelled before it finished.
+std::optional<search_result> run_search(const search_query& query, const std::function<bool()>& is_cancelled = {});
+
+struct discovered_tag {
+	std::string name;
+	size_t file_count{ 0 };
+	bool is_registered{ false }; // only set by mark_registered_tags.
+};
+
+// Counts the files with each tag in the caches. The tag index made by the scan is used, so the disk isn't read again.
+// A file in more than one cache is counted once. The most used tags come first. Can be called on any thread.
+std::vector<discovered_tag> discover_tags(const std::vector<const search_path_cache*>& caches);
+
+// Sets is_registered. The registry isn't thread safe, so this is done on the thread that changes it.
+void mark_registered_tags(std::vector<discovered_tag>& tags);
+
+// Runs queries on a background thread. Submitting a query makes all older queries stale,
+// and a stale query is abandoned as soon as the search thread notices it.
+class search_executor {
+public:
+
+	search_executor();
+	search_executor(const search_executor&) = delete;
+	search_executor(search_executor&&) = delete;
+
+	~search_executor();
+
+	search_executor& operator=(const search_executor&) = delete;
+	search_executor& operator=(search_executor&&) = delete;
+
+	uint64_t submit(search_query query);
+	std::optional<search_result> poll();
+	bool is_busy() const;
+
+private:
+
+	void run();
+	bool is_stale(uint64_t generation) const;
+
+	std::thread thread;
+	mutable std::mutex mutex;
+	std::condition_variable condition;
+	std::optional<search_query> pending_query;
+	std::optional<search_result> finished_result;
+	std::atomic<uint64_t> latest_generation{ 0 };
+	bool busy{ false };
+	bool stopping{ false };
+
+};
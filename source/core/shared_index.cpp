@@ -0,0 +1,811 @@
+#include "shared_index.hpp"
+#include "tags.hpp"
+#include "hash.hpp"
+#include "profiler.hpp"
+#include "io.hpp"
+#include "timer.hpp"
+#include "debug.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace shared_index {
+
+static constexpr uint64_t segment_magic{ 0x78646E69796B6C6Dull }; // "mlkyindx"
+static constexpr uint32_t format_version{ 3 };
+static constexpr size_t page_size{ 4096 };
+static constexpr int max_search_attempts{ 8 };
+static constexpr int max_create_attempts{ 8 };
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "The sequences are shared between processes, so they can't use locks.");
+
+struct slot {
+	std::atomic<uint64_t> sequence{ 0 }; // odd while the slot is written.
+	std::atomic<uint64_t> offset{ 0 }; // from the start of the segment.
+	std::atomic<uint64_t> capacity{ 0 };
+	std::atomic<uint64_t> size{ 0 }; // zero until something is published.
+};
+
+struct header {
+	uint64_t magic{ segment_magic };
+	uint32_t format_version{ shared_index::format_version };
+	std::atomic<uint32_t> active_slot{ 0 };
+	std::atomic<uint64_t> segment_size{ page_size }; // readers map the segment again when it grows.
+	slot slots[2];
+};
+
+// A path entry is empty if the path was removed from the cache. Offsets are into the strings.
+struct path_entry {
+	uint64_t offset{ 0 };
+	uint64_t size{ 0 };
+};
+
+// A tag without ids is the same as a tag that isn't in the slot. It's left until the slot is written again from scratch.
+struct tag_entry {
+	uint64_t name_offset{ 0 };
+	uint64_t name_size{ 0 };
+	uint64_t ids_offset{ 0 };
+	uint64_t id_count{ 0 };
+};
+
+// A published slot starts with the counts, followed by the regions. Offsets are from the start of the slot.
+// The tags are sorted, so readers can find them with a binary search. Every tag has a sorted array of the ids of its
+// paths, so the slot grows with the number of tagged files instead of the number of tags times the number of paths.
+// The regions have room to spare, so a few changes are written into them without copying the rest of the slot.
+struct slot_layout {
+
+	uint64_t path_count{ 0 };
+	uint64_t live_path_count{ 0 }; // without the removed paths.
+	uint64_t path_capacity{ 0 };
+	uint64_t tag_count{ 0 };
+	uint64_t tag_capacity{ 0 };
+	uint64_t ids_size{ 0 };
+	uint64_t ids_capacity{ 0 };
+	uint64_t strings_size{ 0 };
+	uint64_t strings_capacity{ 0 };
+
+	size_t paths() const {
+		return sizeof(slot_layout);
+	}
+
+	size_t tags() const {
+		return paths() + path_capacity * sizeof(path_entry);
+	}
+
+	size_t ids() const {
+		return tags() + tag_capacity * sizeof(tag_entry);
+	}
+
+	size_t strings() const {
+		return ids() + ids_capacity * sizeof(uint32_t);
+	}
+
+	size_t size() const {
+		return strings() + strings_capacity;
+	}
+
+	// The slot may be read while it's written, so the counts can be anything, and must not overflow the sizes.
+	bool fits(uint64_t capacity) const {
+		if (path_capacity > capacity / sizeof(path_entry) || tag_capacity > capacity / sizeof(tag_entry)
+			|| ids_capacity > capacity / sizeof(uint32_t) || strings_capacity > capacity) {
+			return false;
+		}
+		if (path_count > path_capacity || live_path_count > path_count || tag_count > tag_capacity
+			|| ids_size > ids_capacity || strings_size > strings_capacity) {
+			return false;
+		}
+		return size() <= capacity;
+	}
+
+};
+
+// Room for the changes until the slot is written from scratch again.
+static uint64_t with_room_to_spare(uint64_t size) {
+	return size + size / 2 + 64;
+}
+
+std::string segment_name(const std::filesystem::path& directory) {
+	// the gui and the cli may name the same directory differently.
+	std::error_code error;
+	auto normal_path = std::filesystem::weakly_canonical(std::filesystem::absolute(directory, error), error).lexically_normal();
+	if (!normal_path.has_filename() && normal_path.has_parent_path()) {
+		normal_path = normal_path.parent_path();
+	}
+	const auto path_string = normal_path.u8string();
+	std::ostringstream name;
+	name << "/milky-index-" << std::hex << std::setw(16) << std::setfill('0') << hash_bytes(path_string.data(), path_string.size());
+	return name.str();
+}
+
+writer::writer(std::string name, int file) : name{ std::move(name) }, file{ file } {
+
+}
+
+std::unique_ptr<writer> writer::create(const std::filesystem::path& directory) {
+#if defined(__linux__)
+	auto name = segment_name(directory);
+	int file{ -1 };
+	struct stat status {};
+	// the writer before may unlink the segment between opening and locking it, and then the lock is on a segment no
+	// reader can find, so it's opened again until the locked segment is the one with the name.
+	for (int attempt{ 0 }; ; attempt++) {
+		file = shm_open(name.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+		if (file < 0) {
+			WARNING("Failed to open shared memory for " << directory << ". Error: " << std::strerror(errno));
+			return nullptr;
+		}
+		// the lock is held until the writer is destroyed, and is how readers know the index is kept up to date.
+		if (flock(file, LOCK_EX | LOCK_NB) != 0) {
+			close(file);
+			return nullptr;
+		}
+		struct stat named_status {};
+		if (fstat(file, &status) != 0) {
+			close(file);
+			return nullptr;
+		}
+		const auto named_path = "/dev/shm" + name;
+		if (stat(named_path.c_str(), &named_status) == 0 && named_status.st_dev == status.st_dev && named_status.st_ino == status.st_ino) {
+			break;
+		}
+		close(file);
+		if (attempt == max_create_attempts) {
+			WARNING("The shared memory for " << directory << " kept being replaced while it was opened.");
+			return nullptr;
+		}
+	}
+	std::unique_ptr<writer> new_writer{ new writer{ std::move(name), file } };
+	// a segment left by a writer that exited is taken over instead of shrunk, since readers may still have it mapped.
+	const auto existing_size = static_cast<size_t>(status.st_size);
+	const auto existing_header = existing_size >= sizeof(header);
+	if (!existing_header && ftruncate(file, page_size) != 0) {
+		return nullptr;
+	}
+	if (!new_writer->map(std::max(existing_size, page_size))) {
+		return nullptr;
+	}
+	auto segment = new_writer->get_header();
+	if (!existing_header || segment->magic != segment_magic || segment->format_version != format_version) {
+		segment = new (new_writer->mapping) header{};
+		segment->segment_size = std::max(existing_size, page_size);
+	} else {
+		// the old index is no longer up to date, so it's hidden until the first publish.
+		for (auto& old_slot : segment->slots) {
+			const auto sequence = old_slot.sequence.load(std::memory_order_relaxed);
+			old_slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+			old_slot.size.store(0, std::memory_order_relaxed);
+			old_slot.sequence.store(sequence + 2, std::memory_order_release);
+		}
+	}
+	INFO("Publishing the index of " << directory << " in " << new_writer->name);
+	return new_writer;
+#else
+	return nullptr;
+#endif
+}
+
+writer::~writer() {
+#if defined(__linux__)
+	// readers that have the segment mapped keep it until they're done, and new readers won't find it.
+	shm_unlink(name.c_str());
+	if (mapping) {
+		munmap(mapping, mapped_size);
+	}
+	close(file);
+#endif
+}
+
+bool writer::map(size_t size) {
+#if defined(__linux__)
+	if (mapping) {
+		munmap(mapping, mapped_size);
+		mapping = nullptr;
+	}
+	void* new_mapping{ mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0) };
+	if (new_mapping == MAP_FAILED) {
+		WARNING("Failed to map the shared index " << name << ". Error: " << std::strerror(errno));
+		return false;
+	}
+	mapping = new_mapping;
+	mapped_size = size;
+	return true;
+#else
+	return false;
+#endif
+}
+
+header* writer::get_header() const {
+	return static_cast<header*>(mapping);
+}
+
+uint64_t writer::published_version() const {
+	return version;
+}
+
+char* writer::get_slot(uint32_t slot_index) const {
+	return static_cast<char*>(mapping) + get_header()->slots[slot_index].offset;
+}
+
+void writer::publish(const search_path_cache& cache) {
+#if defined(__linux__)
+	PROFILE_ZONE("publish_index");
+	if (!mapping) {
+		return; // failed to grow earlier.
+	}
+	auto segment = get_header();
+	const uint32_t slot_index{ 1 - (segment->active_slot.load(std::memory_order_relaxed) & 1) };
+	const auto sequence = segment->slots[slot_index].sequence.load(std::memory_order_relaxed);
+	segment->slots[slot_index].sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	uint64_t size{ 0 };
+	if (const auto& slot_version = slot_versions[slot_index]) {
+		if (auto changed_ids = cache.changed_ids_since(*slot_version)) {
+			size = write_changes(cache, slot_index, std::move(*changed_ids));
+		}
+	}
+	if (size == 0) {
+		size = write_all(cache, slot_index);
+	}
+	if (!mapping) {
+		return;
+	}
+	segment = get_header();
+	auto& target = segment->slots[slot_index];
+	if (size == 0) {
+		slot_versions[slot_index].reset();
+		target.sequence.store(sequence + 2, std::memory_order_release);
+		return;
+	}
+	target.size.store(size, std::memory_order_relaxed);
+	target.sequence.store(sequence + 2, std::memory_order_release);
+	segment->active_slot.store(slot_index, std::memory_order_release);
+	version = cache.version();
+	slot_versions[slot_index] = version.load();
+#endif
+}
+
+uint64_t writer::write_all(const search_path_cache& cache, uint32_t slot_index) {
+	const auto& paths = cache.paths();
+	auto tag_names = cache.tag_ids().all_tags();
+	std::sort(tag_names.begin(), tag_names.end());
+	slot_layout layout;
+	layout.path_count = paths.size();
+	layout.tag_count = tag_names.size();
+	for (const auto& path : paths) {
+		layout.strings_size += path.native().size();
+		layout.live_path_count += path.empty() ? 0 : 1;
+	}
+	for (const auto& tag : tag_names) {
+		const auto tag_ids = cache.tag_ids().find(tag);
+		layout.ids_size += tag_ids ? tag_ids->count() : 0;
+		layout.strings_size += tag.size();
+	}
+	layout.path_capacity = with_room_to_spare(layout.path_count);
+	layout.tag_capacity = with_room_to_spare(layout.tag_count);
+	layout.ids_capacity = with_room_to_spare(layout.ids_size);
+	layout.strings_capacity = with_room_to_spare(layout.strings_size);
+	if (!place_slot(slot_index, layout.size())) {
+		return 0;
+	}
+
+	const auto data = get_slot(slot_index);
+	std::memcpy(data, &layout, sizeof(layout));
+	const auto path_entries = reinterpret_cast<path_entry*>(data + layout.paths());
+	const auto tag_entries = reinterpret_cast<tag_entry*>(data + layout.tags());
+	const auto ids = reinterpret_cast<uint32_t*>(data + layout.ids());
+	const auto strings = data + layout.strings();
+	uint64_t string_offset{ 0 };
+	for (size_t id{ 0 }; id < paths.size(); id++) {
+		const auto& path_string = paths[id].native();
+		path_entries[id] = { string_offset, path_string.size() };
+		std::memcpy(strings + string_offset, path_string.data(), path_string.size());
+		string_offset += path_string.size();
+	}
+	uint64_t id_offset{ 0 };
+	for (size_t tag_index{ 0 }; tag_index < tag_names.size(); tag_index++) {
+		const auto& tag = tag_names[tag_index];
+		std::memcpy(strings + string_offset, tag.data(), tag.size());
+		const auto tag_ids = cache.tag_ids().find(tag);
+		const auto sorted_ids = tag_ids ? tag_ids->ids() : std::vector<uint32_t>{};
+		std::memcpy(ids + id_offset, sorted_ids.data(), sorted_ids.size() * sizeof(uint32_t));
+		tag_entries[tag_index] = { string_offset, tag.size(), id_offset, sorted_ids.size() };
+		string_offset += tag.size();
+		id_offset += sorted_ids.size();
+	}
+	return layout.size();
+}
+
+uint64_t writer::write_changes(const search_path_cache& cache, uint32_t slot_index, std::vector<uint32_t> changed_ids) {
+	const auto data = get_slot(slot_index);
+	slot_layout layout;
+	std::memcpy(&layout, data, sizeof(layout));
+	const auto& paths = cache.paths();
+	if (paths.size() > layout.path_capacity || paths.size() < layout.path_count) {
+		return 0;
+	}
+	for (auto id = static_cast<uint32_t>(layout.path_count); id < paths.size(); id++) {
+		changed_ids.push_back(id);
+	}
+	std::sort(changed_ids.begin(), changed_ids.end());
+	changed_ids.erase(std::unique(changed_ids.begin(), changed_ids.end()), changed_ids.end());
+	// every tag in the slot is searched for the old tags of the ids, so a large change is cheaper to write from scratch.
+	if (changed_ids.size() * layout.tag_count > layout.ids_size + layout.strings_size) {
+		return 0;
+	}
+	const auto path_entries = reinterpret_cast<path_entry*>(data + layout.paths());
+	const auto tag_entries = reinterpret_cast<tag_entry*>(data + layout.tags());
+	const auto ids = reinterpret_cast<uint32_t*>(data + layout.ids());
+	const auto strings = data + layout.strings();
+	auto get_tag_name = [&](uint64_t tag_index) -> std::string_view {
+		return { strings + tag_entries[tag_index].name_offset, static_cast<size_t>(tag_entries[tag_index].name_size) };
+	};
+
+	std::vector<std::string> changed_tags;
+	for (uint64_t tag_index{ 0 }; tag_index < layout.tag_count; tag_index++) {
+		const auto begin = ids + tag_entries[tag_index].ids_offset;
+		const auto end = begin + tag_entries[tag_index].id_count;
+		for (const auto id : changed_ids) {
+			if (std::binary_search(begin, end, id)) {
+				changed_tags.emplace_back(get_tag_name(tag_index));
+				break;
+			}
+		}
+	}
+	for (const auto id : changed_ids) {
+		for (auto& tag : cache.tag_ids().tags_of(id)) {
+			changed_tags.push_back(std::move(tag));
+		}
+	}
+	std::sort(changed_tags.begin(), changed_tags.end());
+	changed_tags.erase(std::unique(changed_tags.begin(), changed_tags.end()), changed_tags.end());
+
+	// nothing is written until it's known that the changes fit.
+	struct tag_change {
+		std::string_view name;
+		std::optional<uint64_t> tag_index; // nullopt for a new tag.
+		std::vector<uint32_t> ids;
+	};
+	std::vector<tag_change> tag_changes;
+	uint64_t new_tag_count{ 0 };
+	uint64_t appended_ids{ 0 };
+	uint64_t appended_strings{ 0 };
+	for (const auto& tag : changed_tags) {
+		uint64_t first{ 0 };
+		uint64_t last{ layout.tag_count };
+		while (first < last) {
+			const uint64_t middle{ first + (last - first) / 2 };
+			if (get_tag_name(middle) < tag) {
+				first = middle + 1;
+			} else {
+				last = middle;
+			}
+		}
+		const bool is_new{ first == layout.tag_count || get_tag_name(first) != tag };
+		const auto tag_ids = cache.tag_ids().find(tag);
+		auto& change = tag_changes.emplace_back(tag_change{ tag, is_new ? std::nullopt : std::optional<uint64_t>{ first }, tag_ids ? tag_ids->ids() : std::vector<uint32_t>{} });
+		if (is_new) {
+			new_tag_count++;
+			appended_strings += tag.size();
+		}
+		if (is_new || change.ids.size() > tag_entries[first].id_count) {
+			appended_ids += change.ids.size();
+		}
+	}
+	for (const auto id : changed_ids) {
+		const auto size = paths[id].native().size();
+		if (id >= layout.path_count || size > path_entries[id].size) {
+			appended_strings += size;
+		}
+	}
+	if (layout.tag_count + new_tag_count > layout.tag_capacity || layout.ids_size + appended_ids > layout.ids_capacity
+		|| layout.strings_size + appended_strings > layout.strings_capacity) {
+		return 0;
+	}
+
+	// a path that got longer is appended, and the space of the old one is reclaimed when the slot is written from scratch.
+	for (const auto id : changed_ids) {
+		const auto& path_string = paths[id].native();
+		const bool is_new{ id >= layout.path_count };
+		if (!is_new && path_entries[id].size > 0) {
+			layout.live_path_count--;
+		}
+		if (!path_string.empty()) {
+			layout.live_path_count++;
+		}
+		auto& entry = path_entries[id];
+		if (is_new || path_string.size() > entry.size) {
+			entry.offset = layout.strings_size;
+			layout.strings_size += path_string.size();
+		}
+		std::memcpy(strings + entry.offset, path_string.data(), path_string.size());
+		entry.size = path_string.size();
+	}
+	layout.path_count = paths.size();
+
+	// the existing tags are changed first, since inserting the new tags moves them.
+	for (const auto& change : tag_changes) {
+		if (!change.tag_index) {
+			continue;
+		}
+		auto& entry = tag_entries[*change.tag_index];
+		if (change.ids.size() > entry.id_count) {
+			entry.ids_offset = layout.ids_size;
+			layout.ids_size += change.ids.size();
+		}
+		std::memcpy(ids + entry.ids_offset, change.ids.data(), change.ids.size() * sizeof(uint32_t));
+		entry.id_count = change.ids.size();
+	}
+	for (const auto& change : tag_changes) {
+		if (change.tag_index) {
+			continue;
+		}
+		const tag_entry entry{ layout.strings_size, change.name.size(), layout.ids_size, change.ids.size() };
+		std::memcpy(strings + layout.strings_size, change.name.data(), change.name.size());
+		layout.strings_size += change.name.size();
+		std::memcpy(ids + layout.ids_size, change.ids.data(), change.ids.size() * sizeof(uint32_t));
+		layout.ids_size += change.ids.size();
+		uint64_t position{ 0 };
+		while (position < layout.tag_count && get_tag_name(position) < change.name) {
+			position++;
+		}
+		std::memmove(tag_entries + position + 1, tag_entries + position, (layout.tag_count - position) * sizeof(tag_entry));
+		tag_entries[position] = entry;
+		layout.tag_count++;
+	}
+	std::memcpy(data, &layout, sizeof(layout));
+	return layout.size();
+}
+
+bool writer::place_slot(uint32_t slot_index, uint64_t size) {
+#if defined(__linux__)
+	auto segment = get_header();
+	const auto& other = segment->slots[1 - slot_index];
+	const uint64_t capacity{ (size + page_size - 1) / page_size * page_size };
+	const uint64_t current_capacity{ segment->slots[slot_index].capacity };
+	if (current_capacity >= capacity && current_capacity <= capacity * 4) {
+		return true;
+	}
+	// the other slot may be read at any time, so this one goes before it if there's room, and after it if not.
+	// the space this slot used is given back, and a slow reader that still uses it sees the sequence change.
+	uint64_t offset{ page_size };
+	if (other.capacity > 0 && offset + capacity > other.offset) {
+		offset = std::max<uint64_t>(offset, other.offset + other.capacity);
+	}
+	if (offset + capacity > segment->segment_size) {
+		const size_t previous_size{ mapped_size };
+		if (ftruncate(file, static_cast<off_t>(offset + capacity)) != 0 || !map(offset + capacity)) {
+			WARNING("Failed to grow the shared index " << name << ". Error: " << std::strerror(errno));
+			if (!mapping) {
+				map(previous_size);
+			}
+			return false;
+		}
+		segment = get_header();
+		segment->segment_size = offset + capacity;
+	}
+	segment->slots[slot_index].offset = offset;
+	segment->slots[slot_index].capacity = capacity;
+	release_unused_space();
+	return true;
+#else
+	return false;
+#endif
+}
+
+void writer::release_unused_space() {
+#if defined(__linux__)
+	// the segment never shrinks, since readers may have it mapped, but the pages between the slots take no memory.
+	const auto segment = get_header();
+	std::array<std::pair<uint64_t, uint64_t>, 2> used_ranges;
+	for (uint32_t slot_index{ 0 }; slot_index < 2; slot_index++) {
+		const auto& used = segment->slots[slot_index];
+		used_ranges[slot_index] = { used.offset.load(), used.offset + used.capacity };
+	}
+	std::sort(used_ranges.begin(), used_ranges.end());
+	uint64_t unused_begin{ page_size };
+	auto release = [this](uint64_t begin, uint64_t end) {
+		if (begin < end) {
+			fallocate(file, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, static_cast<off_t>(begin), static_cast<off_t>(end - begin));
+		}
+	};
+	for (const auto& [begin, end] : used_ranges) {
+		release(unused_begin, begin);
+		unused_begin = std::max(unused_begin, end);
+	}
+	release(unused_begin, segment->segment_size);
+#endif
+}
+
+reader::reader(int file) : file{ file } {
+
+}
+
+std::unique_ptr<reader> reader::open(const std::filesystem::path& directory) {
+#if defined(__linux__)
+	const auto name = segment_name(directory);
+	const int file{ shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0) };
+	if (file < 0) {
+		return nullptr;
+	}
+	std::unique_ptr<reader> new_reader{ new reader{ file } };
+	if (!new_reader->is_published() || !new_reader->remap()) {
+		return nullptr;
+	}
+	const auto segment = static_cast<const header*>(new_reader->mapping);
+	if (segment->magic != segment_magic || segment->format_version != format_version) {
+		return nullptr;
+	}
+	return new_reader;
+#else
+	return nullptr;
+#endif
+}
+
+reader::~reader() {
+#if defined(__linux__)
+	if (mapping) {
+		munmap(mapping, mapped_size);
+	}
+	close(file);
+#endif
+}
+
+bool reader::is_published() const {
+#if defined(__linux__)
+	// the writer holds an exclusive lock, so a shared lock can only be taken if there is no writer.
+	if (flock(file, LOCK_SH | LOCK_NB) == 0) {
+		flock(file, LOCK_UN);
+		return false;
+	}
+	return errno == EWOULDBLOCK;
+#else
+	return false;
+#endif
+}
+
+bool reader::remap() const {
+#if defined(__linux__)
+	struct stat status {};
+	if (fstat(file, &status) != 0 || static_cast<size_t>(status.st_size) < sizeof(header)) {
+		return false;
+	}
+	if (mapping) {
+		munmap(mapping, mapped_size);
+		mapping = nullptr;
+	}
+	void* new_mapping{ mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_SHARED, file, 0) };
+	if (new_mapping == MAP_FAILED) {
+		return false;
+	}
+	mapping = new_mapping;
+	mapped_size = static_cast<size_t>(status.st_size);
+	return true;
+#else
+	return false;
+#endif
+}
+
+#if defined(__linux__)
+
+// Searches a slot that may be written while it's read. Every offset is checked before it's used,
+// so a torn read gives a wrong result that is thrown away, and never reads outside the slot.
+static std::optional<search_result> search_slot(const char* data, uint64_t capacity, const search_query& query, const std::string& folded_name) {
+	slot_layout layout;
+	std::memcpy(&layout, data, sizeof(layout));
+	if (!layout.fits(capacity)) {
+		return std::nullopt;
+	}
+	const auto path_entries = reinterpret_cast<const path_entry*>(data + layout.paths());
+	const auto tag_entries = reinterpret_cast<const tag_entry*>(data + layout.tags());
+	const auto ids = reinterpret_cast<const uint32_t*>(data + layout.ids());
+	const auto strings = data + layout.strings();
+	bool is_torn{ false };
+	auto get_string = [&](uint64_t offset, uint64_t size) -> std::string_view {
+		if (offset > layout.strings_size || size > layout.strings_size - offset) {
+			is_torn = true;
+			return {};
+		}
+		return { strings + offset, static_cast<size_t>(size) };
+	};
+	// empty if no path has the tag.
+	auto find_ids = [&](const std::string& tag) -> std::vector<uint32_t> {
+		uint64_t first{ 0 };
+		uint64_t last{ layout.tag_count };
+		while (first < last && !is_torn) {
+			const uint64_t middle{ first + (last - first) / 2 };
+			const auto& entry = tag_entries[middle];
+			const auto middle_tag = get_string(entry.name_offset, entry.name_size);
+			if (middle_tag == tag) {
+				const auto begin = entry.ids_offset;
+				const auto count = entry.id_count;
+				if (begin > layout.ids_size || count > layout.ids_size - begin) {
+					is_torn = true;
+					return {};
+				}
+				return { ids + begin, ids + begin + count };
+			} else if (middle_tag < tag) {
+				first = middle + 1;
+			} else {
+				last = middle;
+			}
+		}
+		return {};
+	};
+
+	// the arrays are sorted, unless the slot is torn, and then the result is thrown away anyway.
+	std::optional<std::vector<uint32_t>> matching; // nullopt while every path matches.
+	for (size_t i{ 0 }; i < query.include_tags.size(); i++) {
+		const bool has_alternatives{ i < query.accepted_include_tags.size() && !query.accepted_include_tags[i].empty() };
+		const auto& accepted_tags = has_alternatives ? query.accepted_include_tags[i] : std::vector<std::string>{ query.include_tags[i] };
+		std::vector<uint32_t> with_tag;
+		for (const auto& tag : accepted_tags) {
+			const auto tag_ids = find_ids(tag);
+			std::vector<uint32_t> united;
+			std::set_union(with_tag.begin(), with_tag.end(), tag_ids.begin(), tag_ids.end(), std::back_inserter(united));
+			with_tag = std::move(united);
+		}
+		if (matching) {
+			std::vector<uint32_t> intersection;
+			std::set_intersection(matching->begin(), matching->end(), with_tag.begin(), with_tag.end(), std::back_inserter(intersection));
+			matching = std::move(intersection);
+		} else {
+			matching = std::move(with_tag);
+		}
+	}
+	for (const auto& tag : query.exclude_tags) {
+		const auto tag_ids = find_ids(tag);
+		if (tag_ids.empty()) {
+			continue;
+		}
+		if (!matching) {
+			matching.emplace(static_cast<size_t>(layout.path_count));
+			std::iota(matching->begin(), matching->end(), 0);
+		}
+		std::vector<uint32_t> difference;
+		std::set_difference(matching->begin(), matching->end(), tag_ids.begin(), tag_ids.end(), std::back_inserter(difference));
+		matching = std::move(difference);
+	}
+	if (is_torn) {
+		return std::nullopt;
+	}
+
+	search_result result;
+	result.paths_searched = layout.live_path_count;
+	const uint64_t match_count{ matching ? matching->size() : layout.path_count };
+	for (uint64_t index{ 0 }; index < match_count; index++) {
+		const uint64_t id{ matching ? (*matching)[index] : index };
+		if (id >= layout.path_count) {
+			return std::nullopt;
+		}
+		const auto path_string = get_string(path_entries[id].offset, path_entries[id].size);
+		if (is_torn) {
+			return std::nullopt;
+		}
+		if (path_string.empty()) {
+			continue; // removed from the cache.
+		}
+		if (!folded_name.empty()) {
+			const auto separator = path_string.rfind('/');
+			const std::string file_name{ separator == std::string_view::npos ? path_string : path_string.substr(separator + 1) };
+			if (name_index::fold(tags::filename_without_tags(file_name)).find(folded_name) == std::string::npos) {
+				continue;
+			}
+		}
+		result.paths.emplace_back(std::string{ path_string });
+	}
+	return result;
+}
+
+#endif
+
+std::optional<search_result> reader::search(const search_query& query) const {
+#if defined(__linux__)
+	PROFILE_ZONE("search_shared_index");
+	std::lock_guard lock{ mutex };
+	no::timer timer;
+	timer.start();
+	const auto folded_name = name_index::fold(query.name_contains);
+	for (int attempt{ 0 }; attempt < max_search_attempts; attempt++) {
+		auto segment = static_cast<const header*>(mapping);
+		if (segment->segment_size.load(std::memory_order_acquire) > mapped_size) {
+			if (!remap()) {
+				return std::nullopt;
+			}
+			segment = static_cast<const header*>(mapping);
+		}
+		const auto& active = segment->slots[segment->active_slot.load(std::memory_order_acquire) & 1];
+		const auto sequence = active.sequence.load(std::memory_order_acquire);
+		if (sequence % 2 == 1) {
+			std::this_thread::yield();
+			continue;
+		}
+		const auto offset = active.offset.load(std::memory_order_relaxed);
+		const auto capacity = active.capacity.load(std::memory_order_relaxed);
+		if (active.size.load(std::memory_order_relaxed) == 0) {
+			return std::nullopt;
+		}
+		if (offset > mapped_size || capacity > mapped_size - offset) {
+			remap();
+			continue;
+		}
+		auto result = search_slot(static_cast<const char*>(mapping) + offset, capacity, query, folded_name);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (result && active.sequence.load(std::memory_order_relaxed) == sequence) {
+			result->generation = query.generation;
+			result->milliseconds = timer.milliseconds();
+			result->thread_count = 1;
+			return result;
+		}
+	}
+	return std::nullopt;
+#else
+	return std::nullopt;
+#endif
+}
+
+publisher::~publisher() {
+	// the publishing is run on the change threads of the caches, which don't wait for it like std::async does.
+	for (auto& entry : published) {
+		if (entry.publishing.valid()) {
+			entry.publishing.wait();
+		}
+	}
+}
+
+void publisher::update(const search_path_cache_list& caches) {
+	constexpr std::chrono::seconds publish_interval{ 1 };
+	constexpr std::chrono::seconds create_interval{ 10 };
+	const auto now = std::chrono::steady_clock::now();
+	for (const auto& cache : caches.caches) {
+		const auto found = std::find_if(published.begin(), published.end(), [&cache](const auto& entry) {
+			return entry.cache == cache.get();
+		});
+		if (found == published.end()) {
+			// a cache that skips the search directories inside it doesn't have every file, so it isn't published.
+			const bool is_complete{ cache->excluded_directories().empty() };
+			published.push_back({ cache.get(), is_complete ? writer::create(cache->directory()) : nullptr, now });
+		}
+	}
+	for (auto& entry : published) {
+		if (!entry.index_writer) {
+			// the process that publishes the directory may have exited.
+			if (!entry.cache->excluded_directories().empty() || now - entry.last_create_time < create_interval) {
+				continue;
+			}
+			entry.last_create_time = now;
+			entry.index_writer = writer::create(entry.cache->directory());
+			if (!entry.index_writer) {
+				continue;
+			}
+		}
+		if (entry.publishing.valid()) {
+			if (!no::is_future_ready(entry.publishing)) {
+				continue;
+			}
+			entry.publishing.get();
+		}
+		if (entry.cache->version() == entry.index_writer->published_version() || now - entry.last_publish_time < publish_interval) {
+			continue;
+		}
+		entry.last_publish_time = now;
+		entry.publishing = entry.cache->post_read([&index_writer = *entry.index_writer, &cache = *entry.cache] {
+			index_writer.publish(cache);
+		});
+	}
+}
+
+}
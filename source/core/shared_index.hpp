@@ -0,0 +1,139 @@
+#pragma once
+
+#include "search.hpp"
+
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <future>
+#include <atomic>
+#include <chrono>
+#include <optional>
+#include <array>
+
+// The index of a search directory can be published in shared memory by one process, and searched by any number of
+// other processes without scanning the directory or copying the index. Only supported on Linux.
+//
+// The segment has two slots. The writer fills the slot that isn't being read, and then makes it the active slot,
+// so readers never wait for the writer. Every slot has a sequence number that is odd while the slot is written,
+// and a reader retries if the sequence of its slot changed while it was searching.
+namespace shared_index {
+
+struct header;
+
+// The name of the shared memory segment of the directory.
+std::string segment_name(const std::filesystem::path& directory);
+
+class writer {
+public:
+
+	// Nullptr if another process is already publishing the directory, or shared memory is not available.
+	static std::unique_ptr<writer> create(const std::filesystem::path& directory);
+
+	writer(const writer&) = delete;
+	writer(writer&&) = delete;
+
+	~writer();
+
+	writer& operator=(const writer&) = delete;
+	writer& operator=(writer&&) = delete;
+
+	// Copies the paths and tags that changed since the slot that isn't active was written into it, or every path if
+	// too much has changed, and then activates it. The cache is read without the lock, so this is run on the change
+	// thread of the cache with search_path_cache::post_read, or while nothing else changes the cache.
+	void publish(const search_path_cache& cache);
+
+	uint64_t published_version() const;
+
+private:
+
+	writer(std::string name, int file);
+
+	bool map(size_t size);
+	header* get_header() const;
+	char* get_slot(uint32_t slot_index) const;
+
+	// Return the size of the written slot, or zero if it didn't fit.
+	uint64_t write_all(const search_path_cache& cache, uint32_t slot_index);
+	uint64_t write_changes(const search_path_cache& cache, uint32_t slot_index, std::vector<uint32_t> changed_ids);
+
+	bool place_slot(uint32_t slot_index, uint64_t size);
+	void release_unused_space();
+
+	std::string name;
+	int file{ -1 };
+	void* mapping{ nullptr };
+	size_t mapped_size{ 0 };
+	std::atomic<uint64_t> version{ 0 };
+	std::array<std::optional<uint64_t>, 2> slot_versions; // the version of the cache in each slot, if this writer wrote it.
+
+};
+
+class reader {
+public:
+
+	// Nullptr if no process is publishing the directory.
+	static std::unique_ptr<reader> open(const std::filesystem::path& directory);
+
+	reader(const reader&) = delete;
+	reader(reader&&) = delete;
+
+	~reader();
+
+	reader& operator=(const reader&) = delete;
+	reader& operator=(reader&&) = delete;
+
+	// False if the writer has exited, so the index is no longer kept up to date.
+	bool is_published() const;
+
+	// Searches the active slot. The caches in the query are not used, and the facets are not counted.
+	// Returns nullopt if nothing has been published yet, or the writer kept replacing the index while searching.
+	std::optional<search_result> search(const search_query& query) const;
+
+private:
+
+	reader(int file);
+
+	bool remap() const;
+
+	int file{ -1 };
+	mutable void* mapping{ nullptr };
+	mutable size_t mapped_size{ 0 };
+	mutable std::mutex mutex; // the mapping is replaced when the segment grows.
+
+};
+
+// Publishes every cache in the list that no other process is publishing, again when the cache has changed.
+// The publishing is done on the change thread of the cache, at most once a second for every cache.
+// A directory that another process publishes is tried again now and then, in case that process exits.
+class publisher {
+public:
+
+	publisher() = default;
+	publisher(const publisher&) = delete;
+	publisher(publisher&&) = delete;
+
+	~publisher();
+
+	publisher& operator=(const publisher&) = delete;
+	publisher& operator=(publisher&&) = delete;
+
+	void update(const search_path_cache_list& caches);
+
+private:
+
+	struct published_cache {
+		search_path_cache* cache{ nullptr };
+		std::unique_ptr<writer> index_writer; // nullptr if another process publishes the directory.
+		std::chrono::steady_clock::time_point last_create_time;
+		std::chrono::steady_clock::time_point last_publish_time;
+		std::future<void> publishing; // after the writer, so publishing is done before the writer is destroyed.
+	};
+
+	std::vector<published_cache> published;
+
+};
+
+}
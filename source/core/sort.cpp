@@ -0,0 +1,131 @@
+#include "sort.hpp"
+#include "tags.hpp"
+#include "parallel.hpp"
+#include "profiler.hpp"
+#include "filesystem.hpp"
+
+#include <numeric>
+
+std::string make_collation_key(std::string_view name) {
+	std::string key;
+	key.reserve(name.size() + 8);
+	size_t i{ 0 };
+	while (i < name.size()) {
+		if (std::isdigit(static_cast<unsigned char>(name[i]))) {
+			while (i + 1 < name.size() && name[i] == '0' && std::isdigit(static_cast<unsigned char>(name[i + 1]))) {
+				i++; // leading zeros don't change the value.
+			}
+			const size_t digits_begin{ i };
+			while (i < name.size() && std::isdigit(static_cast<unsigned char>(name[i]))) {
+				i++;
+			}
+			// longer numbers are larger, so the digit count is written before the digits.
+			// it is written as a control character, so numbers are ordered before text.
+			key += static_cast<char>(std::min(i - digits_begin, static_cast<size_t>(31)));
+			key.append(name.substr(digits_begin, i - digits_begin));
+		} else {
+			key += static_cast<char>(std::tolower(static_cast<unsigned char>(name[i])));
+			i++;
+		}
+	}
+	return key;
+}
+
+static void apply_file_status(const fs::file_status& status, entry_sort_key& key) {
+	key.is_directory = status.type == fs::file_type::directory;
+	key.size = status.size;
+	key.modified_time = status.modified_time;
+}
+
+static entry_sort_key make_name_sort_key(const std::filesystem::path& path) {
+	const auto file_name = path.filename().u8string();
+	entry_sort_key key;
+	key.name = make_collation_key(tags::filename_without_tags(file_name));
+	if (tags::get_storage_mode() == tags::storage_mode::file_name) {
+		key.tags = tags::find_tag_string_in_path(file_name);
+	} else {
+		// formatted like the tags in a name, so sorting by tags works the same in every mode.
+		key.tags = tags::find_tag_string_in_path(tags::make_tag_string(tags::read_tags(path)));
+	}
+	if (!key.tags.empty()) {
+		key.tag_count = static_cast<uint32_t>(std::count(key.tags.begin(), key.tags.end(), ' ') + 1);
+	}
+	return key;
+}
+
+entry_sort_key make_sort_key(const std::filesystem::path& path) {
+	auto key = make_name_sort_key(path);
+	apply_file_status(fs::stat(path), key);
+	return key;
+}
+
+std::vector<entry_sort_key> make_sort_keys(const std::vector<std::filesystem::path>& paths, const std::atomic<bool>& cancelled) {
+	PROFILE_ZONE("sort_keys");
+	constexpr size_t paths_per_chunk{ 1024 };
+	std::vector<entry_sort_key> keys(paths.size());
+	parallel_for((paths.size() + paths_per_chunk - 1) / paths_per_chunk, [&](size_t chunk) {
+		if (cancelled) {
+			return;
+		}
+		const size_t begin{ chunk * paths_per_chunk };
+		const size_t end{ std::min(begin + paths_per_chunk, paths.size()) };
+		// the whole chunk is stat'ed in one batch, so the backend can have many in flight.
+		const auto statuses = fs::stat_many({ paths.begin() + begin, paths.begin() + end });
+		for (size_t i{ begin }; i < end; i++) {
+			keys[i] = make_name_sort_key(paths[i]);
+			apply_file_status(statuses[i - begin], keys[i]);
+		}
+	});
+	if (cancelled) {
+		return {};
+	}
+	return keys;
+}
+
+static bool has_tag(const std::string& tag_string, const std::string& tag) {
+	for (size_t start{ tag_string.find(tag) }; start != std::string::npos; start = tag_string.find(tag, start + 1)) {
+		const size_t end{ start + tag.size() };
+		if ((start == 0 || tag_string[start - 1] == ' ') && (end == tag_string.size() || tag_string[end] == ' ')) {
+			return true;
+		}
+	}
+	return false;
+}
+
+std::vector<uint32_t> sorted_order(const std::vector<entry_sort_key>& keys, const sort_options& options) {
+	std::vector<uint32_t> order(keys.size());
+	std::iota(order.begin(), order.end(), 0);
+	if (options.order == sort_order::none) {
+		return order;
+	}
+	std::vector<char> tag_presence;
+	if (options.order == sort_order::tag_presence) {
+		tag_presence.resize(keys.size());
+		parallel_for(keys.size(), [&](size_t i) {
+			tag_presence[i] = has_tag(keys[i].tags, options.tag);
+		});
+	}
+	// returns negative if a is ordered first, positive if b is ordered first, and zero if they are equal.
+	auto compare_primary = [&](uint32_t a, uint32_t b) -> int {
+		switch (options.order) {
+		case sort_order::modified_time: return (keys[a].modified_time > keys[b].modified_time) - (keys[a].modified_time < keys[b].modified_time);
+		case sort_order::size: return (keys[a].size > keys[b].size) - (keys[a].size < keys[b].size);
+		case sort_order::tag_count: return (keys[a].tag_count > keys[b].tag_count) - (keys[a].tag_count < keys[b].tag_count);
+		case sort_order::tag_presence: return tag_presence[b] - tag_presence[a]; // files with the tag first.
+		default: return keys[a].name.compare(keys[b].name);
+		}
+	};
+	parallel_sort(order, [&](uint32_t a, uint32_t b) {
+		if (keys[a].is_directory != keys[b].is_directory) {
+			return keys[a].is_directory;
+		}
+		if (int primary{ compare_primary(a, b) }; primary != 0) {
+			return options.descending ? primary > 0 : primary < 0;
+		}
+		if (int name{ keys[a].name.compare(keys[b].name) }; name != 0) {
+			return name < 0;
+		}
+		return a < b;
+	});
+	return order;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <filesystem>
+#include <atomic>
+#include <memory>
+
+enum class sort_order { none, name, modified_time, size, tag_count, tag_presence };
+
+struct sort_options {
+	sort_order order{ sort_order::none };
+	bool descending{ false };
+	std::string tag; // used when sorting by tag presence.
+};
+
+// Everything needed to sort one entry. The keys are created once per path list,
+// so sorting again with other options never has to touch the file system.
+struct entry_sort_key {
+	std::string name;
+	std::string tags;
+	int64_t modified_time{ 0 };
+	uint64_t size{ 0 };
+	uint32_t tag_count{ 0 };
+	bool is_directory{ false };
+};
+
+using sort_key_list = std::shared_ptr<const std::vector<entry_sort_key>>;
+
+// Case-folded name where digit runs compare by value, so "file2" comes before "file10" with a plain string comparison.
+std::string make_collation_key(std::string_view name);
+
+entry_sort_key make_sort_key(const std::filesystem::path& path);
+
+// Creates the keys for all paths in parallel. Returns an empty list if cancelled.
+std::vector<entry_sort_key> make_sort_keys(const std::vector<std::filesystem::path>& paths, const std::atomic<bool>& cancelled);
+
+// Returns the new position of every entry. Directories always come first.
+std::vector<uint32_t> sorted_order(const std::vector<entry_sort_key>& keys, const sort_options& options);
@@ -0,0 +1,637 @@
+#include "tags.hpp"
+#include "profiler.hpp"
+#include "filesystem.hpp"
+#include "io.hpp"
+#include "assets.hpp"
+#include "debug.hpp"
+
+#include <unordered_map>
+#include <queue>
+#include <atomic>
+
+namespace tags {
+
+struct tag_group {
+	std::string name;
+	std::vector<file_tag> tags;
+};
+
+// Sorted keys for prefix lookups. A sparse table finds the most used tag in any range of keys in constant time,
+// so the top results are found without looking at every tag with the prefix.
+struct tag_dictionary {
+
+	struct key {
+		std::string text;
+		uint32_t tag{ 0 };
+	};
+
+	std::vector<key> keys;
+	std::vector<std::string> names;
+	std::vector<std::vector<uint32_t>> most_used; // most_used[level][i] is the most used key in [i, i + 2^level)
+	uint64_t built_version{ 0 };
+	bool built{ false };
+
+	uint32_t key_usage(uint32_t key_index) const;
+	uint32_t most_used_in_range(size_t first, size_t last) const;
+	void build();
+	std::vector<std::string> complete(std::string_view prefix, size_t max_results) const;
+
+};
+
+struct implication {
+	std::string tag;
+	std::string implied_tag;
+};
+
+// implied_by[i] has a bit set for every tag that implies tag i, directly or through other tags.
+// Precomputed when the rules change, so expanding a tag in a query doesn't depend on how many rules there are.
+struct implication_closure {
+
+	std::vector<std::string> names;
+	std::unordered_map<std::string, uint32_t> indices;
+	std::vector<std::vector<uint64_t>> implied_by;
+	uint64_t built_version{ 0 };
+	bool built{ false };
+
+	void build();
+	std::vector<std::string> implying_tags(const std::string& tag) const;
+
+};
+
+static std::unordered_map<std::string, tag_group> groups;
+static std::filesystem::path registry_path;
+static std::unordered_map<std::string, uint32_t> usage_counts;
+static tag_dictionary dictionary;
+static uint64_t registry_version{ 0 };
+static std::vector<implication> implications;
+static implication_closure closure;
+static uint64_t implications_version{ 0 };
+static std::atomic<storage_mode> current_storage_mode{ storage_mode::file_name }; // read by the scan threads.
+
+static const char* tag_attribute_name{ "user.milky.tags" };
+
+void load() {
+	load(no::asset_path("milky.tags"));
+}
+
+void load(const std::filesystem::path& path) {
+	// todo: milky.tags should be a text format. maybe json? doing binary atm since it's easiest.
+	registry_path = path;
+	// loading another registry replaces the current one.
+	groups.clear();
+	implications.clear();
+	registry_version++;
+	implications_version++;
+	current_storage_mode = storage_mode::file_name;
+	no::io_stream stream;
+	no::file::read(registry_path, stream);
+	if (stream.empty()) {
+		create_group("default");
+		create_tag("default", "important");
+		create_tag("default", "note");
+		create_tag("default", "funny");
+		create_tag("default", "wallpaper");
+		create_tag("default", "cats");
+		return;
+	}
+	const auto group_count = stream.read<int32_t>();
+	for (int32_t group_index{ 0 }; group_index < group_count; group_index++) {
+		const auto group_name = stream.read<std::string>();
+		const auto tag_count = stream.read<int32_t>();
+		auto& group = groups[group_name];
+		for (int32_t tag_index{ 0 }; tag_index < tag_count; tag_index++) {
+			tags::file_tag tag;
+			tag.name = stream.read<std::string>();
+			tag.pretty_name = stream.read<std::string>();
+			tag.description = stream.read<std::string>();
+			tag.background_color = stream.read<no::vector4f>();
+			tag.text_color = stream.read<no::vector4f>();
+			if (!find_tag(tag.name)) {
+				group.tags.push_back(tag);
+			} else {
+				WARNING("Discarded duplicate tag " << tag.name);
+			}
+		}
+	}
+	// older registries end after the groups.
+	if (stream.size_left_to_read() >= sizeof(int32_t)) {
+		const auto implication_count = stream.read<int32_t>();
+		for (int32_t implication_index{ 0 }; implication_index < implication_count; implication_index++) {
+			auto& rule = implications.emplace_back();
+			rule.tag = stream.read<std::string>();
+			rule.implied_tag = stream.read<std::string>();
+		}
+	}
+	if (stream.size_left_to_read() >= sizeof(int32_t)) {
+		const auto mode = static_cast<storage_mode>(stream.read<int32_t>());
+		current_storage_mode = is_attribute_storage_supported() ? mode : storage_mode::file_name;
+	}
+}
+
+void save() {
+	no::io_stream stream;
+	stream.write(static_cast<int32_t>(groups.size()));
+	for (const auto& [group_name, group] : groups) {
+		stream.write(group_name);
+		stream.write(static_cast<int32_t>(group.tags.size()));
+		for (const auto& tag : group.tags) {
+			stream.write(tag.name);
+			stream.write(tag.pretty_name);
+			stream.write(tag.description);
+			stream.write(tag.background_color);
+			stream.write(tag.text_color);
+		}
+	}
+	stream.write(static_cast<int32_t>(implications.size()));
+	for (const auto& rule : implications) {
+		stream.write(rule.tag);
+		stream.write(rule.implied_tag);
+	}
+	stream.write(static_cast<int32_t>(current_storage_mode.load()));
+	no::file::write(registry_path, stream);
+}
+
+void create_group(const std::string& name) {
+	ASSERT(!group_exists(name));
+	groups.try_emplace(name);
+	tags::save();
+}
+
+void create_tag(const std::string& group, const std::string& tag) {
+	if (!find_tag(tag)) {
+		auto& new_tag = groups[group].tags.emplace_back();
+		new_tag.name = tag;
+		new_tag.pretty_name = tag;
+		registry_version++;
+		tags::save();
+	}
+}
+
+void create_tags(const std::string& group, const std::vector<std::string>& tags) {
+	auto& tag_list = groups[group].tags;
+	for (const auto& tag : tags) {
+		if (!find_tag(tag)) {
+			auto& new_tag = tag_list.emplace_back();
+			new_tag.name = tag;
+			new_tag.pretty_name = tag;
+		}
+	}
+	registry_version++;
+	tags::save();
+}
+
+void delete_tag(const std::string& name) {
+	registry_version++;
+	for (auto& [group_name, group] : groups) {
+		auto erased_tag = std::remove_if(group.tags.begin(), group.tags.end(), [name](auto& tag) {
+			return tag.name == name;
+		});
+		if (erased_tag != group.tags.end()) {
+			group.tags.erase(erased_tag);
+			break;
+		}
+	}
+}
+
+void rename_group(const std::string& name, const std::string& new_name) {
+	ASSERT(!group_exists(new_name));
+	groups[new_name] = groups[name];
+	groups.erase(name);
+	tags::save();
+}
+
+void delete_group(const std::string& name) {
+	// the tags are moved to the default group, so they are still recognized.
+	const auto& tags_in_group = groups[name].tags;
+	auto& destination_tags = groups["default"].tags;
+	destination_tags.insert(destination_tags.end(), tags_in_group.begin(), tags_in_group.end());
+	groups.erase(name);
+	tags::save();
+}
+
+std::vector<std::string> get_all_groups() {
+	return no::get_map_keys(groups);
+}
+
+bool group_exists(const std::string& name) {
+	return groups.find(name) != groups.end();
+}
+
+std::vector<std::string> get_all_tags_in_group(const std::string& name) {
+	std::vector<std::string> tags;
+	if (const auto group = groups.find(name); group != groups.end()) {
+		for (const auto& tag : group->second.tags) {
+			tags.push_back(tag.name);
+		}
+	}
+	return tags;
+}
+
+std::vector<std::string> get_all_tags() {
+	std::vector<std::string> tags;
+	for (const auto& [name, group] : groups) {
+		for (const auto& tag : group.tags) {
+			tags.push_back(tag.name);
+		}
+	}
+	return tags;
+}
+
+std::optional<file_tag> find_tag(const std::string& name) {
+	for (const auto& [group_name, group] : groups) {
+		for (const auto& tag : group.tags) {
+			if (tag.name == name) {
+				return tag;
+			}
+		}
+	}
+	return std::nullopt;
+}
+
+bool replace_tag(const std::string& tag_to_replace, const file_tag& new_tag) {
+	if (find_tag(new_tag.name) && tag_to_replace != new_tag.name) {
+		return false; // a tag with the new name already exists, and it's not the one being replaced.
+	}
+	for (auto& [group_name, group] : groups) {
+		for (auto& tag : group.tags) {
+			if (tag.name == tag_to_replace) {
+				if (tag.name != new_tag.name || tag.pretty_name != new_tag.pretty_name) {
+					registry_version++;
+				}
+				tag = new_tag;
+				tags::save();
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+std::optional<std::string> find_group_with_tag(const std::string& tag_name) {
+	for (auto& [group_name, group] : groups) {
+		for (auto& tag : group.tags) {
+			if (tag.name == tag_name) {
+				return group_name;
+			}
+		}
+	}
+	return std::nullopt;
+}
+
+std::string find_tag_string_in_path(const std::string& path) {
+	if (size_t start{ path.find('[') }; start != std::string::npos) {
+		if (size_t end{ path.find(']', start) }; end != std::string::npos) {
+			return path.substr(start + 1, end - start - 1);
+		}
+	}
+	return "";
+}
+
+std::string filename_without_tags(const std::string& filename) {
+	return no::erase_substring(filename, "[" + find_tag_string_in_path(filename) + "]");
+}
+
+// Tags are separated by spaces, but a tag is never empty, so extra spaces are skipped.
+static std::vector<std::string> split_tags(const std::string& tag_string) {
+	auto tags = no::split_string(tag_string, ' ');
+	tags.erase(std::remove(tags.begin(), tags.end(), ""), tags.end());
+	return tags;
+}
+
+std::vector<std::string> parse_tags(const std::string& filename) {
+	return split_tags(find_tag_string_in_path(filename));
+}
+
+std::string make_tag_string(std::vector<std::string> tags) {
+	if (tags.empty()) {
+		return "";
+	}
+	std::sort(tags.begin(), tags.end());
+	std::string result{ "[" };
+	for (const auto& tag : tags) {
+		result += tag + " ";
+	}
+	result.back() = ']';
+	return result;
+}
+
+std::filesystem::path rename_with_tags(const std::filesystem::path& path, const std::vector<std::string>& tags, std::error_code& error) {
+	PROFILE_ZONE("rename");
+	auto new_path = path;
+	new_path.remove_filename();
+	new_path /= std::filesystem::u8path(make_tag_string(tags) + filename_without_tags(path.filename().u8string()));
+	if (new_path != path) {
+		fs::rename(path, new_path, error);
+	}
+	return error ? path : new_path;
+}
+
+void set_storage_mode(storage_mode mode) {
+	if (mode != storage_mode::file_name && !is_attribute_storage_supported()) {
+		WARNING("Extended attributes are not supported on this platform.");
+		return;
+	}
+	current_storage_mode = mode;
+	tags::save();
+}
+
+storage_mode get_storage_mode() {
+	return current_storage_mode;
+}
+
+bool is_attribute_storage_supported() {
+#if defined(__linux__)
+	return true;
+#else
+	return false;
+#endif
+}
+
+std::vector<std::string> read_tags(const std::filesystem::path& path) {
+	const auto filename = path.filename().u8string();
+	if (!is_attribute_storage_supported()) {
+		return parse_tags(filename);
+	}
+	std::error_code error;
+	const auto attribute = fs::read_attribute(path, tag_attribute_name, error);
+	if (!attribute) {
+		return parse_tags(filename);
+	}
+	if (current_storage_mode != storage_mode::file_name) {
+		return split_tags(attribute.value());
+	}
+	// the tags written in an attribute mode are kept until the tags are written again, which moves them into the name.
+	auto tags = parse_tags(filename);
+	for (auto& tag : split_tags(attribute.value())) {
+		if (std::find(tags.begin(), tags.end(), tag) == tags.end()) {
+			tags.push_back(std::move(tag));
+		}
+	}
+	return tags;
+}
+
+std::filesystem::path write_tags(const std::filesystem::path& path, const std::vector<std::string>& tags, std::error_code& error) {
+	if (current_storage_mode == storage_mode::file_name) {
+		auto new_path = rename_with_tags(path, tags, error);
+		if (!error && is_attribute_storage_supported()) {
+			// the name has all the tags now, so the attribute would only bring back the removed tags.
+			std::error_code attribute_error;
+			fs::remove_attribute(new_path, tag_attribute_name, attribute_error);
+		}
+		return new_path;
+	}
+	PROFILE_ZONE("write_tags");
+	auto sorted_tags = tags;
+	std::sort(sorted_tags.begin(), sorted_tags.end());
+	std::string attribute;
+	for (const auto& tag : sorted_tags) {
+		attribute += attribute.empty() ? tag : " " + tag;
+	}
+	// an empty attribute is still written, since the name may have tags that were removed.
+	fs::write_attribute(path, tag_attribute_name, attribute, error);
+	if (error == std::errc::operation_not_supported) {
+		error = {};
+		return rename_with_tags(path, tags, error);
+	}
+	return path;
+}
+
+void add_implication(const std::string& tag, const std::string& implied_tag) {
+	if (tag == implied_tag) {
+		return;
+	}
+	for (const auto& rule : implications) {
+		if (rule.tag == tag && rule.implied_tag == implied_tag) {
+			return;
+		}
+	}
+	implications.push_back({ tag, implied_tag });
+	implications_version++;
+	tags::save();
+}
+
+void remove_implication(const std::string& tag, const std::string& implied_tag) {
+	implications.erase(std::remove_if(implications.begin(), implications.end(), [&](const auto& rule) {
+		return rule.tag == tag && rule.implied_tag == implied_tag;
+	}), implications.end());
+	implications_version++;
+	tags::save();
+}
+
+void replace_tag_in_implications(const std::string& tag, const std::string& new_tag) {
+	std::vector<implication> replaced_implications;
+	for (auto rule : implications) {
+		if (rule.tag == tag) {
+			rule.tag = new_tag;
+		}
+		if (rule.implied_tag == tag) {
+			rule.implied_tag = new_tag;
+		}
+		const bool is_duplicate{ std::any_of(replaced_implications.begin(), replaced_implications.end(), [&](const auto& other) {
+			return other.tag == rule.tag && other.implied_tag == rule.implied_tag;
+		}) };
+		if (!rule.tag.empty() && !rule.implied_tag.empty() && rule.tag != rule.implied_tag && !is_duplicate) {
+			replaced_implications.push_back(std::move(rule));
+		}
+	}
+	implications = std::move(replaced_implications);
+	implications_version++;
+	tags::save();
+}
+
+std::vector<std::string> get_direct_implications(const std::string& tag) {
+	std::vector<std::string> implied_tags;
+	for (const auto& rule : implications) {
+		if (rule.tag == tag) {
+			implied_tags.push_back(rule.implied_tag);
+		}
+	}
+	return implied_tags;
+}
+
+std::vector<std::string> get_implying_tags(const std::string& tag) {
+	if (!closure.built || closure.built_version != implications_version) {
+		closure.build();
+	}
+	return closure.implying_tags(tag);
+}
+
+uint64_t get_implications_version() {
+	return implications_version;
+}
+
+void implication_closure::build() {
+	names.clear();
+	indices.clear();
+	auto index_of = [this](const std::string& name) {
+		const auto [found, inserted] = indices.try_emplace(name, static_cast<uint32_t>(names.size()));
+		if (inserted) {
+			names.push_back(name);
+		}
+		return found->second;
+	};
+	std::vector<std::pair<uint32_t, uint32_t>> rules;
+	for (const auto& rule : implications) {
+		const uint32_t tag{ index_of(rule.tag) };
+		rules.emplace_back(tag, index_of(rule.implied_tag));
+	}
+	const size_t word_count{ (names.size() + 63) / 64 };
+	implied_by.assign(names.size(), std::vector<uint64_t>(word_count));
+	for (const auto& [tag, implied_tag] : rules) {
+		implied_by[implied_tag][tag / 64] |= 1ull << (tag % 64);
+	}
+	// warshall's algorithm on the bitsets. if k implies i, everything implying k also implies i.
+	for (size_t k{ 0 }; k < names.size(); k++) {
+		for (size_t i{ 0 }; i < names.size(); i++) {
+			if (i != k && (implied_by[i][k / 64] & (1ull << (k % 64)))) {
+				for (size_t word{ 0 }; word < word_count; word++) {
+					implied_by[i][word] |= implied_by[k][word];
+				}
+			}
+		}
+	}
+	built_version = implications_version;
+	built = true;
+}
+
+std::vector<std::string> implication_closure::implying_tags(const std::string& tag) const {
+	std::vector<std::string> result{ tag };
+	const auto index = indices.find(tag);
+	if (index == indices.end()) {
+		return result;
+	}
+	const auto& bits = implied_by[index->second];
+	for (size_t word{ 0 }; word < bits.size(); word++) {
+		if (bits[word] == 0) {
+			continue; // most words are empty when there are many rules.
+		}
+		for (size_t bit{ 0 }; bit < 64; bit++) {
+			const size_t i{ word * 64 + bit };
+			if (i != index->second && (bits[word] & (1ull << bit))) {
+				result.push_back(names[i]);
+			}
+		}
+	}
+	return result;
+}
+
+static std::string fold_case(std::string_view text) {
+	std::string folded{ text };
+	for (auto& character : folded) {
+		character = static_cast<char>(std::tolower(static_cast<unsigned char>(character)));
+	}
+	return folded;
+}
+
+uint32_t tag_dictionary::key_usage(uint32_t key_index) const {
+	return usage(names[keys[key_index].tag]);
+}
+
+uint32_t tag_dictionary::most_used_in_range(size_t first, size_t last) const {
+	size_t level{ 0 };
+	while ((static_cast<size_t>(2) << level) <= last - first + 1) {
+		level++;
+	}
+	const uint32_t a{ most_used[level][first] };
+	const uint32_t b{ most_used[level][last + 1 - (static_cast<size_t>(1) << level)] };
+	return key_usage(a) >= key_usage(b) ? a : b;
+}
+
+void tag_dictionary::build() {
+	keys.clear();
+	names.clear();
+	for (const auto& [group_name, group] : groups) {
+		for (const auto& tag : group.tags) {
+			const auto tag_index = static_cast<uint32_t>(names.size());
+			names.push_back(tag.name);
+			keys.push_back({ fold_case(tag.name), tag_index });
+			if (auto pretty_name = fold_case(tag.pretty_name); !pretty_name.empty() && pretty_name != keys.back().text) {
+				keys.push_back({ pretty_name, tag_index });
+			}
+		}
+	}
+	std::sort(keys.begin(), keys.end(), [](const auto& a, const auto& b) {
+		return a.text < b.text;
+	});
+	most_used.clear();
+	auto& first_level = most_used.emplace_back(keys.size());
+	for (uint32_t i{ 0 }; i < keys.size(); i++) {
+		first_level[i] = i;
+	}
+	for (size_t level{ 1 }; (static_cast<size_t>(1) << level) <= keys.size(); level++) {
+		const size_t half{ static_cast<size_t>(1) << (level - 1) };
+		const auto& previous = most_used[level - 1];
+		std::vector<uint32_t> current(keys.size() - (half * 2) + 1);
+		for (size_t i{ 0 }; i < current.size(); i++) {
+			const uint32_t a{ previous[i] };
+			const uint32_t b{ previous[i + half] };
+			current[i] = key_usage(a) >= key_usage(b) ? a : b;
+		}
+		most_used.push_back(std::move(current));
+	}
+	built_version = registry_version;
+	built = true;
+}
+
+std::vector<std::string> tag_dictionary::complete(std::string_view prefix, size_t max_results) const {
+	const auto folded_prefix = fold_case(prefix);
+	const auto first = std::lower_bound(keys.begin(), keys.end(), folded_prefix, [](const auto& key, const auto& text) {
+		return key.text < text;
+	});
+	const auto last = std::upper_bound(first, keys.end(), folded_prefix, [](const auto& text, const auto& key) {
+		return key.text.compare(0, text.size(), text) > 0;
+	});
+	struct key_range {
+		size_t first{ 0 };
+		size_t last{ 0 };
+		uint32_t best{ 0 };
+	};
+	auto less_used = [this](const key_range& a, const key_range& b) {
+		return key_usage(a.best) < key_usage(b.best);
+	};
+	std::priority_queue<key_range, std::vector<key_range>, decltype(less_used)> ranges{ less_used };
+	auto push_range = [&](size_t range_first, size_t range_last) {
+		if (range_first <= range_last && range_last < keys.size()) {
+			ranges.push({ range_first, range_last, most_used_in_range(range_first, range_last) });
+		}
+	};
+	if (first != last) {
+		push_range(first - keys.begin(), last - keys.begin() - 1);
+	}
+	std::vector<uint32_t> found_tags;
+	std::vector<std::string> results;
+	while (!ranges.empty() && results.size() < max_results) {
+		const auto range = ranges.top();
+		ranges.pop();
+		const uint32_t tag{ keys[range.best].tag };
+		if (std::find(found_tags.begin(), found_tags.end(), tag) == found_tags.end()) {
+			found_tags.push_back(tag);
+			results.push_back(names[tag]);
+		}
+		if (range.best > range.first) {
+			push_range(range.first, range.best - 1);
+		}
+		push_range(range.best + 1, range.last);
+	}
+	return results;
+}
+
+std::vector<std::string> complete(std::string_view prefix, size_t max_results) {
+	if (!dictionary.built || dictionary.built_version != registry_version) {
+		dictionary.build();
+	}
+	return dictionary.complete(prefix, max_results);
+}
+
+void add_usage(const std::string& tag, int64_t count) {
+	auto& usage = usage_counts[tag];
+	usage = static_cast<uint32_t>(std::max(static_cast<int64_t>(usage) + count, static_cast<int64_t>(0)));
+	registry_version++; // the ranking must be rebuilt.
+}
+
+uint32_t usage(const std::string& tag) {
+	const auto count = usage_counts.find(tag);
+	return count != usage_counts.end() ? count->second : 0;
+}
+
+}
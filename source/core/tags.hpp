@@ -0,0 +1,81 @@
+#pragma once
+
+#include "math.hpp"
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <optional>
+#include <filesystem>
+
+namespace tags {
+
+struct file_tag {
+	std::string name;
+	std::string pretty_name;
+	std::string description;
+	no::vector4f background_color{ 0.3f, 0.3f, 0.3f, 1.0f };
+	no::vector4f text_color{ 1.0f };
+};
+
+void load();
+void load(const std::filesystem::path& path);
+void save();
+void create_group(const std::string& name);
+void rename_group(const std::string& name, const std::string& new_name);
+void delete_group(const std::string& name);
+void create_tag(const std::string& group, const std::string& tag);
+// Same as create_tag, but the registry is only saved once.
+void create_tags(const std::string& group, const std::vector<std::string>& tags);
+void delete_tag(const std::string& tag);
+std::vector<std::string> get_all_groups();
+bool group_exists(const std::string& name);
+std::vector<std::string> get_all_tags_in_group(const std::string& name);
+std::vector<std::string> get_all_tags();
+std::optional<file_tag> find_tag(const std::string& name);
+bool replace_tag(const std::string& name, const file_tag& tag);
+std::optional<std::string> find_group_with_tag(const std::string& tag);
+
+std::string find_tag_string_in_path(const std::string& path);
+std::string filename_without_tags(const std::string& filename);
+std::vector<std::string> parse_tags(const std::string& filename);
+std::string make_tag_string(std::vector<std::string> tags);
+
+// Renames the file so its name has exactly these tags. Returns the new path, or the old path if it failed.
+std::filesystem::path rename_with_tags(const std::filesystem::path& path, const std::vector<std::string>& tags, std::error_code& error);
+
+// Where the tags of files are stored. The attribute modes keep the tags in the user.milky.tags extended attribute,
+// so tagging doesn't change the path. In the hybrid mode, the names can also be renamed to match the attributes on demand.
+// A file without the attribute has the tags in its name, so files tagged before the mode was changed keep their tags.
+// In the file name mode, the tags left in an attribute are still read, and writing the tags moves them into the name.
+enum class storage_mode { file_name, attribute, hybrid };
+
+void set_storage_mode(storage_mode mode);
+storage_mode get_storage_mode();
+// Only Linux has extended attributes. The filesystem may still not support them.
+bool is_attribute_storage_supported();
+
+// The tags of the file, from wherever the storage mode says they are. Safe to call from any thread.
+std::vector<std::string> read_tags(const std::filesystem::path& path);
+// Stores exactly these tags for the file. Returns the new path, which is the old path unless the file was renamed.
+// If the filesystem doesn't support extended attributes, the file is renamed instead. In the file name mode, the attribute is removed.
+std::filesystem::path write_tags(const std::filesystem::path& path, const std::vector<std::string>& tags, std::error_code& error);
+
+// A file with a tag also counts as having every tag it implies, directly or through other tags, when searching.
+// The file names are not changed. Rules are saved in the registry.
+void add_implication(const std::string& tag, const std::string& implied_tag);
+void remove_implication(const std::string& tag, const std::string& implied_tag);
+// Moves the rules to the new tag, or removes them if the new tag is empty.
+void replace_tag_in_implications(const std::string& tag, const std::string& new_tag);
+std::vector<std::string> get_direct_implications(const std::string& tag);
+// The tags that imply the tag, including the tag itself.
+std::vector<std::string> get_implying_tags(const std::string& tag);
+// Changed every time the rules change, so the queries expanded with the old rules can be expanded again.
+uint64_t get_implications_version();
+
+// Finds the tags where the name or pretty name starts with the prefix, ignoring case. The most used tags come first.
+std::vector<std::string> complete(std::string_view prefix, size_t max_results);
+void add_usage(const std::string& tag, int64_t count);
+uint32_t usage(const std::string& tag);
+
+}
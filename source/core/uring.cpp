@@ -0,0 +1,347 @@
+#include "uring.hpp"
+
+#if MILKY_IO_URING
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+namespace fs {
+
+namespace {
+
+enum class ring_status {
+	finished,
+	failed, // nothing is in flight anymore, so the buffers can be freed.
+	abandoned, // the operations in flight couldn't be waited for, so the kernel may still use the buffers.
+};
+
+// The memory the kernel reads from and writes into. It's leaked if the ring is abandoned with operations in flight.
+struct kernel_buffers {
+	std::vector<std::string> paths;
+	std::vector<struct statx> statuses;
+	std::vector<std::string> data;
+};
+
+void abandon(std::unique_ptr<kernel_buffers> buffers) {
+	buffers.release();
+}
+
+// A minimal io_uring without liburing. Only one thread uses a ring, and the kernel consumes the submissions
+// during io_uring_enter, so the submission head never has to be read.
+class submission_ring {
+public:
+
+	submission_ring(unsigned entries) {
+		io_uring_params params{};
+		fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+		if (fd < 0) {
+			return;
+		}
+		sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		const bool single_mmap{ (params.features & IORING_FEAT_SINGLE_MMAP) != 0 };
+		if (single_mmap) {
+			sq_ring_size = std::max(sq_ring_size, cq_ring_size);
+			cq_ring_size = sq_ring_size;
+		}
+		sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+		cq_ring = single_mmap ? sq_ring : mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+		void* sqes_memory{ mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES) };
+		if (sq_ring == MAP_FAILED || cq_ring == MAP_FAILED || sqes_memory == MAP_FAILED) {
+			if (sqes_memory != MAP_FAILED) {
+				munmap(sqes_memory, sqes_size);
+			}
+			close_ring();
+			return;
+		}
+		sqes = static_cast<io_uring_sqe*>(sqes_memory);
+		auto sq = static_cast<char*>(sq_ring);
+		sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+		sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+		sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+		auto cq = static_cast<char*>(cq_ring);
+		cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+		cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+		cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+		cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+		capacity = params.sq_entries;
+	}
+
+	submission_ring(const submission_ring&) = delete;
+	submission_ring(submission_ring&&) = delete;
+
+	~submission_ring() {
+		close_ring();
+	}
+
+	submission_ring& operator=(const submission_ring&) = delete;
+	submission_ring& operator=(submission_ring&&) = delete;
+
+	bool is_open() const {
+		return fd >= 0;
+	}
+
+	// The submissions of a failed run are still in the queue, and would be submitted with the next run.
+	bool must_reopen() const {
+		return has_failed;
+	}
+
+	// Calls prepare(index, sqe) for every operation, and complete(index, result) when it's done.
+	// The ring is kept full until all are submitted. If the ring fails, the operations in flight are waited for.
+	template<typename Prepare, typename Complete>
+	ring_status run(size_t count, Prepare&& prepare, Complete&& complete) {
+		size_t next{ 0 };
+		size_t completed{ 0 };
+		unsigned in_flight{ 0 }; // submitted to the kernel.
+		unsigned pending{ 0 }; // in the submission queue, but not consumed by the kernel yet.
+		while (completed < count) {
+			unsigned tail{ *sq_tail };
+			while (next < count && in_flight + pending < capacity) {
+				const unsigned index{ tail & sq_mask };
+				auto& sqe = sqes[index];
+				std::memset(&sqe, 0, sizeof(sqe));
+				prepare(next, sqe);
+				sqe.user_data = next;
+				sq_array[index] = index;
+				tail++;
+				next++;
+				pending++;
+			}
+			__atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+			// the kernel may consume fewer than asked for, and the rest are submitted again next time. only operations
+			// that are already in flight are waited for, since nothing would complete if none of these were consumed.
+			const unsigned min_complete{ in_flight > 0 ? 1u : 0u };
+			const long result{ syscall(__NR_io_uring_enter, fd, pending, min_complete, IORING_ENTER_GETEVENTS, nullptr, 0) };
+			if (result >= 0) {
+				pending -= static_cast<unsigned>(result);
+				in_flight += static_cast<unsigned>(result);
+			} else if (errno == EAGAIN || errno == EBUSY) {
+				// out of resources or the completion queue is full, which the completions below make room for.
+				if (in_flight == 0) {
+					std::this_thread::yield();
+				}
+			} else if (errno != EINTR) {
+				has_failed = true;
+				return reap(in_flight) ? ring_status::failed : ring_status::abandoned;
+			}
+			unsigned head{ *cq_head };
+			const unsigned ready_tail{ __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE) };
+			for (; head != ready_tail; head++) {
+				const auto& cqe = cqes[head & cq_mask];
+				complete(static_cast<size_t>(cqe.user_data), cqe.res);
+				completed++;
+				in_flight--;
+			}
+			__atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+		}
+		return ring_status::finished;
+	}
+
+private:
+
+	// Waits for the completions of a failed run, which are thrown away. They are posted to the completion queue even if
+	// io_uring_enter keeps failing, so it's polled for a while before giving up.
+	bool reap(unsigned in_flight) {
+		const auto give_up_time = std::chrono::steady_clock::now() + std::chrono::seconds{ 1 };
+		while (true) {
+			unsigned head{ *cq_head };
+			const unsigned ready_tail{ __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE) };
+			in_flight -= std::min(in_flight, ready_tail - head);
+			__atomic_store_n(cq_head, ready_tail, __ATOMIC_RELEASE);
+			if (in_flight == 0) {
+				return true;
+			}
+			if (syscall(__NR_io_uring_enter, fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR) {
+				if (std::chrono::steady_clock::now() > give_up_time) {
+					return false;
+				}
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	void close_ring() {
+		if (cq_ring != MAP_FAILED && cq_ring != sq_ring) {
+			munmap(cq_ring, cq_ring_size);
+		}
+		if (sq_ring != MAP_FAILED) {
+			munmap(sq_ring, sq_ring_size);
+		}
+		if (sqes) {
+			munmap(sqes, sqes_size);
+		}
+		if (fd >= 0) {
+			close(fd);
+		}
+		fd = -1;
+		sq_ring = MAP_FAILED;
+		cq_ring = MAP_FAILED;
+		sqes = nullptr;
+	}
+
+	int fd{ -1 };
+	bool has_failed{ false };
+	unsigned capacity{ 0 };
+	void* sq_ring{ MAP_FAILED };
+	void* cq_ring{ MAP_FAILED };
+	size_t sq_ring_size{ 0 };
+	size_t cq_ring_size{ 0 };
+	size_t sqes_size{ 0 };
+	io_uring_sqe* sqes{ nullptr };
+	unsigned* sq_tail{ nullptr };
+	unsigned* sq_array{ nullptr };
+	unsigned sq_mask{ 0 };
+	unsigned* cq_head{ nullptr };
+	unsigned* cq_tail{ nullptr };
+	unsigned cq_mask{ 0 };
+	io_uring_cqe* cqes{ nullptr };
+
+};
+
+constexpr unsigned statx_mask{ STATX_TYPE | STATX_MTIME | STATX_SIZE };
+
+submission_ring* thread_ring() {
+	thread_local std::unique_ptr<submission_ring> ring;
+	if (!ring || ring->must_reopen()) {
+		ring = std::make_unique<submission_ring>(uring_backend::queue_depth);
+	}
+	return ring->is_open() ? ring.get() : nullptr;
+}
+
+void prepare_statx(io_uring_sqe& sqe, const std::string& path, struct statx& buffer) {
+	sqe.opcode = IORING_OP_STATX;
+	sqe.fd = AT_FDCWD;
+	sqe.addr = reinterpret_cast<uintptr_t>(path.c_str());
+	sqe.len = statx_mask;
+	sqe.off = reinterpret_cast<uintptr_t>(&buffer);
+	sqe.statx_flags = AT_STATX_DONT_SYNC;
+}
+
+}
+
+bool uring_backend::is_supported() {
+	return submission_ring{ 2 }.is_open();
+}
+
+std::vector<file_status> uring_backend::stat_many(const std::vector<std::filesystem::path>& paths) {
+	auto ring = thread_ring();
+	if (!ring) {
+		return backend::stat_many(paths);
+	}
+	auto buffers = std::make_unique<kernel_buffers>();
+	buffers->paths.reserve(paths.size());
+	for (const auto& path : paths) {
+		buffers->paths.push_back(path.native());
+	}
+	buffers->statuses.resize(paths.size());
+	std::vector<file_status> statuses(paths.size());
+	const auto status = ring->run(paths.size(), [&](size_t index, io_uring_sqe& sqe) {
+		prepare_statx(sqe, buffers->paths[index], buffers->statuses[index]);
+	}, [&](size_t index, int result) {
+		if (result == 0) {
+			statuses[index] = from_statx(buffers->statuses[index]);
+		} else if (result == -EINVAL) {
+			std::error_code error;
+			statuses[index] = stat(paths[index], error); // the kernel is too old for this operation.
+		}
+	});
+	if (status == ring_status::abandoned) {
+		abandon(std::move(buffers));
+	}
+	return status == ring_status::finished ? statuses : backend::stat_many(paths);
+}
+
+std::vector<std::optional<std::string>> uring_backend::read_many(const std::vector<std::filesystem::path>& paths, size_t max_bytes) {
+	auto ring = thread_ring();
+	if (!ring) {
+		return backend::read_many(paths, max_bytes);
+	}
+	std::vector<std::optional<std::string>> files(paths.size());
+	// the files are read in windows, so no more than the queue depth are open at the same time.
+	for (size_t window_begin{ 0 }; window_begin < paths.size(); window_begin += queue_depth) {
+		const size_t count{ std::min<size_t>(queue_depth, paths.size() - window_begin) };
+		auto buffers = std::make_unique<kernel_buffers>();
+		for (size_t i{ 0 }; i < count; i++) {
+			buffers->paths.push_back(paths[window_begin + i].native());
+		}
+		buffers->statuses.resize(count);
+		buffers->data.resize(count);
+		std::vector<bool> has_size(count);
+		std::vector<int> descriptors(count, -1);
+		// the sizes are needed to allocate the buffers, so they are queried together with the opens.
+		auto status = ring->run(count * 2, [&](size_t index, io_uring_sqe& sqe) {
+			const auto& path = buffers->paths[index % count];
+			if (index < count) {
+				prepare_statx(sqe, path, buffers->statuses[index]);
+			} else {
+				sqe.opcode = IORING_OP_OPENAT;
+				sqe.fd = AT_FDCWD;
+				sqe.addr = reinterpret_cast<uintptr_t>(path.c_str());
+				sqe.open_flags = O_RDONLY | O_CLOEXEC;
+			}
+		}, [&](size_t index, int result) {
+			if (index < count) {
+				has_size[index] = result == 0;
+			} else {
+				descriptors[index - count] = result;
+			}
+		});
+		auto& data = buffers->data;
+		std::vector<size_t> pending;
+		for (size_t i{ 0 }; i < count; i++) {
+			if (status == ring_status::finished && has_size[i] && descriptors[i] >= 0) {
+				data[i].resize(static_cast<size_t>(std::min<uint64_t>(buffers->statuses[i].stx_size, max_bytes)));
+				pending.push_back(i);
+			}
+		}
+		if (status == ring_status::finished) {
+			status = ring->run(pending.size(), [&](size_t index, io_uring_sqe& sqe) {
+				const size_t i{ pending[index] };
+				sqe.opcode = IORING_OP_READ;
+				sqe.fd = descriptors[i];
+				sqe.addr = reinterpret_cast<uintptr_t>(data[i].data());
+				sqe.len = static_cast<uint32_t>(data[i].size());
+				sqe.off = 0;
+			}, [&](size_t index, int result) {
+				const size_t i{ pending[index] };
+				if (result >= 0) {
+					data[i].resize(static_cast<size_t>(result)); // shorter if the file shrank since the stat.
+					files[window_begin + i] = std::move(data[i]); // the kernel is done with the completed buffers.
+				}
+			});
+		}
+		const bool finished{ status == ring_status::finished };
+		if (status == ring_status::abandoned) {
+			abandon(std::move(buffers)); // the descriptors are left open too, since the kernel may still read from them.
+		} else {
+			for (const int descriptor : descriptors) {
+				if (descriptor >= 0) {
+					close(descriptor);
+				}
+			}
+		}
+		// fall back for the whole window if the ring failed, or for single files the kernel can't do.
+		for (size_t i{ 0 }; i < count; i++) {
+			if (!finished || (!files[window_begin + i] && (descriptors[i] == -EINVAL || !has_size[i]))) {
+				std::error_code error;
+				auto file = read(paths[window_begin + i], max_bytes, error);
+				files[window_begin + i] = error ? std::nullopt : std::make_optional(std::move(file));
+			}
+		}
+	}
+	return files;
+}
+
+}
+
+#endif
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "filesystem.hpp"
+
+#if defined(__linux__)
+#include <sys/stat.h>
+#endif
+
+namespace fs {
+
+#if defined(__linux__)
+file_status from_statx(const struct statx& status);
+#endif
+
+#if MILKY_IO_URING
+
+// Submits the batched stats and reads through io_uring, so hundreds of operations are in flight at once.
+// Every thread has its own ring, so batches can run on several threads without locking.
+// The single operations are the same as the native backend.
+class uring_backend : public native_backend {
+public:
+
+	static constexpr unsigned queue_depth{ 256 };
+
+	// False if the kernel is too old, or io_uring is blocked.
+	static bool is_supported();
+
+	std::vector<file_status> stat_many(const std::vector<std::filesystem::path>& paths) override;
+	std::vector<std::optional<std::string>> read_many(const std::vector<std::filesystem::path>& paths, size_t max_bytes) override;
+
+};
+
+#endif
+
+}
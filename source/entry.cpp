@@ -3,20 +3,270 @@
 #include "assets.hpp"
 #include "platform.hpp"
 #include "draw.hpp"
+#include "profiler.hpp"
+#include "filesystem.hpp"
+#include "parallel.hpp"
+#include "image.hpp"
+
+#include <cctype>
+
+thumbnail_cache::thumbnail_cache(size_t budget_bytes) : budget_bytes{ budget_bytes } {
+
+}
+
+std::shared_ptr<const decoded_image> thumbnail_cache::find(const std::filesystem::path& path, const fs::file_status& status, int size) {
+	std::lock_guard lock{ mutex };
+	auto found = thumbnails_by_key.find(make_key(path, status, size));
+	if (found == thumbnails_by_key.end()) {
+		return nullptr;
+	}
+	thumbnails.splice(thumbnails.begin(), thumbnails, found->second);
+	return found->second->image;
+}
+
+void thumbnail_cache::insert(const std::filesystem::path& path, const fs::file_status& status, int size, std::shared_ptr<const decoded_image> image) {
+	std::lock_guard lock{ mutex };
+	auto key = make_key(path, status, size);
+	if (auto found = thumbnails_by_key.find(key); found != thumbnails_by_key.end()) {
+		used_bytes -= found->second->image->pixels.size() * sizeof(uint32_t);
+		thumbnails.erase(found->second);
+		thumbnails_by_key.erase(found);
+	}
+	used_bytes += image->pixels.size() * sizeof(uint32_t);
+	thumbnails.push_front({ key, std::move(image) });
+	thumbnails_by_key.emplace(std::move(key), thumbnails.begin());
+	// the newest thumbnail is kept even if it alone is over the budget.
+	while (used_bytes > budget_bytes && thumbnails.size() > 1) {
+		auto& oldest = thumbnails.back();
+		used_bytes -= oldest.image->pixels.size() * sizeof(uint32_t);
+		thumbnails_by_key.erase(oldest.key);
+		thumbnails.pop_back();
+	}
+}
+
+std::string thumbnail_cache::make_key(const std::filesystem::path& path, const fs::file_status& status, int size) {
+	// a file that was changed gets a new key, and its old thumbnails are dropped when they are the least recently used.
+	return path.u8string() + '\n' + std::to_string(size) + '\n' + std::to_string(status.modified_time) + '\n' + std::to_string(status.size);
+}
+
+// the content decides the format, but other extensions are left to the platform without reading the file first.
+static bool is_decodable_extension(const std::filesystem::path& path) {
+	auto extension = path.extension().u8string();
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) {
+		return static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+	});
+	for (const char* decodable : { ".jpg", ".jpeg", ".jpe", ".jfif", ".png", ".webp" }) {
+		if (extension == decodable) {
+			return true;
+		}
+	}
+	return false;
+}
+
+int thumbnail_loader::level_for_size(float entry_size) {
+	for (const int size : level_sizes) {
+		if (static_cast<float>(size) >= entry_size) {
+			return size;
+		}
+	}
+	return level_sizes[std::size(level_sizes) - 1];
+}
+
+thumbnail_loader::thumbnail_loader(frame_scheduler& scheduler) : scheduler{ scheduler } {}
 
 void thumbnail_loader::load(std::filesystem::path path, int scale, int& destination) {
-	requests.push_back({ std::ref(destination), std::async(std::launch::async, no::platform::load_file_thumbnail, path, 256) });
+	cancel(destination);
+	auto& thumbnail = queued.emplace_back();
+	thumbnail.path = std::move(path);
+	thumbnail.size = scale;
+	requests.push_back({ &destination, thumbnail.promise.get_future() });
+}
+
+std::shared_ptr<const decoded_image> thumbnail_loader::find_cached(const std::filesystem::path& path, const fs::file_status& status, int size) {
+	for (const int level_size : level_sizes) {
+		if (level_size >= size) {
+			if (auto image = cache.find(path, status, level_size)) {
+				return image;
+			}
+		}
+	}
+	return nullptr;
+}
+
+void thumbnail_loader::reserve_bytes(size_t bytes) {
+	std::unique_lock lock{ bytes_mutex };
+	bytes_released.wait(lock, [&] {
+		return bytes_in_flight == 0 || bytes_in_flight + bytes <= max_bytes_in_flight;
+	});
+	bytes_in_flight += bytes;
+}
+
+void thumbnail_loader::release_bytes(size_t bytes) {
+	{
+		std::lock_guard lock{ bytes_mutex };
+		bytes_in_flight -= bytes;
+	}
+	bytes_released.notify_all();
+}
+
+void thumbnail_loader::start_batch() {
+	batches.push_back(std::async(std::launch::async, [this, batch{ std::move(queued) }]() mutable {
+		try {
+			load_batch(batch);
+		} catch (const std::exception& exception) {
+			WARNING("Failed to load thumbnails. Error: " << exception.what());
+		}
+		// the future of a request that never gets a result would never be ready.
+		for (auto& thumbnail : batch) {
+			if (!thumbnail.is_done) {
+				thumbnail.promise.set_value(std::nullopt);
+			}
+		}
+	}));
+	queued.clear();
+}
+
+void thumbnail_loader::load_batch(std::vector<queued_thumbnail>& batch) {
+	auto finish = [](queued_thumbnail& thumbnail, std::optional<no::surface> surface) {
+		thumbnail.promise.set_value(std::move(surface));
+		thumbnail.is_done = true;
+	};
+	auto make_surface = [](const decoded_image& image) {
+		return no::surface{ const_cast<uint32_t*>(image.pixels.data()), image.width, image.height, no::pixel_format::rgba, no::surface::construct_by::copy };
+	};
+	std::vector<std::filesystem::path> paths;
+	for (const auto& thumbnail : batch) {
+		paths.push_back(thumbnail.path);
+	}
+	// the status is part of the cache key, so a file that was changed is read again.
+	const auto statuses = fs::stat_many(paths);
+	std::vector<size_t> images;
+	std::vector<size_t> others;
+	for (size_t index{ 0 }; index < batch.size(); index++) {
+		auto& thumbnail = batch[index];
+		if (statuses[index].type != fs::file_type::file) {
+			finish(thumbnail, std::nullopt);
+		} else if (auto image = find_cached(thumbnail.path, statuses[index], thumbnail.size)) {
+			// a larger level is shrunk, which is cheaper than decoding.
+			if (image->width > thumbnail.size || image->height > thumbnail.size) {
+				image = std::make_shared<const decoded_image>(downscale_to_fit(*image, thumbnail.size));
+				cache.insert(thumbnail.path, statuses[index], thumbnail.size, image);
+			}
+			finish(thumbnail, make_surface(*image));
+		} else if (statuses[index].size <= max_image_file_size && is_decodable_extension(thumbnail.path)) {
+			// only the formats we decode ourselves are read, so each file is read once, by us or by the platform.
+			images.push_back(index);
+		} else {
+			others.push_back(index);
+		}
+	}
+	// anything we can't decode is left to the platform, which may know how to make a thumbnail for it.
+	auto load_platform_thumbnail = [&](size_t index) {
+		finish(batch[index], no::platform::load_file_thumbnail(batch[index].path, batch[index].size));
+	};
+	// the whole file is needed to decode, so only a window of images is kept in memory at a time.
+	size_t window_begin{ 0 };
+	while (window_begin < images.size()) {
+		size_t window_end{ window_begin };
+		size_t window_bytes{ 0 };
+		while (window_end < images.size() && window_end - window_begin < images_per_window) {
+			const size_t size{ static_cast<size_t>(statuses[images[window_end]].size) };
+			if (window_end > window_begin && window_bytes + size > max_bytes_in_flight) {
+				break;
+			}
+			window_bytes += size;
+			window_end++;
+		}
+		std::vector<std::filesystem::path> window_paths;
+		for (size_t i{ window_begin }; i < window_end; i++) {
+			window_paths.push_back(paths[images[i]]);
+		}
+		reserve_bytes(window_bytes);
+		try {
+			const auto files = fs::read_many(window_paths, max_image_file_size);
+			parallel_for(files.size(), [&](size_t i) {
+				PROFILE_ZONE("thumbnail_decode");
+				const size_t index{ images[window_begin + i] };
+				auto& thumbnail = batch[index];
+				if (files[i]) {
+					if (auto image = decode_thumbnail(files[i].value(), thumbnail.size)) {
+						auto cached = std::make_shared<const decoded_image>(std::move(image.value()));
+						cache.insert(thumbnail.path, statuses[index], thumbnail.size, cached);
+						finish(thumbnail, make_surface(*cached));
+						return;
+					}
+				}
+				load_platform_thumbnail(index);
+			});
+		} catch (...) {
+			release_bytes(window_bytes);
+			throw;
+		}
+		release_bytes(window_bytes);
+		window_begin = window_end;
+	}
+	parallel_for(others.size(), [&](size_t i) {
+		PROFILE_ZONE("thumbnail_decode");
+		load_platform_thumbnail(others[i]);
+	});
+}
+
+void thumbnail_loader::cancel(int& destination) {
+	// the future can't be abandoned without waiting for it, so the request is kept until it is ready.
+	for (auto& request : requests) {
+		if (request.destination == &destination) {
+			request.destination = nullptr;
+		}
+	}
 }
 
 void thumbnail_loader::update() {
-	for (int i{ 0 }; i < static_cast<int>(requests.size()); i++) {
-		auto& request = requests[i];
-		if (no::is_future_ready(request.future)) {
-			request.destination.get() = no::create_texture(request.future.get(), no::scale_option::linear, false);
-			requests.erase(requests.begin() + i);
-			i--;
+	if (!queued.empty()) {
+		start_batch();
+	}
+	batches.erase(std::remove_if(batches.begin(), batches.end(), [](const auto& batch) {
+		return no::is_future_ready(batch);
+	}), batches.end());
+	if (is_upload_posted) {
+		return;
+	}
+	const bool any_ready{ std::any_of(requests.begin(), requests.end(), [](const auto& request) {
+		return no::is_future_ready(request.future);
+	}) };
+	if (any_ready) {
+		// the textures are uploaded a few at a time, so a screen full of thumbnails doesn't stall one frame.
+		is_upload_posted = true;
+		post_upload();
+	}
+}
+
+void thumbnail_loader::post_upload() {
+	scheduler.post(task_priority::normal, "thumbnail_upload", [this] {
+		// posted again at the back of the queue instead of staying first, so the other tasks take turns with the uploads.
+		is_upload_posted = upload_next();
+		if (is_upload_posted) {
+			post_upload();
 		}
+		return false;
+	});
+}
+
+bool thumbnail_loader::upload_next() {
+	const auto ready = std::find_if(requests.begin(), requests.end(), [](const auto& request) {
+		return no::is_future_ready(request.future);
+	});
+	if (ready == requests.end()) {
+		return false;
 	}
+	if (auto surface = ready->future.get(); surface && ready->destination) {
+		// the previous level is shown until the new one is ready, so changing the zoom doesn't flicker.
+		if (*ready->destination != -1) {
+			no::delete_texture(*ready->destination);
+		}
+		*ready->destination = no::create_texture(surface.value(), no::scale_option::linear, false);
+	}
+	requests.erase(ready);
+	return true;
 }
 
 template<typename T>
@@ -28,31 +278,27 @@ std::vector<T> merge_vectors(const std::vector<T>& front, const std::vector<T>&
 	return result;
 }
 
-std::vector<directory_entry> directory_entry::load_from_directory(const std::filesystem::path& path) {
+std::vector<std::filesystem::path> directory_entry::paths_in_directory(const std::filesystem::path& path) {
 	std::vector<std::filesystem::path> directories;
 	std::vector<std::filesystem::path> files;
-	for (const auto& path : no::entries_in_directory(path, no::entry_inclusion::everything, false)) {
+	for (const auto& path : fs::enumerate(path, false)) {
 		if (no::platform::is_system_file(path)) {
 			continue;
 		}
 		if (path.filename().u8string().front() == '.') {
 			continue; // todo: this should be configurable.
 		}
-		if (std::filesystem::is_directory(path)) {
+		if (fs::is_directory(path)) {
 			directories.emplace_back(path);
 		} else {
 			files.emplace_back(path);
 		}
 	}
-	std::vector<directory_entry> entries;
-	for (const auto& path : merge_vectors(directories, files)) {
-		entries.emplace_back(path);
-	}
-	return entries;
+	return merge_vectors(directories, files);
 }
 
 std::vector<std::string> directory_entry::parse_tags(const std::filesystem::path& path) {
-	return no::split_string(tags::find_tag_string_in_path(path.filename().u8string()), ' ');
+	return tags::read_tags(path);
 }
 
 directory_entry::directory_entry(const std::filesystem::path& path) : path{ path } {
@@ -62,63 +308,82 @@ directory_entry::directory_entry(const std::filesystem::path& path) : path{ path
 }
 
 directory_entry::~directory_entry() {
-	no::delete_texture(thumbnail_texture);
+	if (thumbnail_texture != -1) {
+		no::delete_texture(thumbnail_texture);
+	}
 }
 
-void directory_entry::update() {
-	rename_if_needed();
+bool directory_entry::update() {
+	return write_tags_if_needed();
 }
 
-std::string directory_entry::tag_string() const {
-	if (tags.empty()) {
-		return "";
+void directory_entry::reset(const std::filesystem::path& new_path) {
+	if (thumbnail_texture != -1) {
+		no::delete_texture(thumbnail_texture);
 	}
-	std::string result{ "[" };
-	for (const auto& tag : tags) {
-		result += tag + " ";
+	*this = directory_entry{ new_path };
+}
+
+void directory_entry::clear() {
+	if (thumbnail_texture != -1) {
+		no::delete_texture(thumbnail_texture);
 	}
-	result.back() = ']';
-	return result;
+	path.clear();
+	transform = {};
+	thumbnail_texture = -1;
+	hovered = false;
+	double_clicked = false;
+	left_clicked = false;
+	right_clicked = false;
+	visible = false;
+	thumbnail_size = 0;
+	name.clear();
+	tags.clear();
+	needs_write = false;
+	write_failed = false;
+}
+
+std::string directory_entry::tag_string() const {
+	return tags::make_tag_string(tags);
 }
 
 std::string directory_entry::file_name() const {
 	return name;
 }
 
-void directory_entry::rename_if_needed() {
-	if (needs_rename) {
-		needs_rename = false;
-		rename_failed = false;
-		auto new_path = path;
-		new_path.remove_filename();
-		new_path /= std::filesystem::u8path(tag_string() + file_name());
-		std::error_code error;
-		std::filesystem::rename(path, new_path, error);
-		if (error) {
-			WARNING("Failed to rename from " << path << " to " << new_path << ". Error: " << error.message());
-			rename_failed = true;
-		} else {
-			path = new_path;
-		}
+bool directory_entry::write_tags_if_needed() {
+	if (!needs_write) {
+		return false;
 	}
+	needs_write = false;
+	write_failed = false;
+	std::error_code error;
+	const auto new_path = tags::write_tags(path, tags, error);
+	if (error) {
+		WARNING("Failed to write tags " << tag_string() << " to " << path << ". Error: " << error.message());
+		write_failed = true;
+		return false;
+	}
+	path = new_path;
+	return true;
 }
 
-bool directory_entry::is_rename_failing() const {
-	return rename_failed;
+bool directory_entry::is_tag_write_failing() const {
+	return write_failed;
 }
 
 void directory_entry::add_tag(const std::string& tag) {
 	if (!has_tag(tag)) {
 		tags.push_back(tag);
 		std::sort(tags.begin(), tags.end());
-		needs_rename = true;
+		needs_write = true;
 	}
 }
 
 void directory_entry::remove_tag(const std::string& tag) {
 	if (auto found_tag = std::find(tags.begin(), tags.end(), tag); found_tag != tags.end()) {
 		tags.erase(found_tag);
-		needs_rename = true;
+		needs_write = true;
 	}
 }
 
@@ -129,3 +394,18 @@ bool directory_entry::has_tag(const std::string& tag) {
 std::vector<std::string> directory_entry::get_tags() const {
 	return tags;
 }
+
+directory_entry& directory_entry_pool::acquire(const std::filesystem::path& path) {
+	if (free_entries.empty()) {
+		return *entries.emplace_back(std::make_unique<directory_entry>(path));
+	}
+	auto entry = free_entries.back();
+	free_entries.pop_back();
+	entry->reset(path);
+	return *entry;
+}
+
+void directory_entry_pool::release(directory_entry& entry) {
+	entry.clear();
+	free_entries.push_back(&entry);
+}
@@ -3,41 +3,130 @@
 #include "transform.hpp"
 #include "tags.hpp"
 #include "surface.hpp"
+#include "image.hpp"
+#include "frame_scheduler.hpp"
+#include "filesystem.hpp"
 
 #include <filesystem>
 #include <future>
+#include <optional>
+#include <list>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+
+// Decoded thumbnails, so scrolling back or changing the zoom level doesn't decode the file again.
+// The least recently used thumbnails are dropped when the budget is exceeded. Used from the loading threads.
+class thumbnail_cache {
+public:
+
+	static constexpr size_t default_budget_bytes{ 128 * 1024 * 1024 };
+
+	thumbnail_cache(size_t budget_bytes = default_budget_bytes);
+
+	// The status is the one the thumbnail was made from, so it's not found after the file is changed.
+	std::shared_ptr<const decoded_image> find(const std::filesystem::path& path, const fs::file_status& status, int size);
+	void insert(const std::filesystem::path& path, const fs::file_status& status, int size, std::shared_ptr<const decoded_image> image);
+
+private:
+
+	struct cached_thumbnail {
+		std::string key;
+		std::shared_ptr<const decoded_image> image;
+	};
+
+	static std::string make_key(const std::filesystem::path& path, const fs::file_status& status, int size);
+
+	std::mutex mutex;
+	std::list<cached_thumbnail> thumbnails; // most recently used first.
+	std::unordered_map<std::string, std::list<cached_thumbnail>::iterator> thumbnails_by_key;
+	size_t budget_bytes{ 0 };
+	size_t used_bytes{ 0 };
+
+};
 
 class thumbnail_loader {
 public:
 
+	static constexpr size_t max_image_file_size{ 64 * 1024 * 1024 };
+	static constexpr size_t images_per_window{ 64 };
+	static constexpr size_t max_bytes_in_flight{ 256 * 1024 * 1024 }; // for all batches together.
+
+	// The levels of detail thumbnails are made in. They match the sizes in the View menu.
+	static constexpr int level_sizes[]{ 96, 128, 256, 320 };
+
+	// The smallest level that is at least as large as the entry, or the largest level.
+	static int level_for_size(float entry_size);
+
 	struct thumbnail_request {
-		std::reference_wrapper<int> destination;
-		std::future<no::surface> future;
+		int* destination{ nullptr };
+		std::future<std::optional<no::surface>> future;
 	};
 
 	std::vector<thumbnail_request> requests;
 
+	thumbnail_loader(frame_scheduler& scheduler);
+	thumbnail_loader(const thumbnail_loader&) = delete;
+	thumbnail_loader(thumbnail_loader&&) = delete;
+
+	thumbnail_loader& operator=(const thumbnail_loader&) = delete;
+	thumbnail_loader& operator=(thumbnail_loader&&) = delete;
+
+	// Replaces the texture in destination when the thumbnail is ready. Earlier requests for the same destination are cancelled.
 	void load(std::filesystem::path path, int scale, int& destination);
+	void cancel(int& destination);
 	void update();
 
+private:
+
+	struct queued_thumbnail {
+		std::filesystem::path path;
+		int size{ 0 };
+		std::promise<std::optional<no::surface>> promise;
+		bool is_done{ false }; // the promise is set.
+	};
+
+	// The requests made during a frame are read as one batch, so the backend can have many reads in flight.
+	void start_batch();
+	void load_batch(std::vector<queued_thumbnail>& batch);
+
+	// A smaller level can be made from a larger cached level without reading the file.
+	std::shared_ptr<const decoded_image> find_cached(const std::filesystem::path& path, const fs::file_status& status, int size);
+
+	// Waits until the bytes can be read without going over the limit. A read larger than the limit waits for all others.
+	void reserve_bytes(size_t bytes);
+	void release_bytes(size_t bytes);
+
+	void post_upload();
+	// Uploads one ready thumbnail. Returns true if there may be more ready.
+	bool upload_next();
+
+	frame_scheduler& scheduler;
+	bool is_upload_posted{ false };
+	std::vector<queued_thumbnail> queued;
+	thumbnail_cache cache;
+	std::mutex bytes_mutex;
+	std::condition_variable bytes_released;
+	size_t bytes_in_flight{ 0 };
+	std::vector<std::future<void>> batches; // after the cache, since the batches use it until they are destroyed.
+
 };
 
 class directory_entry {
 public:
 
-	static std::vector<directory_entry> load_from_directory(const std::filesystem::path& path);
+	static std::vector<std::filesystem::path> paths_in_directory(const std::filesystem::path& path);
 	static std::vector<std::string> parse_tags(const std::filesystem::path& path);
 
 	std::filesystem::path path;
 	no::transform2 transform;
 	int thumbnail_texture{ -1 };
 	bool hovered{ false };
-	bool selected{ false };
 	bool double_clicked{ false };
 	bool left_clicked{ false };
 	bool right_clicked{ false };
 	bool visible{ false };
-	bool has_requested_thumbnail{ false };
+	int thumbnail_size{ 0 }; // the level of detail last requested, or 0 if none.
 
 	directory_entry(const std::filesystem::path& path);
 	directory_entry(const directory_entry&) = delete;
@@ -48,12 +137,17 @@ public:
 	directory_entry& operator=(const directory_entry&) = delete;
 	directory_entry& operator=(directory_entry&&) = default;
 
-	void update();
+	// Returns true if the tags were written this frame. The path is changed if the tags are stored in the name.
+	bool update();
+	void reset(const std::filesystem::path& new_path);
+
+	// Like reset, but without a new path, so the file system isn't touched.
+	void clear();
 
 	std::string tag_string() const;
 	std::string file_name() const;
 
-	bool is_rename_failing() const;
+	bool is_tag_write_failing() const;
 
 	void add_tag(const std::string& tag);
 	void remove_tag(const std::string& tag);
@@ -62,11 +156,26 @@ public:
 
 private:
 
-	void rename_if_needed();
+	bool write_tags_if_needed();
 
 	std::string name;
 	std::vector<std::string> tags;
-	bool needs_rename{ false };
-	bool rename_failed{ false };
+	bool needs_write{ false };
+	bool write_failed{ false };
+
+};
+
+// Entries are only created for the visible part of a directory or search result.
+// Released entries are kept here and reused, instead of allocating new entries while scrolling.
+class directory_entry_pool {
+public:
+
+	directory_entry& acquire(const std::filesystem::path& path);
+	void release(directory_entry& entry);
+
+private:
+
+	std::vector<std::unique_ptr<directory_entry>> entries;
+	std::vector<directory_entry*> free_entries;
 
 };
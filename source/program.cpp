@@ -7,21 +7,39 @@
 main_state::main_state() {
 	no::ui::create(window(), "calibril.ttf", 18);
 	tags::load();
+	search.saved_searches.load();
 	window().set_clear_color({ 27.0f / 256.0f,  27.0f / 256.0f, 27.0f / 256.0f });
 	set_synchronization(no::draw_synchronization::if_updated);
 	window().set_swap_interval(no::swap_interval::immediate);
-	tag_ui = std::make_unique<tag_system_ui>();
-	browser = std::make_unique<file_browser>(window(), mouse(), keyboard());
+	tag_ui = std::make_unique<tag_system_ui>(search.cache_list);
+	browser = std::make_unique<file_browser>(window(), mouse(), keyboard(), scheduler);
+	browser->on_entry_renamed = [this](const std::filesystem::path& from, const std::filesystem::path& to) {
+		search.cache_list.rename_path(from, to);
+	};
+	browser->on_retag_requested = [this](const tag_operation& operation, std::vector<std::filesystem::path> paths) {
+		tag_ui->retag_files(operation, std::move(paths));
+	};
+	tag_ui->set_on_paths_renamed([this](const manage_tag_ui::path_renames& renames) {
+		browser->rename_paths(renames);
+	});
 #if PLATFORM_WINDOWS
 	window().set_icon_from_resource(102);
 #endif
+	profiler_stats_timer.start();
 }
 
 main_state::~main_state() {
+	// the results are saved, so they can be shown before the next scan. the last save may still be running.
+	search.saved_searches.wait();
+	search.saved_searches.save(search.cache_list);
 	no::ui::destroy();
 }
 
 void main_state::update() {
+	PROFILE_ZONE("frame");
+	const auto filesystem_calls_before = fs::call_count();
+	// the tasks posted last frame are done before the interface is made, so it shows their results.
+	scheduler.run();
 	ImGui::BeginMainMenuBar();
 	if (ImGui::BeginMenu("Options")) {
 		ImGui::PushItemWidth(360.0f);
@@ -31,6 +49,16 @@ void main_state::update() {
 		ImGui::MenuItem("Double click to open directories", "", &browser->config.double_click_opens_directories);
 		ImGui::MenuItem("Double click to open files", "", &browser->config.double_click_opens_files);
 		ImGui::MenuItem("Show pretty name", "", &browser->config.show_pretty_name);
+		if (ImGui::MenuItem("Profiler", nullptr, &profiling)) {
+			profiler::set_enabled(profiling);
+		}
+		if (ImGui::MenuItem("Export profiler trace", nullptr, false, profiling)) {
+			if (profiler::export_chrome_trace("milky-trace.json")) {
+				INFO("Exported profiler trace to milky-trace.json");
+			} else {
+				WARNING("Failed to export profiler trace");
+			}
+		}
 		if (ImGui::MenuItem("Theme")) {
 			show_theme_options = true;
 		}
@@ -54,30 +82,49 @@ void main_state::update() {
 		ImGui::PopItemWidth();
 		ImGui::EndMenu();
 	}
+	if (ImGui::BeginMenu("Sort")) {
+		auto sorting = browser->sorting();
+		auto sort_item = [&](const char* label, sort_order order, const std::string& tag = "") {
+			if (ImGui::MenuItem(label, nullptr, sorting.order == order && sorting.tag == tag)) {
+				sorting.order = order;
+				sorting.tag = tag;
+				browser->sort_entries(sorting);
+			}
+		};
+		sort_item("Name", sort_order::name);
+		sort_item("Date modified", sort_order::modified_time);
+		sort_item("Size", sort_order::size);
+		sort_item("Tag count", sort_order::tag_count);
+		if (ImGui::BeginMenu("Has tag")) {
+			for (const auto& tag : tags::get_all_tags()) {
+				sort_item(tag.c_str(), sort_order::tag_presence, tag);
+			}
+			ImGui::EndMenu();
+		}
+		no::ui::separate();
+		if (ImGui::MenuItem("Descending", nullptr, &sorting.descending)) {
+			browser->sort_entries(sorting);
+		}
+		ImGui::EndMenu();
+	}
 	no::ui::colored_text({ 0.9f, 0.9f, 0.1f }, "\tFPS: %i", frame_counter().current_fps());
+	if (profiling) {
+		update_profiler_overlay();
+	}
 	if (no::ui::button("←")) {
 		browser->pop_history();
 	}
-	auto active_dir = browser->active_directory();
-	active_dir.make_preferred();
-	auto path_parts = no::split_string(active_dir.u8string(), std::filesystem::path::preferred_separator);
-	std::filesystem::path current_path_here;
-	for (const auto& path_part : path_parts) {
-		current_path_here /= path_part;
-		current_path_here.make_preferred();
-		if (path_part.empty()) {
+	update_breadcrumbs();
+	for (const auto& breadcrumb : breadcrumbs) {
+		if (breadcrumb.name.empty()) {
 			no::ui::text("/");
 			no::ui::inline_next();
 			continue; // for f.ex C://
 		}
-		std::error_code error_code{};
-		if (std::filesystem::equivalent(current_path_here, active_dir, error_code)) {
-			if (error_code.value() != 0) {
-				WARNING("File system error: " << error_code.message());
-			}
-			no::ui::text(path_part);
-		} else if (error_code.value() == 0 && no::ui::button(path_part)) {
-			browser->load_directory(current_path_here);
+		if (breadcrumb.is_active) {
+			no::ui::text(breadcrumb.name);
+		} else if (no::ui::button(breadcrumb.name)) {
+			browser->load_directory(breadcrumb.path);
 		}
 		no::ui::inline_next();
 		no::ui::text("/");
@@ -91,8 +138,20 @@ void main_state::update() {
 	
 	no::ui::push_static_window("##side", { 0.0f, 23.0f }, { 336.0f, static_cast<float>(window().size().y) - 23.0f });
 	tag_ui->update();
-	search.update(*browser);
+	search.update(*browser, scheduler);
 	no::ui::text("%i thumbnail requests", static_cast<int>(browser->loader.requests.size()));
+	no::ui::text("%i filesystem calls last frame", static_cast<int>(filesystem_calls_last_frame));
+	const auto& tasks = scheduler.last_frame();
+	no::ui::text("%i queued tasks (%i high, %i normal, %i low)", static_cast<int>(scheduler.queued_tasks()),
+		static_cast<int>(tasks.queued_tasks[0]), static_cast<int>(tasks.queued_tasks[1]), static_cast<int>(tasks.queued_tasks[2]));
+	no::ui::text("%i task steps in %.2f ms last frame", static_cast<int>(tasks.steps), static_cast<float>(tasks.microseconds) / 1000.0f);
+	if (const auto worst_task = scheduler.worst_overrun_task()) {
+		no::ui::text("%i frames over the task budget", static_cast<int>(scheduler.overrun_frames()));
+		no::ui::text("Worst: %s, %.2f ms over", worst_task, static_cast<float>(scheduler.worst_overrun_microseconds()) / 1000.0f);
+	}
+	if (browser->is_sorting()) {
+		no::ui::text("Sorting...");
+	}
 	no::ui::pop_window();
 
 	if (show_theme_options) {
@@ -113,6 +172,64 @@ void main_state::update() {
 		}
 		no::ui::pop_window();
 	}
+	filesystem_calls_last_frame = fs::call_count() - filesystem_calls_before;
+}
+
+void main_state::update_breadcrumbs() {
+	// the filesystem is only checked when the directory changes, since it can be slow on network drives.
+	auto active_directory = browser->active_directory();
+	active_directory.make_preferred();
+	if (active_directory == breadcrumb_directory && !breadcrumbs.empty()) {
+		return;
+	}
+	breadcrumb_directory = active_directory;
+	breadcrumbs.clear();
+	std::filesystem::path current_path_here;
+	for (const auto& path_part : no::split_string(active_directory.u8string(), std::filesystem::path::preferred_separator)) {
+		current_path_here /= path_part;
+		current_path_here.make_preferred();
+		breadcrumbs.push_back({ path_part, current_path_here, !path_part.empty() && fs::equivalent(current_path_here, active_directory) });
+	}
+}
+
+void main_state::update_profiler_overlay() {
+	// sorting all the events is too slow to do every frame.
+	if (profiler_stats_timer.milliseconds() >= 500) {
+		profiler_stats = profiler::collect_stats();
+		profiler_stats_timer.start();
+	}
+	const auto frame = std::find_if(profiler_stats.begin(), profiler_stats.end(), [](const auto& zone) {
+		return zone.name == "frame";
+	});
+	if (frame != profiler_stats.end()) {
+		no::ui::colored_text({ 0.6f, 0.8f, 0.9f }, "\tFrame p50: %.2f ms p99: %.2f ms", frame->p50_milliseconds, frame->p99_milliseconds);
+	} else {
+		no::ui::colored_text({ 0.6f, 0.8f, 0.9f }, "\tProfiling...");
+	}
+	if (ImGui::IsItemHovered()) {
+		ImGui::BeginTooltip();
+		ImGui::Columns(4);
+		no::ui::text("Zone");
+		ImGui::NextColumn();
+		no::ui::text("Count");
+		ImGui::NextColumn();
+		no::ui::text("p50 (ms)");
+		ImGui::NextColumn();
+		no::ui::text("p99 (ms)");
+		ImGui::NextColumn();
+		for (const auto& zone : profiler_stats) {
+			no::ui::text(zone.name);
+			ImGui::NextColumn();
+			no::ui::text("%i", static_cast<int>(zone.count));
+			ImGui::NextColumn();
+			no::ui::text("%.3f", zone.p50_milliseconds);
+			ImGui::NextColumn();
+			no::ui::text("%.3f", zone.p99_milliseconds);
+			ImGui::NextColumn();
+		}
+		ImGui::Columns(1);
+		ImGui::EndTooltip();
+	}
 }
 
 void main_state::draw() {
@@ -1,14 +1,19 @@
 #pragma once
 
-#include "tags.hpp"
+#include "tags_ui.hpp"
 #include "browser.hpp"
-#include "search.hpp"
+#include "search_ui.hpp"
 #include "loop.hpp"
+#include "timer.hpp"
+#include "profiler.hpp"
+#include "filesystem.hpp"
+#include "frame_scheduler.hpp"
 
 class main_state : public no::program_state {
 public:
 
 	bool limit_fps{ true };
+	bool profiling{ false };
 
 	main_state();
 	~main_state() override;
@@ -18,9 +23,24 @@ public:
 
 private:
 
+	struct breadcrumb {
+		std::string name;
+		std::filesystem::path path;
+		bool is_active{ false };
+	};
+
+	void update_breadcrumbs();
+	void update_profiler_overlay();
+
+	frame_scheduler scheduler; // before the browser and search, since their tasks refer to them.
 	std::unique_ptr<file_browser> browser;
-	std::unique_ptr<tag_system_ui> tag_ui;
 	search_ui search;
+	std::unique_ptr<tag_system_ui> tag_ui; // after search, since its background work uses the caches.
 	bool show_theme_options{ false };
+	std::vector<breadcrumb> breadcrumbs;
+	std::filesystem::path breadcrumb_directory;
+	uint64_t filesystem_calls_last_frame{ 0 };
+	std::vector<profiler::zone_stats> profiler_stats;
+	no::timer profiler_stats_timer;
 
 };
@@ -0,0 +1,220 @@
+#include "search_ui.hpp"
+#include "browser.hpp"
+#include "ui.hpp"
+
+void search_ui::select_tag_popup(const char* popup_id, bool include) {
+	if (!ImGui::BeginPopup(popup_id)) {
+		return;
+	}
+	if (const auto tag = picker.update()) {
+		if (include) {
+			include_tags.push_back(tag.value());
+		} else {
+			exclude_tags.push_back(tag.value());
+		}
+		must_update_browser = true;
+		ImGui::CloseCurrentPopup();
+	}
+	ImGui::EndPopup();
+}
+
+void search_ui::update(file_browser& browser, frame_scheduler& scheduler) {
+	if (cache_list.caches.empty()) {
+		if (!browser.config.default_open_path.empty()) {
+			cache_list.add_search_directory(browser.config.default_open_path);
+		}
+		return;
+	}
+	update_browser(browser, scheduler);
+	if (!ImGui::CollapsingHeader("Search##search-ui")) {
+		return;
+	}
+	ImGui::PushID("search");
+	no::ui::text("Name contains:");
+	const auto previous_name_filter = name_filter;
+	no::ui::input("##name-filter", name_filter);
+	if (name_filter != previous_name_filter) {
+		must_update_browser = true;
+	}
+	no::ui::text("Include tags:");
+	no::ui::inline_next();
+	for (int i{ 0 }; i < static_cast<int>(include_tags.size()); i++) {
+		const auto tag = tags::find_tag(include_tags[i]);
+		if (no::ui::button(tag->pretty_name)) {
+			include_tags.erase(include_tags.begin() + i);
+			i--;
+			must_update_browser = true;
+		}
+		no::ui::inline_next();
+	}
+	if (no::ui::button("+##open-context-include")) {
+		picker.reset();
+		ImGui::OpenPopup("##context-include-tag");
+	}
+	select_tag_popup("##context-include-tag", true);
+	no::ui::new_line();
+	no::ui::text("Exclude tags:");
+	no::ui::inline_next();
+	for (int i{ 0 }; i < static_cast<int>(exclude_tags.size()); i++) {
+		const auto tag = tags::find_tag(exclude_tags[i]);
+		if (no::ui::button(tag->pretty_name)) {
+			exclude_tags.erase(exclude_tags.begin() + i);
+			i--;
+			must_update_browser = true;
+		}
+		no::ui::inline_next();
+	}
+	if (no::ui::button("+##open-context-exclude")) {
+		picker.reset();
+		ImGui::OpenPopup("##context-exclude-tag");
+	}
+	select_tag_popup("##context-exclude-tag", false);
+	no::ui::new_line();
+	update_facets();
+	if (executor.is_busy()) {
+		no::ui::text("Searching...");
+	} else if (!last_result_stats.empty()) {
+		no::ui::text(last_result_stats);
+	}
+	update_saved_searches(browser);
+	ImGui::PopID();
+}
+
+void search_ui::update_browser(file_browser& browser, frame_scheduler& scheduler) {
+	cache_list.start_scans();
+	if (cache_list.has_finished_scans() && !is_scan_merge_posted) {
+		// the paths are moved on the change threads of the caches, but the tag usage is added to the registry here,
+		// a cache at a time, since it takes a while for a large scan.
+		is_scan_merge_posted = true;
+		scheduler.post(task_priority::low, "merge_scans", [this, next_cache = size_t{ 0 }, any_merged = false]() mutable {
+			if (next_cache < cache_list.caches.size()) {
+				any_merged |= cache_list.caches[next_cache]->update();
+				next_cache++;
+			}
+			if (next_cache < cache_list.caches.size()) {
+				return true;
+			}
+			is_scan_merge_posted = false;
+			if (any_merged && has_searched) {
+				must_update_browser = true; // a scan finished, so the last search is missing paths.
+			}
+			return false;
+		});
+	}
+	saved_searches.update(cache_list);
+	index_publisher.update(cache_list);
+	if (must_update_browser) {
+		must_update_browser = false;
+		has_searched = true;
+		search_query query;
+		query.include_tags = include_tags;
+		query.exclude_tags = exclude_tags;
+		query.name_contains = name_filter;
+		query.count_facets = true;
+		query.expand_implications();
+		for (const auto& cache : cache_list.caches) {
+			query.caches.push_back(cache.get());
+		}
+		last_submitted_generation = executor.submit(std::move(query));
+	}
+	if (auto result = executor.poll(); result && result->generation > ignored_generation) {
+		// loading the paths releases every visible entry, so it waits for its turn with the other tasks.
+		auto finished = std::make_shared<search_result>(std::move(result.value()));
+		scheduler.post(task_priority::high, "apply_search_result", [this, &browser, finished] {
+			if (finished->generation <= ignored_generation) {
+				return false; // a saved search was opened after.
+			}
+			last_result_stats = STRING(finished->paths.size() << " of " << finished->paths_searched << " paths in " << finished->milliseconds
+				<< " ms (" << static_cast<long long>(finished->paths_per_second()) << " paths/s, " << finished->thread_count << " threads)");
+			INFO("Filtered " << last_result_stats);
+			facets = std::move(finished->facets);
+			browser.load_paths(std::move(finished->paths));
+			return false;
+		});
+	}
+}
+
+void search_ui::update_facets() {
+	constexpr int max_facets{ 24 };
+	if (facets.empty()) {
+		return;
+	}
+	no::ui::text("Tags in results:");
+	int shown_facets{ 0 };
+	for (const auto& facet : facets) {
+		const bool is_included{ std::find(include_tags.begin(), include_tags.end(), facet.tag) != include_tags.end() };
+		const bool is_excluded{ std::find(exclude_tags.begin(), exclude_tags.end(), facet.tag) != exclude_tags.end() };
+		const auto tag = tags::find_tag(facet.tag);
+		if (is_included || is_excluded || !tag) {
+			continue;
+		}
+		ImGui::PushID(facet.tag.c_str());
+		if (no::ui::button("+")) {
+			include_tags.push_back(facet.tag);
+			must_update_browser = true;
+		}
+		no::ui::inline_next();
+		if (no::ui::button("-")) {
+			exclude_tags.push_back(facet.tag);
+			must_update_browser = true;
+		}
+		no::ui::inline_next();
+		no::ui::text("%s (%i)", tag->pretty_name.c_str(), static_cast<int>(facet.count));
+		ImGui::PopID();
+		if (++shown_facets == max_facets) {
+			break;
+		}
+	}
+}
+
+void search_ui::update_saved_searches(file_browser& browser) {
+	no::ui::separate();
+	no::ui::text("Saved searches:");
+	std::optional<std::string> removed_search;
+	for (const auto& search : saved_searches.searches()) {
+		ImGui::PushID(search.name.c_str());
+		if (no::ui::button(search.name)) {
+			open_saved_search(browser, search);
+		}
+		no::ui::inline_next();
+		if (no::ui::button("x")) {
+			removed_search = search.name;
+		}
+		ImGui::PopID();
+	}
+	if (removed_search) {
+		saved_searches.remove(removed_search.value(), cache_list);
+		saved_searches.save(cache_list);
+	}
+	no::ui::input("##saved-search-name", new_saved_search_name);
+	no::ui::inline_next();
+	if (new_saved_search_name.empty()) {
+		no::ui::begin_disabled();
+	}
+	if (no::ui::button("Save search")) {
+		saved_search search;
+		search.name = new_saved_search_name;
+		search.include_tags = include_tags;
+		search.exclude_tags = exclude_tags;
+		search.name_contains = name_filter;
+		saved_searches.add(std::move(search), cache_list);
+		new_saved_search_name = "";
+	}
+	if (new_saved_search_name.empty()) {
+		no::ui::end_disabled();
+	}
+}
+
+void search_ui::open_saved_search(file_browser& browser, const saved_search& search) {
+	// the view is already up to date, so there's nothing to search.
+	include_tags = search.include_tags;
+	exclude_tags = search.exclude_tags;
+	name_filter = search.name_contains;
+	must_update_browser = false;
+	has_searched = true;
+	ignored_generation = last_submitted_generation;
+	facets.clear();
+	auto paths = saved_searches.paths(search.name, cache_list);
+	last_result_stats = STRING(paths.size() << " paths in saved search " << search.name);
+	browser.load_paths(std::move(paths));
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "search.hpp"
+#include "saved_search.hpp"
+#include "shared_index.hpp"
+#include "frame_scheduler.hpp"
+#include "tags_ui.hpp"
+
+class file_browser;
+
+class search_ui {
+public:
+
+	search_path_cache_list cache_list;
+	saved_search_list saved_searches;
+	
+	void update(file_browser& browser, frame_scheduler& scheduler);
+
+private:
+
+	void select_tag_popup(const char* popup_id, bool include);
+	void update_browser(file_browser& browser, frame_scheduler& scheduler);
+	void update_facets();
+	void update_saved_searches(file_browser& browser);
+	void open_saved_search(file_browser& browser, const saved_search& search);
+
+	bool must_update_browser{ false };
+	bool has_searched{ false };
+	bool is_scan_merge_posted{ false };
+	std::vector<std::string> include_tags;
+	std::vector<std::string> exclude_tags;
+	std::string name_filter;
+	tag_picker picker;
+	search_executor executor;
+	std::string last_result_stats;
+	std::vector<tag_facet> facets; // the tags in the last result.
+	uint64_t last_submitted_generation{ 0 };
+	uint64_t ignored_generation{ 0 }; // results up to this are discarded, since a saved search was opened after.
+	std::string new_saved_search_name;
+	shared_index::publisher index_publisher; // after the caches, so it stops publishing before they are destroyed.
+
+};
@@ -0,0 +1,615 @@
+#include "tags_ui.hpp"
+
+#include "ui.hpp"
+#include "draw.hpp"
+#include "font.hpp"
+
+#include <unordered_map>
+#include <unordered_set>
+
+std::optional<std::string> tag_picker::update() {
+	constexpr size_t max_results{ 12 };
+	if (must_focus) {
+		ImGui::SetKeyboardFocusHere();
+		must_focus = false;
+	}
+	const auto previous_text = text;
+	no::ui::input("##tag-picker", text);
+	if (text != previous_text) {
+		highlighted = 0;
+	}
+	const auto results = tags::complete(text, max_results);
+	if (ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_DownArrow))) {
+		highlighted = std::min(highlighted + 1, static_cast<int>(results.size()) - 1);
+	} else if (ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_UpArrow))) {
+		highlighted = std::max(highlighted - 1, 0);
+	}
+	std::optional<std::string> picked;
+	if (!results.empty() && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Enter))) {
+		picked = results[std::clamp(highlighted, 0, static_cast<int>(results.size()) - 1)];
+	}
+	for (int i{ 0 }; i < static_cast<int>(results.size()); i++) {
+		const auto tag = tags::find_tag(results[i]);
+		const auto label = STRING(tag->pretty_name << " (" << tags::usage(tag->name) << ")##" << tag->name);
+		if (ImGui::Selectable(label.c_str(), i == highlighted)) {
+			picked = results[i];
+		}
+	}
+	if (results.empty()) {
+		no::ui::text("No matching tags.");
+	}
+	if (picked) {
+		reset();
+	}
+	return picked;
+}
+
+void tag_picker::reset() {
+	text = "";
+	highlighted = 0;
+	must_focus = true;
+}
+
+tag_system_ui::tag_system_ui(search_path_cache_list& caches) : caches{ caches }, manage_ui{ caches }, import_ui{ caches }, duplicates{ caches } {
+
+}
+
+void tag_system_ui::set_on_paths_renamed(std::function<void(const manage_tag_ui::path_renames& renames)> callback) {
+	manage_ui.on_paths_renamed = callback;
+	duplicates.on_paths_renamed = callback;
+	on_paths_renamed = std::move(callback);
+}
+
+void tag_system_ui::retag_files(const tag_operation& operation, std::vector<std::filesystem::path> paths) {
+	queued_file_retags.emplace_back(operation, std::move(paths));
+	update_file_retag();
+}
+
+void tag_system_ui::update_file_retag() {
+	if (file_retag) {
+		auto result = file_retag->finish();
+		if (!result) {
+			return;
+		}
+		file_retag = nullptr;
+		for (const auto& failure : result->failures) {
+			WARNING("Failed to write the tags of " << failure.path << ": " << failure.message);
+		}
+		if (on_paths_renamed) {
+			on_paths_renamed(result->renamed_paths);
+		}
+	}
+	// the next operation may write the same files, so it waits until the last one is done.
+	if (!queued_file_retags.empty()) {
+		auto [operation, paths] = std::move(queued_file_retags.front());
+		queued_file_retags.pop_front();
+		file_retag = std::make_unique<bulk_retag>(operation, std::move(paths), caches);
+	}
+}
+
+void tag_system_ui::update() {
+	update_file_retag();
+	if (!ImGui::CollapsingHeader("Tags##tag-manage")) {
+		return;
+	}
+	ImGui::PushID("tag-system");
+	ImGui::PushItemWidth(144.0f);
+	update_storage_mode();
+	groups_ui.update();
+	import_ui.update();
+	duplicates.update();
+	no::ui::separate();
+	new_tag_group = no::ui::combo("##tag-group", tags::get_all_groups(), new_tag_group).value_or(new_tag_group);
+	no::ui::inline_next();
+	no::ui::input("##new-tag-name", new_tag_name);
+	ImGui::PopItemWidth();
+	no::ui::inline_next();
+	if (no::ui::button("+##save-new-tag")) {
+		tags::create_tag(tags::get_all_groups()[new_tag_group], new_tag_name);
+		new_tag_name = "";
+	}
+	for (auto& group : tags::get_all_groups()) {
+		ImGui::PushID(group.c_str());
+		if (ImGui::CollapsingHeader(group.c_str())) {
+			const int selected_in_group{ group == selected_group ? selected_tag : -1 };
+			if (const auto new_selected_tag = no::ui::list("##tags", tags::get_all_tags_in_group(group), selected_in_group)) {
+				selected_group = group; // todo: set group to proper value
+				selected_tag = new_selected_tag.value();
+				manage_ui.open(tags::get_all_tags_in_group(group)[selected_tag]);
+			}
+		}
+		ImGui::PopID();
+	}
+	manage_ui.update();
+	ImGui::PopID();
+}
+
+void tag_system_ui::update_storage_mode() {
+	if (!tags::is_attribute_storage_supported()) {
+		return;
+	}
+	const std::vector<std::string> modes{ "File names", "Attributes", "Attributes, mirrored to file names" };
+	const auto mode = static_cast<int>(tags::get_storage_mode());
+	no::ui::text("Store tags in");
+	no::ui::inline_next();
+	if (const auto new_mode = no::ui::combo("##storage-mode", modes, mode); new_mode && new_mode.value() != mode) {
+		tags::set_storage_mode(static_cast<tags::storage_mode>(new_mode.value()));
+		caches.rescan(); // the tags of the files may be read from somewhere else now.
+	}
+	if (tags::get_storage_mode() == tags::storage_mode::hybrid) {
+		const bool is_retagging{ manage_ui.is_retagging() };
+		if (is_retagging) {
+			no::ui::begin_disabled();
+		}
+		if (no::ui::button("Mirror tags into file names")) {
+			manage_ui.mirror_tags_to_names();
+		}
+		if (is_retagging) {
+			no::ui::end_disabled();
+		}
+	}
+}
+
+manage_tag_ui::manage_tag_ui(search_path_cache_list& caches) : caches{ caches } {
+
+}
+
+void manage_tag_ui::open(const std::string& name) {
+	close();
+	tag = tags::find_tag(name);
+	original_name = name;
+	selected_group = 0;
+	// todo: this really needs to be cleaned up lol... searching like this smh
+	if (auto group = tags::find_group_with_tag(name)) {
+		for (const auto& group_name : tags::get_all_groups()) {
+			if (group_name == group) {
+				break;
+			}
+			selected_group++;
+		}
+	}
+}
+
+void manage_tag_ui::close() {
+	tag = std::nullopt;
+	original_name = "";
+}
+
+void manage_tag_ui::update() {
+	update_retag();
+	if (!tag.has_value()) {
+		return;
+	}
+	ImGui::PushID("manage-tag");
+	no::ui::input("Name", tag->name);
+	no::ui::input("Pretty name", tag->pretty_name);
+	no::ui::text("Description");
+	no::ui::input("##description", tag->description, { -1.0f, 64.0f });
+
+	const auto old_group = selected_group;
+	selected_group = no::ui::combo("##group", tags::get_all_groups(), selected_group).value_or(selected_group);
+	if (old_group != selected_group) {
+		const auto selected_group_name = tags::get_all_groups()[selected_group];
+		tags::delete_tag(tag->name);
+		tags::create_tag(selected_group_name, tag->name); // todo: make this accept the tag instead of string?
+		tags::replace_tag(tag->name, tag.value());
+	}
+
+	ImGui::ColorEdit3("Background", &tag->background_color.x);
+	ImGui::ColorEdit3("Text", &tag->text_color.x);
+	auto temporary_tag = tag.value();
+	temporary_tag.name = original_name;
+	tags::replace_tag(original_name, temporary_tag);
+
+	// searching for an implied tag also finds the files with this tag.
+	no::ui::text("Implies:");
+	no::ui::inline_next();
+	for (const auto& implied_tag : tags::get_direct_implications(original_name)) {
+		ImGui::PushID(implied_tag.c_str());
+		if (no::ui::button(implied_tag)) {
+			tags::remove_implication(original_name, implied_tag);
+		}
+		ImGui::PopID();
+		no::ui::inline_next();
+	}
+	if (no::ui::button("+##open-implication")) {
+		implication_picker.reset();
+		ImGui::OpenPopup("##implication-tag");
+	}
+	if (ImGui::BeginPopup("##implication-tag")) {
+		if (const auto implied_tag = implication_picker.update()) {
+			tags::add_implication(original_name, implied_tag.value());
+			ImGui::CloseCurrentPopup();
+		}
+		ImGui::EndPopup();
+	}
+	no::ui::new_line();
+
+	// the files are renamed first, and the registry is changed when all of them are done.
+	const bool is_retagging{ retag != nullptr };
+	if (is_retagging) {
+		no::ui::begin_disabled();
+	}
+	if (tag->name != original_name) {
+		if (tag->name.empty() || tag->name.find_first_of(" []") != std::string::npos) {
+			no::ui::colored_text({ 1.0f, 0.8f, 0.8f }, "Tags can't be empty or have spaces or brackets.");
+		} else if (tags::find_tag(tag->name)) {
+			if (no::ui::button("Merge into " + tag->name)) {
+				start_retag(tag_operation_kind::merge, tag->name);
+			}
+		} else if (no::ui::button("Rename in files")) {
+			start_retag(tag_operation_kind::rename, tag->name);
+		}
+	}
+	if (no::ui::button("Delete")) {
+		start_retag(tag_operation_kind::remove, "");
+	}
+	if (is_retagging) {
+		no::ui::end_disabled();
+	}
+	ImGui::PopID();
+}
+
+void manage_tag_ui::mirror_tags_to_names() {
+	last_retag_result = std::nullopt;
+	retag = std::make_unique<bulk_retag>(tag_operation{ tag_operation_kind::mirror }, caches);
+}
+
+bool manage_tag_ui::is_retagging() const {
+	return retag != nullptr;
+}
+
+void manage_tag_ui::start_retag(tag_operation_kind kind, const std::string& new_tag) {
+	last_retag_result = std::nullopt;
+	retag = std::make_unique<bulk_retag>(tag_operation{ kind, original_name, new_tag }, caches);
+}
+
+void manage_tag_ui::update_retag() {
+	if (retag) {
+		if (auto result = retag->finish()) {
+			last_retag_operation = retag->operation();
+			last_retag_result = std::move(result);
+			retag = nullptr;
+			if (on_paths_renamed) {
+				on_paths_renamed(last_retag_result->renamed_paths);
+			}
+			// the registry has changed, so the tag being edited must be reloaded. it's only changed if every file was written.
+			if (original_name == last_retag_operation.tag && last_retag_result->failures.empty()) {
+				if (last_retag_operation.kind == tag_operation_kind::remove) {
+					close();
+				} else {
+					open(last_retag_operation.new_tag);
+				}
+			}
+		} else {
+			const auto done = static_cast<int>(retag->files_done());
+			const auto total = static_cast<int>(retag->file_count());
+			if (retag->operation().kind == tag_operation_kind::mirror) {
+				no::ui::text("Mirroring tags into file names: %i of %i", done, total);
+			} else {
+				no::ui::text("Changing the tags of files with %s: %i of %i", retag->operation().tag.c_str(), done, total);
+			}
+			ImGui::ProgressBar(total > 0 ? static_cast<float>(done) / static_cast<float>(total) : 1.0f);
+		}
+	}
+	if (!last_retag_result) {
+		return;
+	}
+	ImGui::PushID("retag-result");
+	if (last_retag_operation.kind == tag_operation_kind::mirror) {
+		no::ui::text("Renamed %i files to match their tags.", static_cast<int>(last_retag_result->renamed_paths.size()));
+	} else {
+		no::ui::text("Changed the tags of %i files with %s.", static_cast<int>(last_retag_result->renamed_paths.size()), last_retag_operation.tag.c_str());
+	}
+	if (!last_retag_result->failures.empty()) {
+		no::ui::colored_text({ 1.0f, 0.8f, 0.8f }, "%i files could not be changed.", static_cast<int>(last_retag_result->failures.size()));
+		if (last_retag_operation.kind != tag_operation_kind::mirror) {
+			no::ui::text("The tag was kept in the registry, since some files still have it.");
+		}
+		if (ImGui::TreeNode("Failures")) {
+			for (const auto& failure : last_retag_result->failures) {
+				no::ui::text(STRING(failure.path.u8string() << ": " << failure.message));
+			}
+			ImGui::TreePop();
+		}
+	}
+	if (no::ui::button("Dismiss")) {
+		last_retag_result = std::nullopt;
+	}
+	ImGui::PopID();
+}
+
+void manage_tag_groups_ui::update() {
+	if (!ImGui::CollapsingHeader("Groups##group-header")) {
+		return;
+	}
+	ImGui::PushID("manage-groups");
+	const bool any_group_is_being_renamed{ !new_group_name.empty() };
+	if (any_group_is_being_renamed) {
+		no::ui::begin_disabled();
+	}
+	no::ui::input("##new-group", new_group_name_to_create);
+	if (any_group_is_being_renamed) {
+		no::ui::end_disabled();
+	}
+	const bool new_group_already_exists{ tags::group_exists(new_group_name_to_create) };
+	if (new_group_already_exists) {
+		no::ui::begin_disabled();
+	}
+	no::ui::inline_next();
+	if (no::ui::button("Create group")) {
+		tags::create_group(new_group_name_to_create);
+		new_group_name_to_create = "";
+	}
+	if (new_group_already_exists) {
+		no::ui::end_disabled();
+		no::ui::colored_text({ 1.0f, 0.8f, 0.8f }, "Group already exists.");
+	}
+	for (const auto& group : tags::get_all_groups()) {
+		const bool is_default_group{ group == "default" };
+		ImGui::PushID(group.c_str());
+		if (is_default_group || any_group_is_being_renamed) {
+			no::ui::begin_disabled();
+		}
+		if (no::ui::button("Delete")) {
+			tags::delete_group(group);
+		}
+		if (is_default_group || any_group_is_being_renamed) {
+			no::ui::end_disabled();
+		}
+		no::ui::inline_next();
+		if (group_to_rename.empty()) {
+			no::ui::inline_next();
+			if (is_default_group || any_group_is_being_renamed) {
+				no::ui::begin_disabled();
+			}
+			if (no::ui::button("Rename")) {
+				group_to_rename = group;
+				new_group_name = group;
+			}
+			if (is_default_group || any_group_is_being_renamed) {
+				no::ui::end_disabled();
+			}
+			no::ui::inline_next();
+			no::ui::text(group);
+		} else if (group_to_rename == group) {
+			no::ui::text(group);
+			no::ui::input("##new-name", new_group_name);
+			const bool group_already_exists{ tags::group_exists(new_group_name) };
+			if (group_already_exists) {
+				no::ui::begin_disabled();
+			}
+			no::ui::inline_next();
+			if (no::ui::button("Save") && !group_already_exists) {
+				tags::rename_group(group_to_rename, new_group_name);
+			}
+			if (group_already_exists) {
+				no::ui::end_disabled();
+			}
+			no::ui::inline_next();
+			if (no::ui::button("Cancel")) {
+				group_to_rename = "";
+				new_group_name = "";
+			}
+			if (group_already_exists) {
+				no::ui::colored_text({ 1.0f, 0.8f, 0.8f }, "Group already exists.");
+			}
+		}
+		ImGui::PopID();
+	}
+	ImGui::PopID();
+}
+
+import_tags_ui::import_tags_ui(search_path_cache_list& caches) : caches{ caches } {
+
+}
+
+void import_tags_ui::discover() {
+	std::vector<const search_path_cache*> searched_caches;
+	for (const auto& cache : caches.caches) {
+		searched_caches.push_back(cache.get());
+	}
+	// the caches are locked while counting, so it's done in the background instead of stalling the frame.
+	future_discovery = std::async(std::launch::async, [searched_caches] {
+		return discover_tags(searched_caches);
+	});
+}
+
+void import_tags_ui::update_discovery() {
+	if (!future_discovery.valid() || !no::is_future_ready(future_discovery)) {
+		return;
+	}
+	unknown_tags = future_discovery.get();
+	// the registry may have changed while counting, and is only read here on the thread that changes it.
+	mark_registered_tags(unknown_tags);
+	unknown_tags.erase(std::remove_if(unknown_tags.begin(), unknown_tags.end(), [](const auto& tag) {
+		return tag.is_registered;
+	}), unknown_tags.end());
+	selected.assign(unknown_tags.size(), true);
+	has_discovered = true;
+}
+
+void import_tags_ui::update() {
+	if (!ImGui::CollapsingHeader("Import tags##import-header")) {
+		return;
+	}
+	ImGui::PushID("import-tags");
+	update_discovery();
+	if (future_discovery.valid()) {
+		no::ui::text("Finding tags in files...");
+	} else if (no::ui::button("Find tags in files")) {
+		discover();
+	}
+	if (!has_discovered) {
+		ImGui::PopID();
+		return;
+	}
+	if (unknown_tags.empty()) {
+		no::ui::text("All tags in the searched files are known.");
+		ImGui::PopID();
+		return;
+	}
+	no::ui::inline_next();
+	if (no::ui::button("All")) {
+		selected.assign(unknown_tags.size(), true);
+	}
+	no::ui::inline_next();
+	if (no::ui::button("None")) {
+		selected.assign(unknown_tags.size(), false);
+	}
+	for (size_t i{ 0 }; i < unknown_tags.size(); i++) {
+		bool is_selected{ selected[i] };
+		if (ImGui::Checkbox(CSTRING(unknown_tags[i].name << " (" << unknown_tags[i].file_count << ")##" << i), &is_selected)) {
+			selected[i] = is_selected;
+		}
+	}
+	const auto groups = tags::get_all_groups();
+	group = no::ui::combo("##import-group", groups, std::min(group, static_cast<int>(groups.size()) - 1)).value_or(group);
+	no::ui::inline_next();
+	if (no::ui::button("Import") && group < static_cast<int>(groups.size())) {
+		std::vector<std::string> tags_to_import;
+		for (size_t i{ 0 }; i < unknown_tags.size(); i++) {
+			if (selected[i]) {
+				tags_to_import.push_back(unknown_tags[i].name);
+			}
+		}
+		tags::create_tags(groups[group], tags_to_import);
+		INFO("Imported " << tags_to_import.size() << " tags into " << groups[group]);
+		discover();
+	}
+	ImGui::PopID();
+}
+
+duplicates_ui::duplicates_ui(search_path_cache_list& caches) : caches{ caches } {
+
+}
+
+void duplicates_ui::update() {
+	if (!ImGui::CollapsingHeader("Duplicates##duplicates-header")) {
+		return;
+	}
+	ImGui::PushID("duplicates");
+	update_merge();
+	update_search();
+	if (!last_result) {
+		ImGui::PopID();
+		return;
+	}
+	uint64_t wasted_bytes{ 0 };
+	for (const auto& group : last_result->groups) {
+		wasted_bytes += group.wasted_bytes();
+	}
+	no::ui::text("%i groups of copies, %.1f MiB wasted.", static_cast<int>(last_result->groups.size()), static_cast<double>(wasted_bytes) / (1024.0 * 1024.0));
+	if (!merge_failures.empty()) {
+		no::ui::colored_text({ 1.0f, 0.8f, 0.8f }, "%i files could not be renamed.", static_cast<int>(merge_failures.size()));
+		if (ImGui::TreeNode("Failures")) {
+			for (const auto& failure : merge_failures) {
+				no::ui::text(STRING(failure.path.u8string() << ": " << failure.message));
+			}
+			ImGui::TreePop();
+		}
+	}
+	if (merge) {
+		no::ui::text("Merging tags: %i of %i groups", static_cast<int>(merge->groups_done()), static_cast<int>(merge->group_count()));
+		ImGui::ProgressBar(static_cast<float>(merge->groups_done()) / static_cast<float>(std::max(merge->group_count(), size_t{ 1 })));
+	} else if (no::ui::button("Merge tags of all copies")) {
+		std::vector<size_t> group_indices;
+		for (size_t i{ 0 }; i < last_result->groups.size(); i++) {
+			if (!last_result->groups[i].has_same_tags) {
+				group_indices.push_back(i);
+			}
+		}
+		start_merge(std::move(group_indices));
+	}
+	// there can be many thousands of groups, so only the largest are listed.
+	constexpr size_t max_listed_groups{ 100 };
+	for (size_t i{ 0 }; i < std::min(last_result->groups.size(), max_listed_groups); i++) {
+		const auto& group = last_result->groups[i];
+		ImGui::PushID(static_cast<int>(i));
+		if (ImGui::TreeNode(CSTRING(group.paths.front().filename().u8string() << " (" << group.paths.size() << " copies, " << group.size / 1024 << " KiB)"))) {
+			for (const auto& path : group.paths) {
+				no::ui::text(path.u8string());
+			}
+			if (!merge && !group.has_same_tags && no::ui::button("Merge tags")) {
+				start_merge({ i });
+			}
+			ImGui::TreePop();
+		}
+		ImGui::PopID();
+	}
+	ImGui::PopID();
+}
+
+void duplicates_ui::update_search() {
+	if (finder) {
+		if (auto result = finder->finish()) {
+			last_result = std::move(result);
+			finder = nullptr;
+			hashes.save();
+		} else {
+			const auto done = finder->bytes_hashed();
+			const auto total = finder->bytes_to_hash();
+			no::ui::text("Hashing files with the same size: %i of %i MiB", static_cast<int>(done / (1024 * 1024)), static_cast<int>(total / (1024 * 1024)));
+			ImGui::ProgressBar(total > 0 ? static_cast<float>(done) / static_cast<float>(total) : 0.0f);
+			return;
+		}
+	}
+	if (!merge && no::ui::button("Find duplicates")) {
+		if (!has_loaded_hashes) {
+			hashes.load();
+			has_loaded_hashes = true;
+		}
+		last_result = std::nullopt;
+		merge_failures.clear();
+		finder = std::make_unique<duplicate_finder>(caches, hashes);
+	}
+}
+
+void duplicates_ui::start_merge(std::vector<size_t> group_indices) {
+	if (group_indices.empty()) {
+		return;
+	}
+	std::vector<duplicate_group> groups;
+	for (const auto index : group_indices) {
+		groups.push_back(last_result->groups[index]);
+	}
+	merging_groups = std::move(group_indices);
+	merge = std::make_unique<duplicate_merge>(std::move(groups), caches, hashes);
+}
+
+void duplicates_ui::update_merge() {
+	if (!merge) {
+		return;
+	}
+	auto merged = merge->finish();
+	if (!merged) {
+		return;
+	}
+	merge = nullptr;
+	// there can be thousands of groups, so the paths are looked up instead of searched for in every group.
+	std::unordered_map<std::string, std::filesystem::path> new_paths;
+	for (const auto& [from, to] : merged->renamed_paths) {
+		new_paths.emplace(from.u8string(), to);
+	}
+	std::unordered_set<std::string> failed_paths;
+	for (const auto& failure : merged->failures) {
+		failed_paths.insert(failure.path.u8string());
+	}
+	for (const auto index : merging_groups) {
+		auto& group = last_result->groups[index];
+		group.has_same_tags = true;
+		for (auto& path : group.paths) {
+			const auto path_string = path.u8string();
+			if (const auto new_path = new_paths.find(path_string); new_path != new_paths.end()) {
+				path = new_path->second;
+			}
+			group.has_same_tags &= failed_paths.count(path_string) == 0;
+		}
+	}
+	merging_groups.clear();
+	std::move(merged->failures.begin(), merged->failures.end(), std::back_inserter(merge_failures));
+	if (on_paths_renamed && !merged->renamed_paths.empty()) {
+		on_paths_renamed(merged->renamed_paths);
+	}
+	hashes.save();
+}
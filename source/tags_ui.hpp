@@ -0,0 +1,158 @@
+#pragma once
+
+#include "tags.hpp"
+#include "retag.hpp"
+#include "duplicates.hpp"
+
+#include <functional>
+#include <future>
+#include <deque>
+
+class tag_picker {
+public:
+
+	// Returns the name of the tag that was picked this frame.
+	std::optional<std::string> update();
+	void reset();
+
+private:
+
+	std::string text;
+	int highlighted{ 0 };
+	bool must_focus{ true };
+
+};
+
+class manage_tag_ui {
+public:
+
+	using path_renames = std::vector<std::pair<std::filesystem::path, std::filesystem::path>>;
+
+	// Called when files were renamed because a tag was renamed, merged or deleted.
+	std::function<void(const path_renames& renames)> on_paths_renamed;
+
+	manage_tag_ui(search_path_cache_list& caches);
+
+	void open(const std::string& tag);
+	void close();
+	void update();
+
+	// Renames every searched file so its name has the tags in its attribute.
+	void mirror_tags_to_names();
+	bool is_retagging() const;
+
+private:
+
+	void start_retag(tag_operation_kind kind, const std::string& new_tag);
+	void update_retag();
+
+	search_path_cache_list& caches;
+	std::string original_name;
+	std::optional<tags::file_tag> tag;
+	int selected_group{ 0 };
+	tag_picker implication_picker;
+
+	// Only one tag is renamed in the files at a time.
+	std::unique_ptr<bulk_retag> retag;
+	std::optional<bulk_retag::result> last_retag_result;
+	tag_operation last_retag_operation;
+
+};
+
+class manage_tag_groups_ui {
+public:
+
+	void update();
+
+private:
+
+	std::string group_to_rename;
+	std::string new_group_name;
+	std::string new_group_name_to_create;
+
+};
+
+// Finds the tags used in the searched files that aren't in the registry yet, so they can be added to a group.
+class import_tags_ui {
+public:
+
+	import_tags_ui(search_path_cache_list& caches);
+
+	void update();
+
+private:
+
+	void discover();
+	void update_discovery();
+
+	search_path_cache_list& caches;
+	std::vector<discovered_tag> unknown_tags;
+	std::vector<bool> selected;
+	int group{ 0 };
+	bool has_discovered{ false };
+	std::future<std::vector<discovered_tag>> future_discovery; // last, so it's done before the rest is destroyed.
+
+};
+
+// Finds the copies of the same file in the searched directories, so their tags can be merged.
+class duplicates_ui {
+public:
+
+	// Called when files were renamed because their tags were merged.
+	std::function<void(const manage_tag_ui::path_renames& renames)> on_paths_renamed;
+
+	duplicates_ui(search_path_cache_list& caches);
+
+	void update();
+
+private:
+
+	void update_search();
+	void update_merge();
+	void start_merge(std::vector<size_t> group_indices);
+
+	search_path_cache_list& caches;
+	file_hash_cache hashes;
+	bool has_loaded_hashes{ false };
+	std::unique_ptr<duplicate_finder> finder;
+	std::optional<duplicate_finder::result> last_result;
+	std::vector<bulk_retag::failure> merge_failures;
+	std::vector<size_t> merging_groups; // the indices in the last result.
+	std::unique_ptr<duplicate_merge> merge; // last, since it updates the caches and the hashes.
+
+};
+
+class tag_system_ui {
+public:
+
+	tag_system_ui(search_path_cache_list& caches);
+
+	void update();
+
+	void set_on_paths_renamed(std::function<void(const manage_tag_ui::path_renames& renames)> callback);
+
+	// Adds or removes a tag in these files in the background. The operations are run one at a time, in order.
+	void retag_files(const tag_operation& operation, std::vector<std::filesystem::path> paths);
+
+private:
+
+	void update_storage_mode();
+	void update_file_retag();
+
+	search_path_cache_list& caches;
+	std::string new_tag_name;
+	int new_tag_group{ 0 };
+
+	std::string selected_group;
+	int selected_tag{ 0 };
+
+	manage_tag_ui manage_ui;
+	manage_tag_groups_ui groups_ui;
+	import_tags_ui import_ui;
+	duplicates_ui duplicates;
+
+	std::function<void(const manage_tag_ui::path_renames& renames)> on_paths_renamed;
+	std::deque<std::pair<tag_operation, std::vector<std::filesystem::path>>> queued_file_retags;
+	std::unique_ptr<bulk_retag> file_retag; // last, since it updates the caches.
+
+};